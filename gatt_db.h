@@ -19,13 +19,16 @@ extern const struct bg_gattdb_def bg_gattdb_data;
 #define gattdb_device_name                     11
 #define gattdb_button_state                    16
 #define gattdb_y_axis_value                    20
-#define gattdb_seconds                         24
-#define gattdb_ota_control                     35
-#define gattdb_temperature_measurement         38
-#define gattdb_temperature_type                41
-#define gattdb_intermediate_temperature         43
-#define gattdb_measurement_interval            46
-#define gattdb_valid_range                     48
-#define gattdb_tx_power_level                  51
+#define gattdb_history_control                 23
+#define gattdb_history_data                    25
+#define gattdb_live_retransmit                 28
+#define gattdb_seconds                         31
+#define gattdb_ota_control                     42
+#define gattdb_temperature_measurement         45
+#define gattdb_temperature_type                48
+#define gattdb_intermediate_temperature         50
+#define gattdb_measurement_interval            53
+#define gattdb_valid_range                     55
+#define gattdb_tx_power_level                  58
 
 #endif
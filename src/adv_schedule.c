@@ -0,0 +1,189 @@
+/*********************************************************************************************
+ *  @file adv_schedule.c
+ *	@brief Fast then slow connectable advertising of the server, see adv_schedule.h.
+ *
+ *  @authors : Sundar Krishnakumar (GATT server code)
+ *
+ *
+ *  @date      April 29, 2020 (last update)
+ *
+ **********************************************************************************************/
+#include "ble_device_type.h"
+#if BUILD_INCLUDES_BLE_CLIENT
+
+#else
+
+#include "adv_schedule.h"
+#include "native_gecko.h"
+#include "history.h"
+#include "log.h"
+
+
+adv_schedule_typedef adv_schedule;
+
+// 30 s fast for a reconnect, 250 ms (the old fixed interval) for 5 min, then 1 s and 2.5 s
+static const adv_schedule_stage_typedef adv_schedule_stages[] = {
+	{30, 30},
+	{250, 300},
+	{1000, 1800},
+	{2500, 0}
+};
+
+#define ADV_SCHEDULE_STAGES		(sizeof(adv_schedule_stages) / sizeof(adv_schedule_stages[0]))
+
+
+static uint32_t adv_schedule_ms_since(uint32_t ticks)
+{
+	return (uint32_t)((uint64_t)(history_time_ticks() - ticks) * 1000 / HISTORY_TIMER_FREQ);
+}
+
+// Events sent at the interval of the stage being left
+static void adv_schedule_count_events(void)
+{
+	adv_schedule.events += adv_schedule_ms_since(adv_schedule.stage_ticks) / adv_schedule_stages[adv_schedule.stage].interval_ms + 1;
+}
+
+static void adv_schedule_timer_set(uint32_t ticks)
+{
+	struct gecko_msg_hardware_set_soft_timer_rsp_t *ret = gecko_cmd_hardware_set_soft_timer(ticks, ADV_SCHEDULE_TIMER_HANDLE, 1);
+	if (ret->result != 0)
+	{
+		#if INCLUDE_LOGGING
+			LOG_ERROR("ERROR: %d | response code from gecko_cmd_hardware_set_soft_timer()", ret->result);
+		#endif
+	}
+}
+
+/** -------------------------------------------------------------------------------------------
+ * @brief (re)starts set 0 at the interval of 'stage'. The timing only applies when
+ * advertising is enabled, so a running set is stopped first.
+ *-------------------------------------------------------------------------------------------- **/
+static void adv_schedule_enter(uint8_t stage)
+{
+	const adv_schedule_stage_typedef *s = &adv_schedule_stages[stage];
+
+	if (adv_schedule.advertising)
+	{
+		adv_schedule_count_events();
+
+		struct gecko_msg_le_gap_stop_advertising_rsp_t *ret0 = gecko_cmd_le_gap_stop_advertising(ADV_SCHEDULE_HANDLE);
+		if (ret0->result != 0)
+		{
+			#if INCLUDE_LOGGING
+				LOG_ERROR("ERROR: %d | response code from gecko_cmd_le_gap_stop_advertising()", ret0->result);
+			#endif
+		}
+	}
+
+	struct gecko_msg_le_gap_set_advertise_timing_rsp_t *ret1 = gecko_cmd_le_gap_set_advertise_timing(ADV_SCHEDULE_HANDLE,
+			s->interval_ms * 8 / 5, s->interval_ms * 8 / 5, 0, 0);
+	if (ret1->result != 0)
+	{
+		#if INCLUDE_LOGGING
+			LOG_ERROR("ERROR: %d | response code from gecko_cmd_le_gap_set_advertise_timing()", ret1->result);
+		#endif
+	}
+	struct gecko_msg_le_gap_start_advertising_rsp_t *ret2 = gecko_cmd_le_gap_start_advertising(ADV_SCHEDULE_HANDLE,
+			le_gap_general_discoverable, le_gap_connectable_scannable);
+	if (ret2->result != 0)
+	{
+		#if INCLUDE_LOGGING
+			LOG_ERROR("ERROR: %d | response code from gecko_cmd_le_gap_start_advertising()", ret2->result);
+		#endif
+	}
+
+	adv_schedule.advertising = 1;
+	adv_schedule.stage = stage;
+	adv_schedule.stage_ticks = history_time_ticks();
+
+	// Last stage lasts until a client connects
+	adv_schedule_timer_set((uint32_t)s->duration_s * HISTORY_TIMER_FREQ);
+}
+
+
+// Boot and disconnect
+void adv_schedule_start(void)
+{
+
+	adv_schedule.advertising = 0;
+	adv_schedule.start_ticks = history_time_ticks();
+	adv_schedule_enter(0);
+
+}
+
+// ADV_SCHEDULE_TIMER_HANDLE expired, backs off to the next stage
+void adv_schedule_timer(void)
+{
+
+	if (adv_schedule.advertising && (uint32_t)adv_schedule.stage + 1 < ADV_SCHEDULE_STAGES)
+	{
+		adv_schedule_enter(adv_schedule.stage + 1);
+	}
+
+}
+
+// Connection opened, the stack has stopped set 0
+void adv_schedule_connected(void)
+{
+
+	if (adv_schedule.advertising == 0)
+	{
+		return;
+	}
+
+	adv_schedule_count_events();
+	adv_schedule.advertising = 0;
+	adv_schedule_timer_set(0);
+
+	adv_schedule.connects++;
+	adv_schedule.connect_ms = adv_schedule_ms_since(adv_schedule.start_ticks);
+	adv_schedule.connect_ms_sum += adv_schedule.connect_ms;
+	if (adv_schedule.connect_ms > adv_schedule.connect_ms_max)
+	{
+		adv_schedule.connect_ms_max = adv_schedule.connect_ms;
+	}
+
+	adv_schedule_log_stats();
+
+}
+
+// PB0 press or motion: fast again if it had backed off
+void adv_schedule_wake(void)
+{
+
+	if (adv_schedule.advertising && adv_schedule.stage != 0)
+	{
+		adv_schedule.wakes++;
+		adv_schedule_enter(0);
+	}
+
+}
+
+// Every sample, a tilt change of ADV_SCHEDULE_MOTION_CDEG since the last one is motion
+void adv_schedule_sample(uint16_t tilt_cdeg)
+{
+	int32_t change = (int32_t)tilt_cdeg - (int32_t)adv_schedule.last_tilt;
+
+	if (adv_schedule.last_tilt_valid && (change > ADV_SCHEDULE_MOTION_CDEG || change < -ADV_SCHEDULE_MOTION_CDEG))
+	{
+		adv_schedule_wake();
+	}
+
+	adv_schedule.last_tilt = tilt_cdeg;
+	adv_schedule.last_tilt_valid = 1;
+}
+
+void adv_schedule_log_stats(void)
+{
+
+	#if INCLUDE_LOGGING
+		LOG_INFO("Advertising: connected after %lu ms (stage %u), %lu connections, mean %lu ms max %lu ms, "
+				"%lu events, %lu wakes",
+				adv_schedule.connect_ms, adv_schedule.stage, adv_schedule.connects,
+				(adv_schedule.connects != 0) ? adv_schedule.connect_ms_sum / adv_schedule.connects : 0,
+				adv_schedule.connect_ms_max, adv_schedule.events, adv_schedule.wakes);
+	#endif
+
+}
+
+#endif
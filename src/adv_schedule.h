@@ -0,0 +1,71 @@
+/*********************************************************************************************
+ *  @file  adv_schedule.h
+ *	@brief Connectable advertising of the server (set 0), fast then slow. Advertising starts
+ *		   at a short interval so a client that just dropped, or is just looking, connects
+ *		   within a few of its scan windows, then backs off in stages to seconds when no
+ *		   client is around. A PB0 press or moving the sensor starts over from the fast
+ *		   stage.
+ *
+ *		   The advertising events sent are estimated from the time spent at each interval
+ *		   (the stack does not report them), time-to-connect is measured from the start of
+ *		   advertising (boot or disconnect) to the connection.
+ *
+ *  @authors : Sundar Krishnakumar (GATT server code)
+ *
+ *
+ *  @date      April 29, 2020 (last update)
+ *
+ **********************************************************************************************/
+#include "ble_device_type.h"
+#if BUILD_INCLUDES_BLE_CLIENT
+
+#else
+
+#ifndef __ADV_SCHEDULE_H__
+#define __ADV_SCHEDULE_H__
+
+#include <stdint.h>
+
+#define ADV_SCHEDULE_HANDLE				(0)		// connectable advertising set
+#define ADV_SCHEDULE_TIMER_HANDLE		(4)
+
+// Tilt change between two samples that counts as the sensor being moved
+#define ADV_SCHEDULE_MOTION_CDEG		(1000)
+
+typedef struct
+{
+	uint16_t interval_ms;
+	uint16_t duration_s;				// 0: until a client connects
+
+}adv_schedule_stage_typedef;
+
+typedef struct
+{
+	uint8_t advertising;				// 1 while set 0 advertises (not connected)
+	uint8_t stage;
+	uint32_t start_ticks;				// advertising started (boot or disconnect)
+	uint32_t stage_ticks;				// current stage entered
+	uint16_t last_tilt;
+	uint8_t last_tilt_valid;
+
+	uint32_t events;					// advertising events, estimated
+	uint32_t wakes;						// back to the fast stage on PB0 or motion
+	uint32_t connects;
+	uint32_t connect_ms;				// time-to-connect of the last connection
+	uint32_t connect_ms_sum;
+	uint32_t connect_ms_max;
+
+}adv_schedule_typedef;
+
+extern adv_schedule_typedef adv_schedule;
+
+void adv_schedule_start(void);
+void adv_schedule_timer(void);
+void adv_schedule_connected(void);
+void adv_schedule_wake(void);
+void adv_schedule_sample(uint16_t tilt_cdeg);
+void adv_schedule_log_stats(void);
+
+#endif /* __ADV_SCHEDULE_H__ */
+
+#endif
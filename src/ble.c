@@ -19,37 +19,34 @@
 
 #include "ble.h"
 #include "scheduler.h"
+#include "history.h"
+#include "live_frame.h"
+#include "gatt_cache.h"
+#include "broadcast.h"
+#include "periodic_stream.h"
+#include "scan_schedule.h"
+#include "body_fusion.h"
 //defines
 #define ORIENTATION_MARGIN (60)		//(ref_value - 30) to (ref_value + 30)
 
 const uint8_t IMU_service_UUID[16] = {0x94, 0x62, 0x13, 0x2d, 0x2a, 0x65, 0xec, 0x87, 0x3e, 0x43, 0xc8, 0x38, 0x01, 0x00, 0x00, 0x00};
 const uint8_t axis_orientation_char_UUID[16] = {0x95, 0x62, 0x13, 0x2d, 0x2a, 0x65, 0xec, 0x87, 0x3e, 0x43, 0xc8, 0x38, 0x01, 0x00, 0x00, 0x00};
+const uint8_t history_control_char_UUID[16] = {0x95, 0x62, 0x13, 0x2d, 0x2a, 0x65, 0xec, 0x87, 0x3e, 0x43, 0xc8, 0x38, 0x02, 0x00, 0x00, 0x00};
+const uint8_t history_data_char_UUID[16] = {0x95, 0x62, 0x13, 0x2d, 0x2a, 0x65, 0xec, 0x87, 0x3e, 0x43, 0xc8, 0x38, 0x03, 0x00, 0x00, 0x00};
+const uint8_t live_retransmit_char_UUID[16] = {0x95, 0x62, 0x13, 0x2d, 0x2a, 0x65, 0xec, 0x87, 0x3e, 0x43, 0xc8, 0x38, 0x04, 0x00, 0x00, 0x00};
 
 const uint8_t user_control_UUID[16] = {0x96, 0x62, 0x13, 0x2d, 0x2a, 0x65, 0xec, 0x87, 0x3e, 0x43, 0xc8, 0x38, 0x01, 0x00, 0x00, 0x00};
 const uint8_t time_until_trigger_char_UUID[16] = {0x97, 0x62, 0x13, 0x2d, 0x2a, 0x65, 0xec, 0x87, 0x3e, 0x43, 0xc8, 0x38, 0x01, 0x00, 0x00, 0x00};
 
-tx_power_based_on_rssi_t tx_power_based_on_rssi_table[] = {
-		{ RSSI_MAX, -35, TX_POWER_MIN },
-		{ -35, -45, -20 },
-		{ -45, -55, -15 },
-		{ -55, -65, -5 },
-		{ -65, -75, 0 },
-		{ -75, -85, 5 },
-		{ -85, RSSI_MIN, TX_POWER_MAX }
-};
-
-uint8_t tx_power_based_on_rssi_table_length = sizeof(tx_power_based_on_rssi_table) 	/ sizeof(tx_power_based_on_rssi_table[0]);
+const uint8_t generic_attribute_UUID[2] = {0x01, 0x18};
+const uint8_t database_hash_char_UUID[2] = {0x2A, 0x2B};
 
 ble_status_t ble_status = {
 		.connection_handle = 0,
 		.htp_indication_status = false,
-		.tx_power_based_on_rssi = tx_power_based_on_rssi_table,
 		.connection_status = DISCONNECTED
 };
 
-uint16_t y_axis_value;
-uint16_t y_axis_reference_value = 0;
-bool y_axis_reference_value_set = false;
 uint8_t* charValue;
 bool is_bad_posture = false;;
 
@@ -61,28 +58,37 @@ extern uint16_t pobp_tut_timer_seconds_initial_value;
 
 #if BUILD_INCLUDES_BLE_CLIENT
 
-ble_client_t ble_client ={
-	.status ={
-		.connection_handle = 0,
-		.htp_indication_status = false,
-		.tx_power_based_on_rssi = tx_power_based_on_rssi_table, // tx_power_based_on_rssi_table
-		.connection_status = DISCONNECTED},
-	.service = {
-		[IMU_SERVICE] = 			{.handle = 0, .procedure_complete_status = true},
-		[USER_CONTROL_SERVICE] = 	{.handle = 0, .procedure_complete_status = true}
-	},
-
-	.characteristic = {
-		[AXIS_ORIENTATION_CHARACTERISTIC] = 	{.handle = 0, .procedure_complete_status = true},
-		[TIMER_UNTIL_TRIGGER_CHARACTERISTIC] = 	{.handle = 0, .procedure_complete_status = true}
-	},
-
-	.indication ={
-		[AXIS_ORIENTATION_CHARACTERISTIC] = 	{.procedure_complete_status = true},
-		[TIMER_UNTIL_TRIGGER_CHARACTERISTIC] = 	{.procedure_complete_status = true}
-	}
+// Links to the servers, set up on boot by ble_client_reset()
+ble_client_t ble_client[CLIENT_MAX_SERVERS];
+
+// Servers connected to without a bond. Add the other wearables of the station here, bonded
+// servers are connected to as well.
+static const bd_addr server_addresses[] = {
+	SERVER_BT_ADDRESS
 };
 
+#define SERVER_ADDRESS_COUNT	(sizeof(server_addresses) / sizeof(server_addresses[0]))
+
+// What the client looks for on the server. Notifications / indications are turned on in table order.
+static const wanted_service_t wanted_service[SERVICE_COUNT] = {
+	[IMU_SERVICE] = 				{IMU_service_UUID, sizeof(IMU_service_UUID), true},
+	[USER_CONTROL_SERVICE] = 		{user_control_UUID, sizeof(user_control_UUID), true},
+	[GENERIC_ATTRIBUTE_SERVICE] = 	{generic_attribute_UUID, sizeof(generic_attribute_UUID), false}	// Database hash is read by UUID
+};
+
+static const wanted_characteristic_t wanted_characteristic[CHARACTERISTIC_COUNT] = {
+	[AXIS_ORIENTATION_CHARACTERISTIC] = 	{IMU_SERVICE, axis_orientation_char_UUID, sizeof(axis_orientation_char_UUID),
+												AXIS_ORIENTATION_NOTIFICATIONS ? gatt_notification : gatt_indication},
+	[TIMER_UNTIL_TRIGGER_CHARACTERISTIC] = 	{USER_CONTROL_SERVICE, time_until_trigger_char_UUID, sizeof(time_until_trigger_char_UUID), gatt_indication},
+	[HISTORY_CONTROL_CHARACTERISTIC] = 		{IMU_SERVICE, history_control_char_UUID, sizeof(history_control_char_UUID), gatt_disable},
+	[HISTORY_DATA_CHARACTERISTIC] = 		{IMU_SERVICE, history_data_char_UUID, sizeof(history_data_char_UUID), gatt_notification},
+	[LIVE_RETRANSMIT_CHARACTERISTIC] = 		{IMU_SERVICE, live_retransmit_char_UUID, sizeof(live_retransmit_char_UUID), gatt_disable},
+	[DATABASE_HASH_CHARACTERISTIC] = 		{GENERIC_ATTRIBUTE_SERVICE, database_hash_char_UUID, sizeof(database_hash_char_UUID), gatt_disable}
+};
+
+// Handles of the connected servers as found in the GATT cache, or as discovered, one per link
+gatt_cache_record_t gatt_cache_record[CLIENT_MAX_SERVERS];
+
 uint8_t* ptr_to_byte_array;
 #endif
 
@@ -92,6 +98,435 @@ uint8_t* ptr_to_byte_array;
 #endif
 
 #if BUILD_INCLUDES_BLE_CLIENT
+/** ---------------------------------------------------------------------------------------------------------
+ * @brief sets up a link, on boot and when another server takes it over. On disconnect only the connection
+ *	state is cleared, the server address and its posture reference stay with the link.
+ *--------------------------------------------------------------------------------------------------------- **/
+static void ble_client_reset(ble_client_t *client, uint8_t link)
+{
+	memset(client, 0, sizeof(*client));
+	client->link = link;
+	client->status.connection_status = DISCONNECTED;
+	client->discovery.state = DISCOVERY_IDLE;
+	client->bonding = BOND_HANDLE_INVALID;
+}
+
+// Link of an open connection, NULL if the connection is not one of ours
+static ble_client_t *ble_client_by_connection(uint8_t connection)
+{
+	for (uint8_t i = 0; i < CLIENT_MAX_SERVERS; i++)
+	{
+		if (ble_client[i].status.connection_status != DISCONNECTED && ble_client[i].status.connection_handle == connection)
+		{
+			return &ble_client[i];
+		}
+	}
+	return NULL;
+}
+
+// Link of a server, connected or not, NULL if it never had one
+static ble_client_t *ble_client_by_address(bd_addr address)
+{
+	for (uint8_t i = 0; i < CLIENT_MAX_SERVERS; i++)
+	{
+		if (ble_client[i].address_valid && is_device_found_by_address(address, ble_client[i].address))
+		{
+			return &ble_client[i];
+		}
+	}
+	return NULL;
+}
+
+// Link for a new connection to 'address': the one the server had before, else a free one, NULL if all are in use
+static ble_client_t *ble_client_free_link(bd_addr address)
+{
+	ble_client_t *client = ble_client_by_address(address);
+
+	if (client != NULL)
+	{
+		return (client->status.connection_status == DISCONNECTED) ? client : NULL;
+	}
+	for (uint8_t i = 0; i < CLIENT_MAX_SERVERS; i++)
+	{
+		if (ble_client[i].address_valid == false)
+		{
+			return &ble_client[i];
+		}
+	}
+	//all links have had a server: the first disconnected one is taken over
+	for (uint8_t i = 0; i < CLIENT_MAX_SERVERS; i++)
+	{
+		if (ble_client[i].status.connection_status == DISCONNECTED)
+		{
+			return &ble_client[i];
+		}
+	}
+	return NULL;
+}
+
+static uint8_t ble_client_connected_count(void)
+{
+	uint8_t count = 0;
+
+	for (uint8_t i = 0; i < CLIENT_MAX_SERVERS; i++)
+	{
+		if (ble_client[i].status.connection_status != DISCONNECTED)
+		{
+			count++;
+		}
+	}
+	return count;
+}
+
+// The sparkline follows the lowest link connected
+static bool is_display_link(const ble_client_t *client)
+{
+	for (uint8_t i = 0; i < client->link; i++)
+	{
+		if (ble_client[i].status.connection_status != DISCONNECTED)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+// Posture of a link against its reference, from its newest Y-axis value. Bad on any server is bad posture.
+static void posture_check(ble_client_t *client)
+{
+	if(client->y_axis_reference_value_set == true)
+	{
+		//if posture is within set margin
+		if(((client->y_axis_reference_value + (ORIENTATION_MARGIN / 2)) > client->y_axis_value)
+				&& (client->y_axis_value > (client->y_axis_reference_value - (ORIENTATION_MARGIN / 2))))
+		{
+			client->bad_posture = false;
+			LOG_DEBUG("In Good Posture (link %u)", client->link);
+		}
+		//if bad posture
+		else
+		{
+			client->bad_posture = true;
+			LOG_DEBUG("In Bad Posture (link %u)", client->link);
+		}
+	}
+
+	is_bad_posture = false;
+	for (uint8_t i = 0; i < CLIENT_MAX_SERVERS; i++)
+	{
+		is_bad_posture = is_bad_posture || ble_client[i].bad_posture;
+	}
+	#if BODY_FUSION
+		bool fused_bad_posture;
+
+		//two servers streaming: their relative orientation decides
+		if (body_fusion_posture(&fused_bad_posture))
+		{
+			is_bad_posture = fused_bad_posture;
+		}
+	#endif
+	if (is_bad_posture == false)
+	{
+		pobp_tut_timer_seconds = pobp_tut_timer_seconds_initial_value;
+	}
+}
+
+/** ---------------------------------------------------------------------------------------------------------
+ * @brief handles an Axis orientation frame (indication or notification): sparkline and posture check.
+ *	Posture is judged on the newest sample, resent frames only go to the sparkline.
+ *--------------------------------------------------------------------------------------------------------- **/
+static void axis_orientation_received(ble_client_t *client, const uint8_t *data, uint8_t len)
+{
+	live_sample_t samples[LIVE_FRAME_MAX_SAMPLES];
+	uint8_t count = live_client_frame(client->link, client->status.connection_handle,
+			client->characteristic[LIVE_RETRANSMIT_CHARACTERISTIC].handle, data, len, samples);
+
+	for (uint8_t i = 0; i < count && is_display_link(client); i++)
+	{
+		// Display to LCD
+		displaySparklineAddSample(samples[i].y);
+	}
+	if (count == 0 || (data[0] & LIVE_FRAME_FLAG_RETRANSMIT) != 0)
+	{
+		return;
+	}
+
+	client->y_axis_value = (uint16_t)samples[count - 1].y;
+	LOG_DEBUG("Y-xis value: %u millirad/s (%u samples, link %u)", client->y_axis_value, count, client->link);
+	#if BODY_FUSION
+		body_fusion_samples(client->link, samples, count);
+	#endif
+	posture_check(client);
+}
+
+#if PERIODIC_STREAM
+/** ---------------------------------------------------------------------------------------------------------
+ * @brief handles a packet of the server's periodic train: sparkline and posture check on the new samples.
+ *	The GATT stream takes over while connected, the sync is closed then. The train is only followed while
+ *	no server is connected, its samples are checked against the reference of the first link.
+ *--------------------------------------------------------------------------------------------------------- **/
+static void periodic_stream_received(const uint8_t *data, uint8_t len, uint8_t data_status)
+{
+	ble_client_t *client = &ble_client[0];
+	live_sample_t samples[PERIODIC_STREAM_SAMPLES];
+	uint8_t count = periodic_client_data(data, len, data_status, samples);
+
+	for (uint8_t i = 0; i < count; i++)
+	{
+		// Display to LCD
+		displaySparklineAddSample(samples[i].y);
+	}
+	if (count == 0)
+	{
+		return;
+	}
+
+	client->y_axis_value = (uint16_t)samples[count - 1].y;
+	LOG_DEBUG("Y-xis value: %u millirad/s (%u periodic samples)", client->y_axis_value, count);
+	posture_check(client);
+}
+#endif
+
+#if POSTURE_BROADCAST
+/** ---------------------------------------------------------------------------------------------------------
+ * @brief handles a new posture status from a server's broadcast. The server judges the posture
+ *	itself, against the upright reference it took at calibration.
+ *--------------------------------------------------------------------------------------------------------- **/
+static void posture_broadcast_received(const broadcast_status_t *status)
+{
+	LOG_DEBUG("Broadcast: session %u seq %u tilt %u cdeg flags 0x%x battery %u%%", status->session, status->seq,
+			status->tilt_cdeg, status->flags, status->battery);
+
+	if ((status->flags & BROADCAST_FLAG_CALIBRATED) == 0)
+	{
+		return;
+	}
+
+	if ((status->flags & BROADCAST_FLAG_BAD_POSTURE) == 0)
+	{
+		is_bad_posture = false;
+		pobp_tut_timer_seconds = pobp_tut_timer_seconds_initial_value;
+	}
+	else
+	{
+		is_bad_posture = true;
+	}
+}
+#endif
+
+/** ---------------------------------------------------------------------------------------------------------
+ * @brief true if a scan report is from one of our servers. With the accept list the controller has
+ *	already dropped the reports of any other device.
+ *--------------------------------------------------------------------------------------------------------- **/
+static bool is_server(bd_addr address)
+{
+	#if SCAN_ACCEPT_LIST
+		(void)address;
+		return true;
+	#else
+		for (uint8_t i = 0; i < SERVER_ADDRESS_COUNT; i++)
+		{
+			if (is_device_found_by_address(address, server_addresses[i]))
+			{
+				return true;
+			}
+		}
+		return false;
+	#endif
+}
+
+/** ---------------------------------------------------------------------------------------------------------
+ * @brief programs server_addresses[] into the controller's accept list and turns the filtering on for
+ *	scanning and connecting. Bonded servers are put on the list by the stack.
+ *--------------------------------------------------------------------------------------------------------- **/
+static void accept_list_enable(void)
+{
+	for (uint8_t i = 0; i < SERVER_ADDRESS_COUNT; i++)
+	{
+		BTSTACK_CHECK_RESPONSE(gecko_cmd_sm_add_to_whitelist(server_addresses[i], SERVER_BT_ADDRESS_TYPE));
+	}
+	BTSTACK_CHECK_RESPONSE(gecko_cmd_le_gap_enable_whitelisting(1));
+}
+
+/** ---------------------------------------------------------------------------------------------------------
+ * @brief scan report: the posture broadcast is taken from any server while none is connected, the
+ *	connection is made to ours if it has none yet and a link is free
+ *--------------------------------------------------------------------------------------------------------- **/
+static void device_found(bd_addr address, uint8_t address_type, const uint8_t *data, uint8_t len)
+{
+	//every report wakes the host
+	scan_schedule_report();
+
+	#if POSTURE_BROADCAST
+		broadcast_status_t broadcast_status;
+
+		if (broadcast_client_scan_report(address.addr, data, len, &broadcast_status) && ble_client_connected_count() == 0)
+		{
+			posture_broadcast_received(&broadcast_status);
+		}
+	#else
+		(void)data;
+		(void)len;
+	#endif
+	#if POSTURE_BROADCAST_ONLY
+		return;
+	#endif
+	LOG_DEBUG("Device found... checking if its a device of interest");
+	//Checking if address of discovered device matches with required address
+	if (is_server(address) && ble_client_free_link(address) != NULL)
+	{
+		//stop scanning
+		BTSTACK_CHECK_RESPONSE(gecko_cmd_le_gap_end_procedure());
+		scan_schedule_found();
+		//connect to a device, scanning goes on from connection_opened if a link is left
+		struct gecko_msg_le_gap_connect_rsp_t *ret = gecko_cmd_le_gap_connect(address, address_type, le_gap_phy_1m);
+		BTSTACK_CHECK_RESPONSE(ret);
+		if (ret->result != bg_err_success)
+		{
+			scan_schedule_start();
+		}
+	}
+}
+
+/** ---------------------------------------------------------------------------------------------------------
+ * @brief discovery is over: notifications / indications are on, the catch-up is asked for.
+ *	Logs the GATT procedures run and the time since the connection opened.
+ *--------------------------------------------------------------------------------------------------------- **/
+static void gatt_discovery_done(ble_client_t *client)
+{
+
+	client->discovery.state = DISCOVERY_DONE;
+	#if INCLUDE_LOGGING
+		uint32_t ms = (uint32_t)((uint64_t)(history_time_ticks() - client->discovery.start_ticks) * 1000 / HISTORY_TIMER_FREQ);
+
+		LOG_INFO("GATT discovery %u (%s): %u procedures, %lu ms, %lu connection intervals",
+				client->link, client->discovery.cached ? "cached handles" : "full", client->discovery.procedures, ms,
+				(client->discovery.interval != 0) ? ms * 4 / (client->discovery.interval * 5) : 0);
+	#endif
+	displayPrintf(DISPLAY_ROW_CONNECTION, "Handling Indications");
+
+	//asking for the samples missed while disconnected, servers without History are still handled
+	if (client->characteristic[HISTORY_CONTROL_CHARACTERISTIC].handle != 0
+			&& client->characteristic[HISTORY_DATA_CHARACTERISTIC].handle != 0)
+	{
+		history_client_request(client->link, client->status.connection_handle,
+				client->characteristic[HISTORY_CONTROL_CHARACTERISTIC].handle);
+	}
+}
+
+// Turns on the next notification / indication of wanted_characteristic[] from 'index' on, back to back
+static void gatt_discovery_next_cccd(ble_client_t *client, uint8_t index)
+{
+	for (; index < CHARACTERISTIC_COUNT; index++)
+	{
+		if (wanted_characteristic[index].cccd != gatt_disable && client->characteristic[index].handle != 0)
+		{
+			client->discovery.state = DISCOVERY_CCCD;
+			client->discovery.index = index;
+			client->discovery.procedures++;
+			BTSTACK_CHECK_RESPONSE(gecko_cmd_gatt_set_characteristic_notification(client->status.connection_handle,
+											client->characteristic[index].handle, wanted_characteristic[index].cccd));
+			return;
+		}
+	}
+
+	gatt_discovery_done(client);
+}
+
+// Full discovery: every primary service in one procedure, matched against wanted_service[]
+static void gatt_discovery_start(ble_client_t *client)
+{
+	client->discovery.state = DISCOVERY_SERVICES;
+	client->discovery.procedures++;
+	BTSTACK_CHECK_RESPONSE(gecko_cmd_gatt_discover_primary_services(client->status.connection_handle));
+}
+
+/** ---------------------------------------------------------------------------------------------------------
+ * @brief discovers the characteristics of the next wanted service found on the server, from 'index'
+ *	on (one procedure per service). Once all are known the Database hash is read so the handles can
+ *	be cached; servers without a Generic Attribute service go straight to the CCCDs.
+ *--------------------------------------------------------------------------------------------------------- **/
+static void gatt_discovery_next_service(ble_client_t *client, uint8_t index)
+{
+	for (; index < SERVICE_COUNT; index++)
+	{
+		if (wanted_service[index].discover_characteristics && client->service[index].handle != 0)
+		{
+			client->discovery.state = DISCOVERY_CHARACTERISTICS;
+			client->discovery.index = index;
+			client->discovery.procedures++;
+			BTSTACK_CHECK_RESPONSE(gecko_cmd_gatt_discover_characteristics(client->status.connection_handle,
+											client->service[index].handle));
+			return;
+		}
+	}
+
+	if (client->service[GENERIC_ATTRIBUTE_SERVICE].handle != 0)
+	{
+		client->database_hash_valid = false;
+		client->discovery.state = DISCOVERY_DATABASE_HASH;
+		client->discovery.procedures++;
+		BTSTACK_CHECK_RESPONSE(gecko_cmd_gatt_read_characteristic_value_by_uuid(client->status.connection_handle,
+										client->service[GENERIC_ATTRIBUTE_SERVICE].handle,
+										sizeof(database_hash_char_UUID), database_hash_char_UUID));
+		return;
+	}
+
+	gatt_discovery_next_cccd(client, 0);
+}
+
+/** ---------------------------------------------------------------------------------------------------------
+ * @brief the Database hash has been read (or the read failed, database_hash_valid is false).
+ *	After a cache lookup: an unchanged hash means the cached handles are still right, they are used
+ *	and discovery is skipped; otherwise a full discovery runs. After a discovery: the handles are
+ *	stored with the hash for the next reconnect.
+ *--------------------------------------------------------------------------------------------------------- **/
+static void gatt_discovery_database_hash_read(ble_client_t *client)
+{
+	gatt_cache_record_t *record = &gatt_cache_record[client->link];
+
+	if (client->discovery.state == DISCOVERY_CACHE_CHECK)
+	{
+		if (client->database_hash_valid
+				&& memcmp(client->database_hash, record->database_hash, DATABASE_HASH_LEN) == 0)
+		{
+			LOG_DEBUG("GATT cache hit, discovery skipped");
+			for (uint8_t i = 0; i < SERVICE_COUNT; i++)
+			{
+				client->service[i].handle = record->service[i];
+			}
+			for (uint8_t i = 0; i < CHARACTERISTIC_COUNT; i++)
+			{
+				client->characteristic[i].handle = record->characteristic[i];
+			}
+			client->discovery.cached = true;
+			live_client_gatt_cache_used(client->link);
+			gatt_discovery_next_cccd(client, 0);
+		}
+		else
+		{
+			LOG_DEBUG("GATT database changed, discovering again");
+			gatt_discovery_start(client);
+		}
+		return;
+	}
+
+	if (client->database_hash_valid)
+	{
+		memcpy(record->database_hash, client->database_hash, DATABASE_HASH_LEN);
+		for (uint8_t i = 0; i < SERVICE_COUNT; i++)
+		{
+			record->service[i] = client->service[i].handle;
+		}
+		for (uint8_t i = 0; i < CHARACTERISTIC_COUNT; i++)
+		{
+			record->characteristic[i] = (uint16_t)client->characteristic[i].handle;
+		}
+		gatt_cache_store(record);
+	}
+	gatt_discovery_next_cccd(client, 0);
+}
+
 /** ---------------------------------------------------------------------------------------------------------
  * @brief event handlers for gecko bluetooth client's events
  *	Events :
@@ -102,6 +537,7 @@ uint8_t* ptr_to_byte_array;
  *		characteristic found : gecko_evt_gatt_characteristic_id
  *		procedure completed : gecko_evt_gatt_procedure_completed_id
  *		indication set up : gecko_evt_gatt_characteristic_value_id
+ *		connection interval : gecko_evt_le_connection_parameters_id
  *		rssi value got changed : gecko_evt_le_connection_rssi_id
  *		Disconnected : gecko_evt_le_connection_closed_id
  *		1Hz : gecko_evt_hardware_soft_timer_id
@@ -116,11 +552,11 @@ uint8_t* ptr_to_byte_array;
 void handle_ble_event_client(struct gecko_cmd_packet *event)
 {
 		struct gecko_msg_system_get_bt_address_rsp_t* bt_address;
-		static bd_addr server_address = SERVER_BT_ADDRESS;
 		char passkey_str[10];
-		static bd_addr servers_address_on_connection;
+		bd_addr servers_address_on_connection;
 		int8_t rssi;
 		char bluetooth_addr[18];
+		ble_client_t *client;
 
 		switch (BGLIB_MSG_ID(event->header)) {
 
@@ -134,10 +570,18 @@ void handle_ble_event_client(struct gecko_cmd_packet *event)
 						bt_address->address.addr[0]);
 				displayPrintf(DISPLAY_ROW_BTADDR, bluetooth_addr);
 
+				for (uint8_t i = 0; i < CLIENT_MAX_SERVERS; i++)
+				{
+					ble_client_reset(&ble_client[i], i);
+				}
+
 				//setting Tx power to default value of 0
 				gecko_cmd_system_set_tx_power(0);
-				//delete bonding on boot... device would be required to pair again on connection
-				BTSTACK_CHECK_RESPONSE(gecko_cmd_sm_delete_bondings());
+				//largest ATT MTU so a whole frame of samples fits one indication
+				BTSTACK_CHECK_RESPONSE(gecko_cmd_gatt_set_max_mtu(LIVE_FRAME_ATT_MTU_MAX));
+				//bonds are kept, a bonded server is only encrypted again on reconnect
+				BTSTACK_CHECK_RESPONSE(gecko_cmd_sm_set_bondable_mode(1));
+				BTSTACK_CHECK_RESPONSE(gecko_cmd_sm_store_bonding_configuration(BOND_MAX_PEERS, BOND_POLICY_REPLACE_LRU));
 				//gecko_cmd_sm_configure(0b00000001,1);//configure as 'bonding request needs to be configured' and 1 for Display with Yes/No-buttons
 				//Configure security manager here
 				struct gecko_msg_sm_configure_rsp_t *ret_sm_configure = gecko_cmd_sm_configure(SM_CONFIG_FLAGS, IO_CAPABILITY);
@@ -149,48 +593,107 @@ void handle_ble_event_client(struct gecko_cmd_packet *event)
 				}
 				//setting up discovery type to passive
 				BTSTACK_CHECK_RESPONSE(gecko_cmd_le_gap_set_discovery_type(le_gap_phy_1m, 0));	//PHY = 1 and Scanning Type = Passive(0)
-				//setting up discovery timing
-				BTSTACK_CHECK_RESPONSE(gecko_cmd_le_gap_set_discovery_timing(le_gap_phy_1m, 80, 40));
-
+				#if PERIODIC_STREAM
+					//extended reports carry the periodic interval and SID to sync to
+					BTSTACK_CHECK_RESPONSE(gecko_cmd_le_gap_set_discovery_extended_scan_response(1));
+				#endif
 				// Set connection timing parameters
 				BTSTACK_CHECK_RESPONSE(gecko_cmd_le_gap_set_conn_parameters(CONN_INTERVAL_MIN, CONN_INTERVAL_MAX,
 						                                             CONN_SLAVE_LATENCY,
 						                                             CONN_TIMEOUT));
-				//starting discovery
-				BTSTACK_CHECK_RESPONSE(gecko_cmd_le_gap_start_discovery(le_gap_phy_1m, le_gap_discover_generic));
+				#if SCAN_ACCEPT_LIST
+					accept_list_enable();
+				#endif
+				//starting discovery, fast then backing off (scan_schedule.h)
+				scan_schedule_start();
 
 				displayPrintf(DISPLAY_ROW_CONNECTION, "Discovering");
 				break;
 
 				//Event occurs when any bluetooth device is found
 			case gecko_evt_le_gap_scan_response_id:
-				LOG_DEBUG("Device found... checking if its a device of interest");
-				//Checking if address of discovered device matches with required address
-				if (is_device_found_by_address(event->data.evt_le_gap_scan_response.address, server_address))
+				device_found(event->data.evt_le_gap_scan_response.address, event->data.evt_le_gap_scan_response.address_type,
+						event->data.evt_le_gap_scan_response.data.data, event->data.evt_le_gap_scan_response.data.len);
+				break;
+
+			#if PERIODIC_STREAM
+				//Same, reported this way once extended scan reports are on (boot)
+			case gecko_evt_le_gap_extended_scan_response_id:
+				//the train is followed while no server is connected
+				if (is_server(event->data.evt_le_gap_extended_scan_response.address) && ble_client_connected_count() == 0)
 				{
-					//stop scanning
-					BTSTACK_CHECK_RESPONSE(gecko_cmd_le_gap_end_procedure());
-					//connect to a device
-					BTSTACK_CHECK_RESPONSE(gecko_cmd_le_gap_connect(event->data.evt_le_gap_scan_response.address,
-							event->data.evt_le_gap_scan_response.address_type, le_gap_phy_1m));
+					periodic_client_scan_report(event->data.evt_le_gap_extended_scan_response.address,
+							event->data.evt_le_gap_extended_scan_response.address_type,
+							event->data.evt_le_gap_extended_scan_response.adv_sid,
+							event->data.evt_le_gap_extended_scan_response.periodic_interval);
 				}
+				device_found(event->data.evt_le_gap_extended_scan_response.address,
+						event->data.evt_le_gap_extended_scan_response.address_type,
+						event->data.evt_le_gap_extended_scan_response.data.data,
+						event->data.evt_le_gap_extended_scan_response.data.len);
+				break;
+
+				//Events of the server's periodic train
+			case gecko_evt_sync_opened_id:
+				periodic_client_sync_opened(event->data.evt_sync_opened.sync);
+				break;
+
+			case gecko_evt_sync_closed_id:
+				periodic_client_sync_closed();
+				break;
+
+			case gecko_evt_sync_data_id:
+				periodic_stream_received(event->data.evt_sync_data.data.data, event->data.evt_sync_data.data.len,
+						event->data.evt_sync_data.data_status);
 				break;
+			#endif
 
 				//Event occurs when client is connected over bluetooth
 			case gecko_evt_le_connection_opened_id:
-				//displaying server's address on LCD
 				servers_address_on_connection = event->data.evt_le_connection_opened.address;
+				client = ble_client_free_link(servers_address_on_connection);
+				if (client == NULL)
+				{
+					BTSTACK_CHECK_RESPONSE(gecko_cmd_le_connection_close(event->data.evt_le_connection_opened.connection));
+					break;
+				}
+				if (client->address_valid == false || !is_device_found_by_address(servers_address_on_connection, client->address))
+				{
+					//new server on this link, its posture reference is taken again
+					ble_client_reset(client, client->link);
+					client->address = servers_address_on_connection;
+					client->address_valid = true;
+				}
+				//displaying server's address on LCD
 				sprintf(bluetooth_addr, "%x:%x:%x:%x:%x:%x", servers_address_on_connection.addr[5],
 						servers_address_on_connection.addr[4], servers_address_on_connection.addr[3],
 						servers_address_on_connection.addr[2], servers_address_on_connection.addr[1],
 						servers_address_on_connection.addr[0]);
 				displayPrintf(DISPLAY_ROW_BTADDR2, bluetooth_addr);
 				displayPrintf(DISPLAY_ROW_CONNECTION, "Connected");	//Displaying bluetooth connected over LCD
-				LOG_DEBUG("Device connected");
-				ble_client.status.connection_handle = event->data.evt_le_connection_opened.connection;
-				ble_client.status.connection_status = CONNECTED;
+				LOG_DEBUG("Device connected (link %u)", client->link);
+				client->status.connection_handle = event->data.evt_le_connection_opened.connection;
+				client->status.connection_status = CONNECTED;
+				client->bonding = event->data.evt_le_connection_opened.bonding;
+				client->discovery.start_ticks = history_time_ticks();
+				client->discovery.procedures = 0;
+				client->discovery.cached = false;
+				live_client_connection_opened(client->link);
+				tx_power_connection_opened(client->link);
+				link_phy_connection_opened(client->link, client->status.connection_handle);
+				#if BODY_FUSION
+					body_fusion_link_reset(client->link);
+				#endif
+				#if PERIODIC_STREAM
+					periodic_client_close();
+				#endif
+				//looking for the other servers while a link is left
+				if (ble_client_connected_count() < CLIENT_MAX_SERVERS)
+				{
+					scan_schedule_start();
+				}
 
-				struct gecko_msg_sm_increase_security_rsp_t *ret_increase_security = gecko_cmd_sm_increase_security(ble_client.status.connection_handle);
+				struct gecko_msg_sm_increase_security_rsp_t *ret_increase_security = gecko_cmd_sm_increase_security(client->status.connection_handle);
 				if (ret_increase_security->result != 0)
 				{
 					#if INCLUDE_LOGGING
@@ -198,124 +701,129 @@ void handle_ble_event_client(struct gecko_cmd_packet *event)
 					#endif
 				}
 
-				//searching for button service at connection
-				BTSTACK_CHECK_RESPONSE(gecko_cmd_gatt_discover_primary_services_by_uuid(ble_client.status.connection_handle,
-						16, (const uint8_t* )IMU_service_UUID));	//uuid length is 16 bytes
-				ble_client.service[IMU_SERVICE].procedure_complete_status = false;
+				//known server: read its Database hash at the cached handle, the other handles are used if it is unchanged
+				if (gatt_cache_lookup(servers_address_on_connection, &gatt_cache_record[client->link])
+						&& gatt_cache_record[client->link].characteristic[DATABASE_HASH_CHARACTERISTIC] != 0)
+				{
+					client->database_hash_valid = false;
+					client->discovery.state = DISCOVERY_CACHE_CHECK;
+					client->discovery.procedures++;
+					BTSTACK_CHECK_RESPONSE(gecko_cmd_gatt_read_characteristic_value(client->status.connection_handle,
+							gatt_cache_record[client->link].characteristic[DATABASE_HASH_CHARACTERISTIC]));
+				}
+				else
+				{
+					memset(&gatt_cache_record[client->link], 0, sizeof(gatt_cache_record[client->link]));
+					gatt_cache_record[client->link].address = servers_address_on_connection;
+					//discovering all services at connection
+					gatt_discovery_start(client);
+				}
 
 				break;
 
 				//Event occurs when service for which discovery initiated is found
 			case gecko_evt_gatt_service_id:
-//				LOG_DEBUG("Service found");
-				if(!strncmp((const char *)event->data.evt_gatt_service.uuid.data, (const char *)IMU_service_UUID, sizeof(IMU_service_UUID)))
+				client = ble_client_by_connection(event->data.evt_gatt_service.connection);
+				if (client == NULL)
 				{
-					ble_client.service[IMU_SERVICE].handle = event->data.evt_gatt_service.service;	//interested service found ... here server_button
-//					LOG_DEBUG("IMU Service found");
+					break;
 				}
-				else if(!strncmp((const char *)event->data.evt_gatt_service.uuid.data, (const char *)user_control_UUID, sizeof(user_control_UUID)))
+//				LOG_DEBUG("Service found");
+				//keeping the services of interest, all primary services are reported
+				for (uint8_t i = 0; i < SERVICE_COUNT; i++)
 				{
-					ble_client.service[USER_CONTROL_SERVICE].handle = event->data.evt_gatt_service.service;	//interested service found ... here server_button
-//						LOG_DEBUG("User control Service found");
+					if ((event->data.evt_gatt_service.uuid.len == wanted_service[i].uuid_len)
+							&& !memcmp(event->data.evt_gatt_service.uuid.data, wanted_service[i].uuid, wanted_service[i].uuid_len))
+					{
+						client->service[i].handle = event->data.evt_gatt_service.service;
+						break;
+					}
 				}
 				break;
 
 				//Event occurs when service for which discovery initiated is found
 			case gecko_evt_gatt_characteristic_id:
-//				LOG_DEBUG("Characteristic found");
-				if(!strncmp((const char *)event->data.evt_gatt_characteristic.uuid.data, (const char *)axis_orientation_char_UUID, sizeof(axis_orientation_char_UUID)))
+				client = ble_client_by_connection(event->data.evt_gatt_characteristic.connection);
+				if (client == NULL)
 				{
-					ble_client.characteristic[AXIS_ORIENTATION_CHARACTERISTIC].handle = event->data.evt_gatt_characteristic.characteristic;	//interested service found ... here server_button
-//					LOG_DEBUG("Axis Orientation characteristic found");
+					break;
 				}
-				else if(!strncmp((const char *)event->data.evt_gatt_characteristic.uuid.data, (const char *)time_until_trigger_char_UUID, sizeof(time_until_trigger_char_UUID)))
+//				LOG_DEBUG("Characteristic found");
+				//characteristics of interest in the service being discovered
+				for (uint8_t i = 0; i < CHARACTERISTIC_COUNT; i++)
 				{
-					ble_client.characteristic[TIMER_UNTIL_TRIGGER_CHARACTERISTIC].handle = event->data.evt_gatt_characteristic.characteristic;	//interested service found ... here server_button
-//					LOG_DEBUG("Time until characteristic characteristic found");
+					if ((wanted_characteristic[i].service == client->discovery.index)
+							&& (event->data.evt_gatt_characteristic.uuid.len == wanted_characteristic[i].uuid_len)
+							&& !memcmp(event->data.evt_gatt_characteristic.uuid.data, wanted_characteristic[i].uuid, wanted_characteristic[i].uuid_len))
+					{
+						client->characteristic[i].handle = event->data.evt_gatt_characteristic.characteristic;
+						break;
+					}
 				}
 				break;
 
 
 				//Event occurs when procedure for various actions is completed
 			case gecko_evt_gatt_procedure_completed_id:
-				//handling procedure completed with error
-				if (event->data.evt_gatt_procedure_completed.result != 0)
+				client = ble_client_by_connection(event->data.evt_gatt_procedure_completed.connection);
+				if (client == NULL)
 				{
-					LOG_DEBUG("Procedure completed with error %d", event->data.evt_gatt_procedure_completed.result);
+					break;
 				}
-				else
+				//handling procedure completed with error, discovery goes on with what was found so far
+				if (event->data.evt_gatt_procedure_completed.result != 0)
 				{
-					//checking if procedure completed is for service discovery which would be executed only once on coonection
-					if (ble_client.service[IMU_SERVICE].procedure_complete_status == false)
+					LOG_DEBUG("Procedure completed with error %d", event->data.evt_gatt_procedure_completed.result);
+					if ((client->discovery.state == DISCOVERY_CACHE_CHECK) || (client->discovery.state == DISCOVERY_DATABASE_HASH))
 					{
-//						LOG_DEBUG("Procedure completed for service IMU service read");
-						ble_client.service[IMU_SERVICE].procedure_complete_status = true;
-
-						ble_client.characteristic[AXIS_ORIENTATION_CHARACTERISTIC].procedure_complete_status = false;
-						//discovering Axis orientation characteristic under IMU service
-						BTSTACK_CHECK_RESPONSE(gecko_cmd_gatt_discover_characteristics_by_uuid(ble_client.status.connection_handle,
-														ble_client.service[IMU_SERVICE].handle, 16, (const uint8_t* )axis_orientation_char_UUID)); //uuid length is 2 bytes
-
+						client->database_hash_valid = false;
 					}
-					else if(ble_client.characteristic[AXIS_ORIENTATION_CHARACTERISTIC].procedure_complete_status == false)
-					{
-//						LOG_DEBUG("Procedure completed for char Axis characteristic read");
-						ble_client.characteristic[AXIS_ORIENTATION_CHARACTERISTIC].procedure_complete_status = true;
+				}
 
-						ble_client.service[USER_CONTROL_SERVICE].procedure_complete_status = false;
-						//discovering User control service
-						BTSTACK_CHECK_RESPONSE(gecko_cmd_gatt_discover_primary_services_by_uuid(ble_client.status.connection_handle,
-																						16, (const uint8_t* )user_control_UUID));	//uuid length is 16 bytes
-					}
-					else if (ble_client.service[USER_CONTROL_SERVICE].procedure_complete_status == false)
-					{
-//						LOG_DEBUG("Procedure completed service for User control service read");
-						ble_client.service[USER_CONTROL_SERVICE].procedure_complete_status = true;
+				//next step of the discovery, each step is a single GATT procedure
+				switch (client->discovery.state)
+				{
+					case DISCOVERY_CACHE_CHECK:
+					case DISCOVERY_DATABASE_HASH:
+						gatt_discovery_database_hash_read(client);
+						break;
 
-						ble_client.characteristic[TIMER_UNTIL_TRIGGER_CHARACTERISTIC].procedure_complete_status = false;
-						//discovering Time until trigger characteristic under IMU service
-						BTSTACK_CHECK_RESPONSE(gecko_cmd_gatt_discover_characteristics_by_uuid(ble_client.status.connection_handle,
-														ble_client.service[USER_CONTROL_SERVICE].handle, 16, (const uint8_t* )time_until_trigger_char_UUID)); //uuid length is 2 bytes
-					}
-					else if(ble_client.characteristic[TIMER_UNTIL_TRIGGER_CHARACTERISTIC].procedure_complete_status == false)
-					{
-//						LOG_DEBUG("Procedure completed for char Time Until Trigger characteristic read");
-						ble_client.characteristic[TIMER_UNTIL_TRIGGER_CHARACTERISTIC].procedure_complete_status = true;
+					case DISCOVERY_SERVICES:
+						gatt_discovery_next_service(client, 0);
+						break;
 
-						ble_client.indication[AXIS_ORIENTATION_CHARACTERISTIC].procedure_complete_status = false;
-						//turning on indications for AXIS_ORIENTATION_CHARACTERISTIC
-						BTSTACK_CHECK_RESPONSE(gecko_cmd_gatt_set_characteristic_notification(ble_client.status.connection_handle,
-														ble_client.characteristic[AXIS_ORIENTATION_CHARACTERISTIC].handle, gatt_indication));
-					}
-					else if(ble_client.indication[AXIS_ORIENTATION_CHARACTERISTIC].procedure_complete_status == false)
-					{
-//						LOG_DEBUG("Procedure completed for Axis Orientation indication");
-						ble_client.indication[AXIS_ORIENTATION_CHARACTERISTIC].procedure_complete_status = true;
+					case DISCOVERY_CHARACTERISTICS:
+						gatt_discovery_next_service(client, client->discovery.index + 1);
+						break;
 
-						ble_client.indication[TIMER_UNTIL_TRIGGER_CHARACTERISTIC].procedure_complete_status = false;
-						//turning on indications for AXIS_ORIENTATION_CHARACTERISTIC
-						BTSTACK_CHECK_RESPONSE(gecko_cmd_gatt_set_characteristic_notification(ble_client.status.connection_handle,
-														ble_client.characteristic[TIMER_UNTIL_TRIGGER_CHARACTERISTIC].handle, gatt_indication));
-					}
-					else if(ble_client.indication[TIMER_UNTIL_TRIGGER_CHARACTERISTIC].procedure_complete_status == false)
-					{
-//						LOG_DEBUG("Procedure completed for Time Until Trigger indication");
-						LOG_DEBUG("Indications turned on for both the characteristics");
-						ble_client.indication[TIMER_UNTIL_TRIGGER_CHARACTERISTIC].procedure_complete_status = true;
-						displayPrintf(DISPLAY_ROW_CONNECTION, "Handling Indications");
-					}
+					case DISCOVERY_CCCD:
+						gatt_discovery_next_cccd(client, client->discovery.index + 1);
+						break;
 
+					default:
+						//writes after the discovery (History control, Live retransmit)
+						break;
 				}
 				break;
 
 			case gecko_evt_system_external_signal_id:
-
+				//user at the desk: scan fast again for the server
+				if (event->data.evt_system_external_signal.extsignals
+						& (PROXIMITY_DETECTED | PB0_SWITCH_HIGH_TO_LOW | PB1_SWITCH_LOW_TO_HIGH))
+				{
+					scan_schedule_wake();
+				}
 				break;
 
 
 				//This event is triggered if pairing or bonding was performed in this operation and the result is success.
 			case gecko_evt_sm_bonded_id:
-				ble_client.status.connection_status = BONDED;
+				client = ble_client_by_connection(event->data.evt_sm_bonded.connection);
+				if (client == NULL)
+				{
+					break;
+				}
+				client->status.connection_status = BONDED;
 				displayPrintf(DISPLAY_ROW_PASSKEY, "");
 //				displayPrintf(DISPLAY_ROW_ACTION, "");
 				displayPrintf(DISPLAY_ROW_CONNECTION, "Bonded");
@@ -323,67 +831,93 @@ void handle_ble_event_client(struct gecko_cmd_packet *event)
 
 				//This event is triggered if pairing or bonding was performed in this operation and the result is failure.
 			case gecko_evt_sm_bonding_failed_id:
+				client = ble_client_by_connection(event->data.evt_sm_bonding_failed.connection);
+				if (client == NULL)
+				{
+					break;
+				}
 				displayPrintf(DISPLAY_ROW_PASSKEY, "");
 //				displayPrintf(DISPLAY_ROW_ACTION, "");
 				displayPrintf(DISPLAY_ROW_CONNECTION, "Bonding Failed");
+				//server lost its keys: drop the stale bond so the next connection pairs again
+				if (client->bonding != BOND_HANDLE_INVALID)
+				{
+					BTSTACK_CHECK_RESPONSE(gecko_cmd_sm_delete_bonding(client->bonding));
+					client->bonding = BOND_HANDLE_INVALID;
+				}
 				break;
 
 
 			case gecko_evt_sm_confirm_passkey_id:
+				client = ble_client_by_connection(event->data.evt_sm_confirm_passkey.connection);
+				if (client == NULL)
+				{
+					break;
+				}
 				LOG_DEBUG("Passkey : %d",event->data.evt_sm_confirm_passkey.passkey);
 				sprintf(passkey_str, "%d", (int)event->data.evt_sm_confirm_passkey.passkey);
 				displayPrintf(DISPLAY_ROW_PASSKEY, passkey_str);
 //				displayPrintf(DISPLAY_ROW_ACTION, "Confirm with PB0");
 				//PB0 shall react to bonding event only when state is 'passkey confirmation'
-				ble_client.status.connection_status = BONDING;
+				client->status.connection_status = BONDING;
 
 				break;
 
 			case gecko_evt_gatt_characteristic_value_id:
+				client = ble_client_by_connection(event->data.evt_gatt_characteristic_value.connection);
+				if (client == NULL)
+				{
+					break;
+				}
+				link_phy_value(client->link, event->data.evt_gatt_characteristic_value.value.len);
+				//Database hash, read by handle (cache check) or by UUID (after a discovery)
+				if (((client->discovery.state == DISCOVERY_CACHE_CHECK) || (client->discovery.state == DISCOVERY_DATABASE_HASH))
+						&& ((event->data.evt_gatt_characteristic_value.att_opcode == gatt_read_response)
+								|| (event->data.evt_gatt_characteristic_value.att_opcode == gatt_read_by_type_response)))
+				{
+					if (event->data.evt_gatt_characteristic_value.value.len == DATABASE_HASH_LEN)
+					{
+						client->characteristic[DATABASE_HASH_CHARACTERISTIC].handle = event->data.evt_gatt_characteristic_value.characteristic;
+						memcpy(client->database_hash, event->data.evt_gatt_characteristic_value.value.data, DATABASE_HASH_LEN);
+						client->database_hash_valid = true;
+					}
+					break;
+				}
 				if(event->data.evt_gatt_characteristic_value.att_opcode == gatt_handle_value_indication)
 				{
-					if (ble_client.characteristic[AXIS_ORIENTATION_CHARACTERISTIC].handle == event->data.evt_gatt_characteristic_value.characteristic)
+					if (client->characteristic[AXIS_ORIENTATION_CHARACTERISTIC].handle == event->data.evt_gatt_characteristic_value.characteristic)
 					{
-						charValue = &(event->data.evt_gatt_characteristic_value.value.data[0]);
+						axis_orientation_received(client, event->data.evt_gatt_characteristic_value.value.data,
+								event->data.evt_gatt_characteristic_value.value.len);
 
-						y_axis_value = (charValue[1] << 0) + (charValue[2] << 8);
-						// Display to LCD
-
-						LOG_DEBUG("Y-xis value: %u millirad/s", y_axis_value);
 						// Send confirmation for the indication
 						BTSTACK_CHECK_RESPONSE(gecko_cmd_gatt_send_characteristic_confirmation(event->data.evt_gatt_characteristic_value.connection));
 						// Trigger the RSSI measurement on the connection handle for this connection.
 						// Removed. TX power management done on server side only.
+					}
+					if (client->characteristic[TIMER_UNTIL_TRIGGER_CHARACTERISTIC].handle == event->data.evt_gatt_characteristic_value.characteristic)
+					{
+						charValue = &(event->data.evt_gatt_characteristic_value.value.data[0]);
 
-
-						if(y_axis_reference_value_set == true)
+						//a calibrated server sends the upright reference it keeps in flash, it is used as is
+						if(event->data.evt_gatt_characteristic_value.value.len >= TUT_UPRIGHT_LEN && (charValue[0] & TUT_FLAG_UPRIGHT) != 0)
 						{
-							//if posture is within set margin
-							if(((y_axis_reference_value + (ORIENTATION_MARGIN / 2)) > y_axis_value) && (y_axis_value > (y_axis_reference_value - (ORIENTATION_MARGIN / 2))))
-							{
-								is_bad_posture = false;
-								pobp_tut_timer_seconds = pobp_tut_timer_seconds_initial_value;
-								LOG_DEBUG("In Good Posture");
-							}
-							//if bad posture
-							else
-							{
-								is_bad_posture = true;
-								LOG_DEBUG("In Bad Posture");
-							}
+							client->y_axis_reference_value = BYTES_TO_UINT16(charValue[2], charValue[3]);
+							LOG_DEBUG("Reference value of link %u is the server's upright %u", client->link, client->y_axis_reference_value);
 						}
-					}
-					if (ble_client.characteristic[TIMER_UNTIL_TRIGGER_CHARACTERISTIC].handle == event->data.evt_gatt_characteristic_value.characteristic)
-					{
-						//setting reference value for orientation at first TUT value
-						if(y_axis_reference_value_set == false)
+						//otherwise the reference is taken at the first TUT value of the server
+						else if(client->y_axis_reference_value_set == false)
 						{
-
-							y_axis_reference_value = y_axis_value;
-							LOG_DEBUG("Reference value is set to %u", y_axis_reference_value);
-							y_axis_reference_value_set = true;
+							client->y_axis_reference_value = client->y_axis_value;
+							LOG_DEBUG("Reference value of link %u is set to %u", client->link, client->y_axis_reference_value);
+						}
+						if(client->y_axis_reference_value_set == false)
+						{
+							client->y_axis_reference_value_set = true;
+							#if BODY_FUSION
+								body_fusion_calibrate(client->link);
+							#endif
 						}
-						charValue = &(event->data.evt_gatt_characteristic_value.value.data[0]);
 
 						pobp_tut_timer_seconds_initial_value = (charValue[1] << 0);
 						pobp_tut_timer_seconds = pobp_tut_timer_seconds_initial_value;
@@ -396,65 +930,130 @@ void handle_ble_event_client(struct gecko_cmd_packet *event)
 
 					break;
 				}
+				else if ((event->data.evt_gatt_characteristic_value.att_opcode == gatt_handle_value_notification)
+						&& (client->characteristic[HISTORY_DATA_CHARACTERISTIC].handle == event->data.evt_gatt_characteristic_value.characteristic))
+				{
+					history_client_frame(client->link, event->data.evt_gatt_characteristic_value.value.data,
+							event->data.evt_gatt_characteristic_value.value.len);
+				}
+				else if ((event->data.evt_gatt_characteristic_value.att_opcode == gatt_handle_value_notification)
+						&& (client->characteristic[AXIS_ORIENTATION_CHARACTERISTIC].handle == event->data.evt_gatt_characteristic_value.characteristic))
+				{
+					axis_orientation_received(client, event->data.evt_gatt_characteristic_value.value.data,
+							event->data.evt_gatt_characteristic_value.value.len);
+				}
+				break;
+
+				//Event occurs when the connection parameters are set or changed
+			case gecko_evt_le_connection_parameters_id:
+				client = ble_client_by_connection(event->data.evt_le_connection_parameters.connection);
+				if (client == NULL)
+				{
+					break;
+				}
+				client->discovery.interval = event->data.evt_le_connection_parameters.interval;
+				link_phy_parameters(client->link, event->data.evt_le_connection_parameters.txsize);
+				//links on other intervals drift into each other's connection events, back to the common one
+				if (client->discovery.interval != CONN_INTERVAL_MIN)
+				{
+					BTSTACK_CHECK_RESPONSE(gecko_cmd_le_connection_set_parameters(client->status.connection_handle,
+							CONN_INTERVAL_MIN, CONN_INTERVAL_MAX, CONN_SLAVE_LATENCY, CONN_TIMEOUT));
+				}
 				break;
 
 				//Event occurs when rssi value changes
 			case gecko_evt_le_connection_rssi_id:
-				//Setting tx power based on rssi value. Ranges and desired tx power is defined in this file by tx_power_based_on_rssi_table
-				//	{RSSI_MAX, -35, TX_POWER_MIN},
-				//		{-35, -45, -20},
-				//		{-45, -55, -15},
-				//		{-55, -65, -5},
-				//		{-65, -75, 0},
-				//		{-75, -85, 5},
-				//		{-85, RSSI_MIN, TX_POWER_MAX}
-				LOG_DEBUG("RSSI value changed. Setting new tx power");
+				client = ble_client_by_connection(event->data.evt_le_connection_rssi.connection);
+				if (client == NULL)
+				{
+					break;
+				}
+				//filtered, the TX power follows it only with TX_POWER_CONTROL (tx_power.h)
 				rssi = event->data.evt_le_connection_rssi.rssi;
-				for (int i = 0; i < tx_power_based_on_rssi_table_length; i++)
+				tx_power_rssi(client->link, rssi);
+				link_phy_rssi(client->link, tx_power_rssi_dbm(client->link));
+				break;
+
+			case gecko_evt_le_connection_phy_status_id:
+				client = ble_client_by_connection(event->data.evt_le_connection_phy_status.connection);
+				if (client == NULL)
 				{
-					if ((rssi <= ble_client.status.tx_power_based_on_rssi[i].rssi_range_max)
-							&& (rssi > ble_client.status.tx_power_based_on_rssi[i].rssi_range_min))
-					{
-						gecko_cmd_system_set_tx_power(ble_client.status.tx_power_based_on_rssi[i].tx_power * 10);//TX power in 0.1dBm steps
-						//return_set_tx_power = gecko_cmd_system_set_tx_power(ble_status.tx_power_based_on_rssi[i].tx_power*10);	//TX power in 0.1dBm steps
-						//LOG_DEBUG("RSSI is %d dBm,   Tx power (expected %d) is : %.1f", rssi, ble_status.tx_power_based_on_rssi[i].tx_power,  (return_set_tx_power->set_power/10));
-						break;
-					}
+					break;
 				}
+				link_phy_status(client->link, event->data.evt_le_connection_phy_status.phy);
 				break;
 
 				//Event occurs when disconnected
 			case gecko_evt_le_connection_closed_id:
+				client = ble_client_by_connection(event->data.evt_le_connection_closed.connection);
+				if (client == NULL)
+				{
+					//connection attempt that never opened, scanning was stopped for it
+					if (scan_schedule.scanning == false)
+					{
+						scan_schedule_start();
+					}
+					break;
+				}
 
-				BTSTACK_CHECK_RESPONSE(gecko_cmd_le_gap_start_discovery(le_gap_phy_1m, le_gap_discover_generic));
-				displayPrintf(DISPLAY_ROW_CONNECTION, "Discovering");
-//				displayPrintf(DISPLAY_ROW_POSTURE, "");
-				displayPrintf(DISPLAY_ROW_BTADDR2, "");
+				//scanning while a link was left, fast again for the server that dropped
+				if (ble_client_connected_count() < CLIENT_MAX_SERVERS)
+				{
+					scan_schedule_wake();
+				}
+				else
+				{
+					scan_schedule_start();
+				}
 				displayPrintf(DISPLAY_ROW_PASSKEY, "");
 //				displayPrintf(DISPLAY_ROW_ACTION, "");
-				//setting Tx power to default value of 0
-				gecko_cmd_system_set_tx_power(0);
-				//delete bonding on connection close... device would be required to pair again on connection
-				BTSTACK_CHECK_RESPONSE(gecko_cmd_sm_delete_bondings());
 				//resetting flags and handles
-				ble_client.status.connection_handle = 0;
-				ble_client.status.connection_status = DISCONNECTED;
-				ble_client.status.htp_indication_status = false;
-//				ble_client.indication[AXIS_ORIENTATION_CHARACTERISTIC]
-				ble_client.service[IMU_SERVICE].handle = 0;
-				ble_client.service[IMU_SERVICE].procedure_complete_status = true;
-				ble_client.service[USER_CONTROL_SERVICE].handle = 0;
-				ble_client.service[USER_CONTROL_SERVICE].procedure_complete_status = true;
-				ble_client.characteristic[AXIS_ORIENTATION_CHARACTERISTIC].handle = 0;
-				ble_client.characteristic[AXIS_ORIENTATION_CHARACTERISTIC].procedure_complete_status = true;
-				ble_client.characteristic[TIMER_UNTIL_TRIGGER_CHARACTERISTIC].handle = 0;
-				ble_client.characteristic[TIMER_UNTIL_TRIGGER_CHARACTERISTIC].procedure_complete_status = true;
-				ble_client.indication[AXIS_ORIENTATION_CHARACTERISTIC].procedure_complete_status = true;
-				ble_client.indication[TIMER_UNTIL_TRIGGER_CHARACTERISTIC].procedure_complete_status = true;
+				client->status.connection_handle = 0;
+				client->status.connection_status = DISCONNECTED;
+				client->status.htp_indication_status = false;
+				for (uint8_t i = 0; i < SERVICE_COUNT; i++)
+				{
+					client->service[i].handle = 0;
+				}
+				for (uint8_t i = 0; i < CHARACTERISTIC_COUNT; i++)
+				{
+					client->characteristic[i].handle = 0;
+				}
+				client->discovery.state = DISCOVERY_IDLE;
+				client->database_hash_valid = false;
+				client->bonding = BOND_HANDLE_INVALID;
+				#if BODY_FUSION
+					body_fusion_log_stats(client->link);
+					body_fusion_link_reset(client->link);
+				#endif
+				//the posture of a server that is gone does not count any more
+				client->bad_posture = false;
+				posture_check(client);
+				history_client_disconnected(client->link);
+				live_client_log_stats(client->link, AXIS_ORIENTATION_NOTIFICATIONS);
+				//back to TX_POWER_IDLE_DBM10 with the last link
+				tx_power_connection_closed(client->link, event->data.evt_le_connection_closed.reason);
+				tx_power_log_stats();
+				link_phy_connection_closed(client->link, event->data.evt_le_connection_closed.reason);
+				link_phy_log_stats(client->link);
+				if (ble_client_connected_count() == 0)
+				{
+					displayPrintf(DISPLAY_ROW_CONNECTION, "Discovering");
+//					displayPrintf(DISPLAY_ROW_POSTURE, "");
+					displayPrintf(DISPLAY_ROW_BTADDR2, "");
+				}
+				#if PERIODIC_STREAM
+					periodic_client_log_stats();
+				#endif
 				break;
 
 				//Event occurs at 1Hz
 			case gecko_evt_hardware_soft_timer_id:
+				if (event->data.evt_hardware_soft_timer.handle == SCAN_SCHEDULE_TIMER_HANDLE)
+				{
+					scan_schedule_timer();
+					break;
+				}
 				//refreshing LCD
 				displayUpdate();
 				break;
@@ -508,6 +1107,7 @@ uint32_t service_handle;
 
 
 uint8_t axis_orientation_indication_en_flag = 0;
+uint8_t axis_orientation_notification_en_flag = 0;
 uint8_t time_until_trigger_indication_en_flag = 0;
 uint8_t connected_status_flag = 0;
 
@@ -517,22 +1117,72 @@ uint8_t time_until_trigger[3] = {30, 40, 50};
 uint8_t current_tut_index = 0;
 uint8_t tut_options_max = 3;
 
-uint8_t remote_gatt_cmd_in_progress = 0;
-// bit0=axis_orientation_indication
-// bit1=time_until_trigger_indication
-uint8_t indication_gatt_cmd_defer_flag = 0;
-
 
 // Bonding not started=0
 // Bonding in progress=1
 // Bonding complete=2
 uint8_t bonded = 0;
 
+// Bond of the connected client from a previous connection, BOND_HANDLE_INVALID if none
+uint8_t conn_bonding = BOND_HANDLE_INVALID;
+
 struct gecko_msg_system_get_bt_address_rsp_t* server_bt_addr;
 struct gecko_msg_system_get_bt_address_rsp_t* client_bt_addr;
 
 uint8_t done = 0;
 
+
+// Time until trigger value, built when the queue sends it so it is always the current one
+static uint8_t time_until_trigger_fill(uint8_t *buf)
+{
+	uint8_t *ptr = buf;
+	if (imu_cal.loaded == 0)
+	{
+		UINT8_TO_BITSTREAM(ptr, 0x00)
+		UINT8_TO_BITSTREAM(ptr, (uint8_t)time_until_trigger[current_tut_index]);
+		return 2;
+	}
+
+	// Calibrated: the upright reference goes along, the client judges the posture against it
+	UINT8_TO_BITSTREAM(ptr, TUT_FLAG_UPRIGHT);
+	UINT8_TO_BITSTREAM(ptr, (uint8_t)time_until_trigger[current_tut_index]);
+	UINT16_TO_BITSTREAM(ptr, (uint16_t)imu_cal.record.upright.y);
+
+	return TUT_UPRIGHT_LEN;
+}
+
+// Time until trigger indication, the client confirms it
+static void time_until_trigger_send(void)
+{
+	gatt_queue_request(gattdb_seconds, GATT_QUEUE_PRIORITY_HIGH, 1, time_until_trigger_fill);
+}
+
+// Axis orientation frame with every sample collected until it goes out
+static uint8_t axis_orientation_fill(uint8_t *buf)
+{
+	uint8_t len = live_frame_take(buf);
+
+	if (len != 0 && axis_orientation_indication_en_flag)
+	{
+		live_frame_indication_sent();
+	}
+
+	return len;
+}
+
+// Link encrypted, by a new bonding or with the keys of an earlier one
+static void link_secured(void)
+{
+	bonded = 2;
+
+	displayPrintf(DISPLAY_ROW_PASSKEY, " ");
+	displayPrintf(DISPLAY_ROW_TUT, "Bad Pos TO: %us", time_until_trigger[current_tut_index]);
+	displayPrintf(DISPLAY_ROW_CONNECTION, "Bonded");
+
+	// Catch-up requested before the link was encrypted
+	history_start_pending();
+}
+
 void handle_ble_event(struct gecko_cmd_packet *evt)
 {
 
@@ -549,35 +1199,52 @@ void handle_ble_event(struct gecko_cmd_packet *evt)
 			displayPrintf(DISPLAY_ROW_BTADDR, "%x:%x:%x:%x:%x:%x", val.addr[5], val.addr[4], val.addr[3], val.addr[2],
 					val.addr[1], val.addr[0]);
 
-			struct gecko_msg_le_gap_set_advertise_timing_rsp_t *ret1 = gecko_cmd_le_gap_set_advertise_timing(0, 400, 400, 0, 0);
-			if (ret1->result != 0)
-			{
-				#if INCLUDE_LOGGING
-					LOG_ERROR("ERROR: %d | response code from gecko_cmd_le_gap_set_advertise_timing()", ret1->result);
-				#endif
-			}
-			struct gecko_msg_le_gap_start_advertising_rsp_t *ret2 = gecko_cmd_le_gap_start_advertising(0, le_gap_general_discoverable, le_gap_connectable_scannable);
-			if (ret2->result != 0)
+			// Largest ATT MTU, the stack exchanges it when a connection opens
+			struct gecko_msg_gatt_set_max_mtu_rsp_t *ret_mtu = gecko_cmd_gatt_set_max_mtu(LIVE_FRAME_ATT_MTU_MAX);
+			if (ret_mtu->result != 0)
 			{
 				#if INCLUDE_LOGGING
-					LOG_ERROR("ERROR: %d | response code from gecko_cmd_le_gap_start_advertising()", ret2->result);
+					LOG_ERROR("ERROR: %d | response code from gecko_cmd_gatt_set_max_mtu()", ret_mtu->result);
 				#endif
 			}
 
+			// Fast advertising first, backing off while no client connects
+			adv_schedule_start();
+
 			// Server Security - MITM
-			// Delete bondings here
+			// Bonds are kept in flash, a bonded client only encrypts again on reconnect
 			bonded = 0;
-			struct gecko_msg_sm_delete_bondings_rsp_t *ret7 = gecko_cmd_sm_delete_bondings();
+			struct gecko_msg_sm_set_bondable_mode_rsp_t *ret7 = gecko_cmd_sm_set_bondable_mode(1);
 			if (ret7->result != 0)
 			{
 				#if INCLUDE_LOGGING
-					LOG_ERROR("ERROR: %d | response code from gecko_cmd_sm_delete_bondings()", ret7->result);
+					LOG_ERROR("ERROR: %d | response code from gecko_cmd_sm_set_bondable_mode()", ret7->result);
+				#endif
+			}
+			struct gecko_msg_sm_store_bonding_configuration_rsp_t *ret24 = gecko_cmd_sm_store_bonding_configuration(BOND_MAX_PEERS,
+					BOND_POLICY_REPLACE_LRU);
+			if (ret24->result != 0)
+			{
+				#if INCLUDE_LOGGING
+					LOG_ERROR("ERROR: %d | response code from gecko_cmd_sm_store_bonding_configuration()", ret24->result);
 				#endif
 			}
 
 
 
 
+			#if POSTURE_BROADCAST
+				broadcast_start();
+			#endif
+			#if PERIODIC_STREAM
+				periodic_stream_start();
+			#endif
+
+			// Restore the IMU calibration and take the first sample now instead of waiting
+			// a full LETIMER period, so a valid posture is available within one measurement.
+			imu_cal_load();
+			scheduler_set_event_UF();
+
 			// Display to LCD
 			displayPrintf(DISPLAY_ROW_CONNECTION, "Advertising");
 
@@ -589,11 +1256,19 @@ void handle_ble_event(struct gecko_cmd_packet *evt)
 		{
 			// for extra credit
 			connected_status_flag = 1;
+			adv_schedule_connected();
 
 			// Display to LCD
 			displayPrintf(DISPLAY_ROW_CONNECTION, "Connected");
 
 			conn_handle = evt->data.evt_le_connection_opened.connection;
+			conn_bonding = evt->data.evt_le_connection_opened.bonding;
+			postmortem_log("connection %d opened", conn_handle);
+			history_connection_opened(conn_handle);
+			tx_power_connection_opened(0);
+			link_phy_connection_opened(0, conn_handle);
+			live_frame_init();
+			gatt_queue_connection_opened(conn_handle);
 
 			// gecko_cmd_le_connection_set_parameters() removed. Connection parameters are set on client side
 
@@ -612,72 +1287,17 @@ void handle_ble_event(struct gecko_cmd_packet *evt)
 
 		case gecko_evt_gatt_server_characteristic_status_id:
 		{
-			remote_gatt_cmd_in_progress = 0;
-
-			// bit0=axis_orientation_indication
-			// bit1=time_until_trigger_indication
-
-
-			if ((remote_gatt_cmd_in_progress == 0) && ((indication_gatt_cmd_defer_flag & 0x01) != 0))
-			{
-				indication_gatt_cmd_defer_flag &= ~(0x01);
-
-				uint8_t t_buffer[3];
-				uint8_t *ptr = t_buffer;
-				UINT8_TO_BITSTREAM(ptr, 0x00)
-
-				UINT16_TO_BITSTREAM(ptr, (uint16_t)accel_data.y);
-				uint8_t f_buffer[3];
-				f_buffer[2] = t_buffer[2];
-				f_buffer[1] = t_buffer[1];
-				f_buffer[0] = t_buffer[0];
-
-				struct gecko_msg_gatt_server_send_characteristic_notification_rsp_t *ret21 = gecko_cmd_gatt_server_send_characteristic_notification(conn_handle,
-						gattdb_y_axis_value, 3, f_buffer);
-
-				remote_gatt_cmd_in_progress = 1;
-
-				if (ret21->result != 0)
-				{
-					remote_gatt_cmd_in_progress = 0; // Because gatt_cmd failed.
-					#if INCLUDE_LOGGING
-						LOG_ERROR("ERROR: %d | response code from gecko_cmd_gatt_server_send_characteristic_notification()", ret21->result);
-					#endif
-				}
-
-			}
-
-
-			if ((remote_gatt_cmd_in_progress == 0) && ((indication_gatt_cmd_defer_flag & 0x02) != 0))
+			if (evt->data.evt_gatt_server_characteristic_status.status_flags == gatt_server_confirmation)
 			{
-				indication_gatt_cmd_defer_flag &= ~(0x02);
-
-				uint8_t t_buffer[2];
-				uint8_t *ptr = t_buffer;
-				UINT8_TO_BITSTREAM(ptr, 0x00)
-
-				UINT8_TO_BITSTREAM(ptr, (uint8_t)time_until_trigger[current_tut_index]);
-				uint8_t f_buffer[2];
-				f_buffer[1] = t_buffer[1];
-				f_buffer[0] = t_buffer[0];
-
-				struct gecko_msg_gatt_server_send_characteristic_notification_rsp_t *ret22 = gecko_cmd_gatt_server_send_characteristic_notification(conn_handle,
-						gattdb_seconds, 2, f_buffer);
-
-				remote_gatt_cmd_in_progress = 1;
-
-				if (ret22->result != 0)
+				if (evt->data.evt_gatt_server_characteristic_status.characteristic == gattdb_y_axis_value)
 				{
-					remote_gatt_cmd_in_progress = 0; // Because gatt_cmd failed.
-					#if INCLUDE_LOGGING
-						LOG_ERROR("ERROR: %d | response code from gecko_cmd_gatt_server_send_characteristic_notification()", ret22->result);
-					#endif
+					live_frame_indication_confirmed();
 				}
 
+				// Next queued value (samples that arrived while waiting are in the frame too)
+				gatt_queue_indication_confirmed(evt->data.evt_gatt_server_characteristic_status.characteristic);
 			}
 
-
-
 			struct gecko_msg_le_connection_get_rssi_rsp_t *ret4 = gecko_cmd_le_connection_get_rssi(conn_handle);
 			if (ret4->result != 0)
 			{
@@ -693,6 +1313,17 @@ void handle_ble_event(struct gecko_cmd_packet *evt)
 
 				// enabled
 				axis_orientation_indication_en_flag = 1;
+				axis_orientation_notification_en_flag = 0;
+
+			}
+			else if ((evt->data.evt_gatt_server_characteristic_status.characteristic == gattdb_y_axis_value)
+					&& (evt->data.evt_gatt_server_characteristic_status.status_flags == gatt_server_client_config)
+						&& (evt->data.evt_gatt_server_characteristic_status.client_config_flags == gatt_notification))
+			{
+
+				// enabled, unconfirmed frames with retransmit on request
+				axis_orientation_notification_en_flag = 1;
+				axis_orientation_indication_en_flag = 0;
 
 			}
 			else if (evt->data.evt_gatt_server_characteristic_status.client_config_flags == gatt_disable)
@@ -702,6 +1333,15 @@ void handle_ble_event(struct gecko_cmd_packet *evt)
 
 			}
 
+			if ((evt->data.evt_gatt_server_characteristic_status.characteristic == gattdb_y_axis_value)
+					&& (evt->data.evt_gatt_server_characteristic_status.status_flags == gatt_server_client_config)
+						&& (evt->data.evt_gatt_server_characteristic_status.client_config_flags == gatt_disable))
+			{
+
+				axis_orientation_notification_en_flag = 0;
+
+			}
+
 
 
 			if ((evt->data.evt_gatt_server_characteristic_status.characteristic == gattdb_seconds)
@@ -730,56 +1370,62 @@ void handle_ble_event(struct gecko_cmd_packet *evt)
 
 			signal = evt->data.evt_system_external_signal.extsignals;
 
+			// PB0 press or a moved sensor: a client is probably about to connect
+			if (signal == 200)
+			{
+				adv_schedule_wake();
+			}
+			if (signal == 130)
+			{
+				adv_schedule_sample(tilt);
+			}
+
+			// Every sample goes into the broadcast and the periodic train, connected or not
+			#if POSTURE_BROADCAST
+				if (signal == 130)
+				{
+					broadcast_update(connected_status_flag);
+				}
+			#endif
+			#if PERIODIC_STREAM
+				if (signal == 130 && calibration_complete_flag == 1)
+				{
+					periodic_stream_add_sample();
+				}
+			#endif
 
 			// Send indications to client.
 			// Need for reference. Don't remove this comment.
 			// if (calibration_complete_flag==2 && axis_orientation_indication_en_flag && (signal == 130))
-			if (bonded == 2 && calibration_complete_flag == 1 && axis_orientation_indication_en_flag && (signal == 130))
+			// Live samples wait while a catch-up runs, they are part of the catch-up stream
+			if (bonded == 2 && calibration_complete_flag == 1 && (signal == 130) && history_is_active() == 0
+					&& (axis_orientation_indication_en_flag || axis_orientation_notification_en_flag))
 			{
 
-				if (remote_gatt_cmd_in_progress == 0)
-				{
-
-
-					uint8_t t_buffer[3];
-					uint8_t *ptr = t_buffer;
-					UINT8_TO_BITSTREAM(ptr, 0x00)
+				// Samples are batched, one indication carries a whole frame
+				live_frame_add_sample();
 
-					UINT16_TO_BITSTREAM(ptr, (uint16_t)accel_data.y);
-					uint8_t f_buffer[3];
-					f_buffer[2] = t_buffer[2];
-					f_buffer[1] = t_buffer[1];
-					f_buffer[0] = t_buffer[0];
+				if (live_frame_is_ready() == 0)
+				{
+					return;
+				}
 
-					struct gecko_msg_gatt_server_send_characteristic_notification_rsp_t *ret19 = gecko_cmd_gatt_server_send_characteristic_notification(conn_handle,
-							gattdb_y_axis_value, 3, f_buffer);
+				// Notifications are not confirmed, nothing to wait for. A frame the client
+				// misses is asked for again on Live retransmit. An indication waits in the
+				// queue while the previous one is unconfirmed and keeps collecting samples.
+				gatt_queue_request(gattdb_y_axis_value, GATT_QUEUE_PRIORITY_NORMAL, axis_orientation_indication_en_flag,
+						axis_orientation_fill);
 
-					remote_gatt_cmd_in_progress = 1;
+				if (axis_orientation_indication_en_flag)
+				{
 					done = 1;
-
-					if (first_time_tut_send_flag == 0)
-					{
-						first_time_tut_send_flag = 1;
-						indication_gatt_cmd_defer_flag |= 0x02; // Defer it so that it is sent after first calib value was sent.
-
-					}
-
-					if (ret19->result != 0)
-					{
-						remote_gatt_cmd_in_progress = 0; // Because gatt_cmd failed.
-						#if INCLUDE_LOGGING
-							LOG_ERROR("ERROR: %d | response code from gecko_cmd_gatt_server_send_characteristic_notification()", ret19->result);
-						#endif
-					}
-
 				}
-				else if(remote_gatt_cmd_in_progress != 0)
-				{
-					// defer the gatt call. Once the previous gatt call finishes and gecko_evt_gatt_server_characteristic_status event
-					// triggers, this gatt call will occur there of no other outstanding gatt calls are present at that time.
-
-					indication_gatt_cmd_defer_flag |= 0x01;
 
+				// Queued behind the first frame
+				if (first_time_tut_send_flag == 0)
+				{
+					first_time_tut_send_flag = 1;
+					time_until_trigger_send();
 				}
 
 				return;
@@ -790,43 +1436,12 @@ void handle_ble_event(struct gecko_cmd_packet *evt)
 			if (bonded == 2 && time_until_trigger_indication_en_flag && signal == 200)
 			{
 				current_tut_index = (current_tut_index + 1 ) % tut_options_max;
+				settings_save(SETTINGS_KEY_TUT_INDEX);
 
 				displayPrintf(DISPLAY_ROW_TUT, "Bad Pos TO: %us", time_until_trigger[current_tut_index]);
 
-				if (remote_gatt_cmd_in_progress == 0)
-				{
-
-					uint8_t t_buffer[2];
-					uint8_t *ptr = t_buffer;
-					UINT8_TO_BITSTREAM(ptr, 0x00)
-
-					UINT8_TO_BITSTREAM(ptr, (uint8_t)time_until_trigger[current_tut_index]);
-					uint8_t f_buffer[2];
-					f_buffer[1] = t_buffer[1];
-					f_buffer[0] = t_buffer[0];
-
-					struct gecko_msg_gatt_server_send_characteristic_notification_rsp_t *ret20 = gecko_cmd_gatt_server_send_characteristic_notification(conn_handle,
-							gattdb_seconds, 2, f_buffer);
-
-					remote_gatt_cmd_in_progress = 1;
-
-					if (ret20->result != 0)
-					{
-						remote_gatt_cmd_in_progress = 0; // Because gatt_cmd failed.
-						#if INCLUDE_LOGGING
-							LOG_ERROR("ERROR: %d | response code from gecko_cmd_gatt_server_send_characteristic_notification()", ret20->result);
-						#endif
-					}
-
-				}
-				else if(remote_gatt_cmd_in_progress != 0)
-				{
-					// defer the gatt call. Once the previous gatt call finishes and gecko_evt_gatt_server_characteristic_status event
-					// triggers, this gatt call will occur there of no other outstanding gatt calls are present at that time.
-
-					indication_gatt_cmd_defer_flag |= 0x02;
-
-				}
+				// Sent once the link is free, a second press before that only changes the value
+				time_until_trigger_send();
 
 
 			}
@@ -840,53 +1455,23 @@ void handle_ble_event(struct gecko_cmd_packet *evt)
 		}
 			break;
 
+		case gecko_evt_le_connection_phy_status_id:
+
+			link_phy_status(0, evt->data.evt_le_connection_phy_status.phy);
+			break;
+
 		case gecko_evt_le_connection_rssi_id:
 		{
 			int8 rssi = evt->data.evt_le_connection_rssi.rssi;
 
-
-
-			if (rssi > -35)
-			{
-				gecko_cmd_system_set_tx_power(-300); // set tx_power to TX Min = -30 dBm
-
-			}
-			if ((-35 >= rssi) && (rssi > -45))
-			{
-				gecko_cmd_system_set_tx_power(-200); // set tx_power to -20db
-
-			}
-			if ((-45 >= rssi) && (rssi > -55))
-			{
-				gecko_cmd_system_set_tx_power(-150); // set tx_power to -15db
-
-			}
-			if ((-55 >= rssi) && (rssi > -65))
-			{
-				gecko_cmd_system_set_tx_power(-50); // set tx_power to -5db
-
-			}
-			if ((-65 >= rssi) && (rssi > -75))
-			{
-				gecko_cmd_system_set_tx_power(0); // set tx_power to 0db
-
-			}
-			if ((-75 >= rssi) && (rssi > -85))
-			{
-				gecko_cmd_system_set_tx_power(50); // set tx_power to 5db
-
-			}
-			// The  maximum TX power value from EFR32BG13P632F512GM48 is 10 dBm
-			if (rssi <= -85)
-			{
-				gecko_cmd_system_set_tx_power(100); // set tx_power to TX Max
-
-			}
+			// Filtered, stepped towards the target margin at most once per TX_POWER_STEP_MS
+			tx_power_rssi(0, rssi);
+			link_phy_rssi(0, tx_power_rssi_dbm(0));
 
 			#if BOND_DISCONNECT
 				// rssi is set for the next transmission.
 				// Enable to sleep in EM3 mode here i.e., sleep_mode_blocked = sleepEM4
-				if (calibration_complete_flag == 1 && done == 1 && indication_gatt_cmd_defer_flag == 0)
+				if (calibration_complete_flag == 1 && done == 1 && gatt_queue_is_idle())
 				{
 					done = 0;
 					struct gecko_msg_le_connection_close_rsp_t *ret23 = gecko_cmd_le_connection_close(conn_handle);
@@ -910,32 +1495,31 @@ void handle_ble_event(struct gecko_cmd_packet *evt)
 
 		case gecko_evt_le_connection_closed_id:
 
+			postmortem_log("connection closed, reason 0x%x", evt->data.evt_le_connection_closed.reason);
+			history_connection_closed();
+			live_frame_log_stats();
+			gatt_queue_connection_closed();
+
 			// for extra credit
 			connected_status_flag = 0;
 			axis_orientation_indication_en_flag = 0;
+			axis_orientation_notification_en_flag = 0;
 			time_until_trigger_indication_en_flag = 0;
 
-			gecko_cmd_system_set_tx_power(0); //  TX Power should be set to 0db
+			// TX power back to TX_POWER_IDLE_DBM10 for advertising
+			tx_power_connection_closed(0, evt->data.evt_le_connection_closed.reason);
+			tx_power_log_stats();
+			link_phy_connection_closed(0, evt->data.evt_le_connection_closed.reason);
+			link_phy_log_stats(0);
 
 			// Server Security - MITM
-			// Delete bondings here
+			// The bond stays, the next connection has to be encrypted again
 			bonded = 0;
-			struct gecko_msg_sm_delete_bondings_rsp_t *ret11 = gecko_cmd_sm_delete_bondings();
-			if (ret11->result != 0)
-			{
-				#if INCLUDE_LOGGING
-					LOG_ERROR("ERROR: %d | response code from gecko_cmd_sm_delete_bondings()", ret11->result);
-				#endif
-			}
+			conn_bonding = BOND_HANDLE_INVALID;
 
 
-			struct gecko_msg_le_gap_start_advertising_rsp_t *ret6 = gecko_cmd_le_gap_start_advertising(0, le_gap_general_discoverable, le_gap_connectable_scannable);
-			if (ret6->result != 0)
-			{
-				#if INCLUDE_LOGGING
-					LOG_ERROR("ERROR: %d | response code from gecko_cmd_le_gap_start_advertising()", ret6->result);
-				#endif
-			}
+			// Fast again, the client that dropped is likely still close
+			adv_schedule_start();
 
 			// Display to LCD
 			displayPrintf(DISPLAY_ROW_CONNECTION, "Advertising");
@@ -944,8 +1528,18 @@ void handle_ble_event(struct gecko_cmd_packet *evt)
 
 			break;
 
-		// for assignment questions only
 		case gecko_evt_le_connection_parameters_id:
+
+			link_phy_parameters(0, evt->data.evt_le_connection_parameters.txsize);
+
+			// A bonded client encrypts with its stored keys, no pairing and no sm_bonded event
+			if (bonded != 2 && conn_bonding != BOND_HANDLE_INVALID
+					&& evt->data.evt_le_connection_parameters.security_mode >= le_connection_mode1_level2)
+			{
+				link_secured();
+			}
+
+		// for assignment questions only
 /*		{
 			uint16_t value = evt->data.evt_le_connection_parameters.interval;
 			{
@@ -983,6 +1577,57 @@ void handle_ble_event(struct gecko_cmd_packet *evt)
 				displayUpdate();
 
 			}
+			else if (handle == HISTORY_TIMER_HANDLE)
+			{
+
+				history_pump();
+
+			}
+			else if (handle == ADV_SCHEDULE_TIMER_HANDLE)
+			{
+
+				adv_schedule_timer();
+
+			}
+			else if (handle == GATT_QUEUE_TIMER_HANDLE)
+			{
+
+				gatt_queue_service();
+
+			}
+		}
+			break;
+
+		case gecko_evt_gatt_mtu_exchanged_id:
+
+			history_set_mtu(evt->data.evt_gatt_mtu_exchanged.mtu);
+			live_frame_set_mtu(evt->data.evt_gatt_mtu_exchanged.mtu);
+
+			break;
+
+		// History control: catch-up request, Live retransmit: frames the client missed
+		case gecko_evt_gatt_server_attribute_value_id:
+		{
+			if (evt->data.evt_gatt_server_attribute_value.attribute == gattdb_history_control)
+			{
+
+				history_request(evt->data.evt_gatt_server_attribute_value.value.data,
+						evt->data.evt_gatt_server_attribute_value.value.len);
+
+				if (bonded == 2)
+				{
+					history_start_pending();
+				}
+
+			}
+			else if ((evt->data.evt_gatt_server_attribute_value.attribute == gattdb_live_retransmit)
+					&& bonded == 2 && axis_orientation_notification_en_flag)
+			{
+
+				live_frame_retransmit(conn_handle, evt->data.evt_gatt_server_attribute_value.value.data,
+						evt->data.evt_gatt_server_attribute_value.value.len);
+
+			}
 		}
 			break;
 
@@ -1007,12 +1652,8 @@ void handle_ble_event(struct gecko_cmd_packet *evt)
 	  case gecko_evt_sm_bonded_id:
 
 		// bonding complete
-		bonded = 2;
-
-		displayPrintf(DISPLAY_ROW_PASSKEY, " ");
-		displayPrintf(DISPLAY_ROW_TUT, "Bad Pos TO: %us", time_until_trigger[current_tut_index]);
-		displayPrintf(DISPLAY_ROW_CONNECTION, "Bonded");
-
+		conn_bonding = evt->data.evt_sm_bonded.bonding;
+		link_secured();
 
 		break;
 
@@ -1020,6 +1661,20 @@ void handle_ble_event(struct gecko_cmd_packet *evt)
 	  case gecko_evt_sm_bonding_failed_id:
 	  {
 
+		postmortem_log("bonding failed, reason 0x%x", evt->data.evt_sm_bonding_failed.reason);
+
+		// Client lost its keys: drop the stale bond so it can pair again
+		if (conn_bonding != BOND_HANDLE_INVALID)
+		{
+			struct gecko_msg_sm_delete_bonding_rsp_t *ret25 = gecko_cmd_sm_delete_bonding(conn_bonding);
+			if (ret25->result != 0)
+			{
+				#if INCLUDE_LOGGING
+					LOG_ERROR("ERROR: %d | response code from gecko_cmd_sm_delete_bonding()", ret25->result);
+				#endif
+			}
+			conn_bonding = BOND_HANDLE_INVALID;
+		}
 
 		struct gecko_msg_le_connection_close_rsp_t *ret18 = gecko_cmd_le_connection_close(conn_handle);
 		if (ret18->result != 0)
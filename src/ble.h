@@ -22,12 +22,6 @@
 #include "infrastructure.h"
 
 
-#define RSSI_MIN -128
-#define RSSI_MAX 127
-
-#define TX_POWER_MIN (-100)	//as defined in characteristic
-#define TX_POWER_MAX (20)	//as defined in characteristic
-
 #define ADVERTISE_INTERVAL_MIN_MS 	(250)
 #define ADVERTISE_INTERVAL_MAX_MS 	(250)
 
@@ -39,7 +33,9 @@
 #define SCAN_INTERVAL_MS			(50)
 #define SCAN_WINDOW_MS				(25)
 
-// connection parameters
+// connection parameters. Every link gets the same interval: the link layer places the anchor
+// of a new connection apart from the ones already running, and with equal intervals they stay
+// apart, the connection events of the servers never collide.
 #define CONN_INTERVAL_MIN             80   //100ms
 #define CONN_INTERVAL_MAX             80   //100ms
 #define CONN_SLAVE_LATENCY            4    //4 slots
@@ -59,16 +55,26 @@
 
 #define BLE_ADDR_LENGTH					(6)
 
+// 1: Axis orientation frames as notifications, missing frames are asked for again (live_frame.h)
+// 0: confirmed indications, one frame per ATT round trip
+#define AXIS_ORIENTATION_NOTIFICATIONS	(1)
+
 #define IO_CAPABILITY  				   0 // 0=DISPLAYONLY
 #define SM_CONFIG_FLAGS 			  (0x0A) // encrypted link and bonding should be confirmed
 
-//datatypes and global variables
-typedef struct tx_power_based_on_rssi_t{
-	int8_t rssi_range_max;
-	int8_t rssi_range_min;
-	int16_t tx_power;
-}tx_power_based_on_rssi_t;
+// Bonds are kept in flash so a known peer reconnects without pairing again
+#define BOND_MAX_PEERS				   (4)
+#define BOND_POLICY_REPLACE_LRU		   (2) // a new bond replaces the least recently used one
+#define BOND_HANDLE_INVALID			   (0xFF)
 
+// 1: the controller only reports SERVER_BT_ADDRESS and bonded servers (accept list), the
+// other advertisers around do not wake the host. Posture broadcasts of other servers are
+// not received then.
+// 0: every advertiser is reported, the address is matched by is_device_found_by_address()
+#define SCAN_ACCEPT_LIST			   (1)
+#define SERVER_BT_ADDRESS_TYPE		   (0) // public
+
+//datatypes and global variables
 typedef enum{
 	DISCONNECTED,
 	CONNECTED,
@@ -80,33 +86,85 @@ typedef struct ble_status_s{
 	uint8_t connection_handle;
 	bool htp_indication_status;
 	bool button_indication_status;
-	tx_power_based_on_rssi_t* tx_power_based_on_rssi;
 	connection_status_t connection_status;
 }ble_status_t;
 
 enum custom_services_to_be_implemented{
 	IMU_SERVICE,
-	USER_CONTROL_SERVICE
+	USER_CONTROL_SERVICE,
+	GENERIC_ATTRIBUTE_SERVICE,
+	SERVICE_COUNT
 };
 
 enum custom_characteristics_to_be_implemented{
 	AXIS_ORIENTATION_CHARACTERISTIC,
-	TIMER_UNTIL_TRIGGER_CHARACTERISTIC
+	TIMER_UNTIL_TRIGGER_CHARACTERISTIC,
+	HISTORY_CONTROL_CHARACTERISTIC,
+	HISTORY_DATA_CHARACTERISTIC,
+	LIVE_RETRANSMIT_CHARACTERISTIC,
+	DATABASE_HASH_CHARACTERISTIC,
+	CHARACTERISTIC_COUNT
 };
 
+#define DATABASE_HASH_LEN				(16)
+
+// Time until trigger value: flags, seconds, and with TUT_FLAG_UPRIGHT the server's stored
+// upright Y-axis reference (int16 mg)
+#define TUT_FLAG_UPRIGHT			   (0x01)
+#define TUT_UPRIGHT_LEN				   (4)
+
+// What the client looks for on the server, see wanted_service[] / wanted_characteristic[] in ble.c
+typedef struct wanted_service_s{
+	const uint8_t *uuid;
+	uint8_t uuid_len;
+	bool discover_characteristics;
+}wanted_service_t;
+
+typedef struct wanted_characteristic_s{
+	uint8_t service;		// custom_services_to_be_implemented
+	const uint8_t *uuid;
+	uint8_t uuid_len;
+	uint8_t cccd;			// gatt_notification or gatt_indication to turn on, gatt_disable if none
+}wanted_characteristic_t;
+
+// GATT procedure the discovery waits for
+typedef enum{
+	DISCOVERY_IDLE,
+	DISCOVERY_CACHE_CHECK,			// Database hash read at the cached handle
+	DISCOVERY_SERVICES,				// all primary services
+	DISCOVERY_CHARACTERISTICS,		// characteristics of service discovery.index
+	DISCOVERY_DATABASE_HASH,		// Database hash read by UUID
+	DISCOVERY_CCCD,					// notifications / indications of characteristic discovery.index
+	DISCOVERY_DONE
+}discovery_state_t;
+
+// One link per server connected at the same time, CLIENT_MAX_SERVERS of them
 typedef struct ble_client_s{
+	uint8_t link;								// index in ble_client[]
+	bd_addr address;							// server of the link, kept after a disconnect so it gets the link back
+	bool address_valid;
 	ble_status_t status;
 	struct{
 		uint32_t handle;
-		bool procedure_complete_status;
-	}service[2];
+	}service[SERVICE_COUNT];
 	struct{
 			uint32_t handle;
-			bool procedure_complete_status;
-		}characteristic[2];
+		}characteristic[CHARACTERISTIC_COUNT];
 	struct{
-			bool procedure_complete_status;
-		}indication[2];
+		discovery_state_t state;
+		uint8_t index;
+		uint8_t procedures;			// GATT procedures run since the connection opened
+		bool cached;				// handles taken from the GATT cache
+		uint32_t start_ticks;		// connection opened
+		uint16_t interval;			// connection interval, 1.25 ms units
+	}discovery;
+	uint8_t bonding;							// BOND_HANDLE_INVALID if the server was not bonded yet
+	uint8_t database_hash[DATABASE_HASH_LEN];	// Database hash read from the server
+	bool database_hash_valid;
+	uint16_t y_axis_value;						// newest sample
+	uint16_t y_axis_reference_value;			// taken at the first TUT value of the server
+	bool y_axis_reference_value_set;
+	bool bad_posture;
 }ble_client_t;
 
 //function prototypes
@@ -132,6 +190,20 @@ float bitstream_to_float(const uint8_t *);
 #define IO_CAPABILITY  				   0 // 0=DISPLAYONLY
 #define SM_CONFIG_FLAGS 			  (0x0A) // encrypted link and bonding should be confirmed
 
+// Bonds are kept in flash so a known peer reconnects without pairing again
+#define BOND_MAX_PEERS				   (4)
+#define BOND_POLICY_REPLACE_LRU		   (2) // a new bond replaces the least recently used one
+#define BOND_HANDLE_INVALID			   (0xFF)
+
+// Connectable set 0, the posture broadcast (broadcast.h) and the periodic train
+// (periodic_stream.h), read by gecko_main.c
+#define MAX_ADVERTISERS				   (3)
+
+// Time until trigger value: flags, seconds, and with TUT_FLAG_UPRIGHT the server's stored
+// upright Y-axis reference (int16 mg)
+#define TUT_FLAG_UPRIGHT			   (0x01)
+#define TUT_UPRIGHT_LEN				   (4)
+
 
 #include "native_gecko.h"
 #include "scheduler.h"
@@ -144,6 +216,9 @@ float bitstream_to_float(const uint8_t *);
 #include "ble_device_type.h"
 #include "gpio.h"
 #include "imu.h"
+#include "fusion.h"
+#include "imu_cal.h"
+#include "settings.h"
 #include "main.h"
 
 extern uint8_t connected_status_flag;
@@ -18,6 +18,9 @@
 // Set this #define to the bd_addr of the Gecko that will be your Server
 #define SERVER_BT_ADDRESS {{ 0xec, 0x7e, 0xa9, 0x9f, 0xfd, 0x90 }}
 
+// Servers the client stays connected to at the same time (e.g. upper back and neck)
+#define CLIENT_MAX_SERVERS 2
+
 #if DEVICE_IS_BLE_SERVER
 #define BUILD_INCLUDES_BLE_SERVER 1
 #define BUILD_INCLUDES_BLE_CLIENT 0
@@ -0,0 +1,277 @@
+/*********************************************************************************************
+ *  @file body_fusion.c
+ *	@brief Time alignment of the samples of several servers and posture from their relative
+ *		   orientation, see body_fusion.h.
+ *
+ *  @authors : Rajat Chaple (GATT client code)
+ *
+ *
+ *  @date      April 29, 2020 (last update)
+ *
+ **********************************************************************************************/
+#include "ble_device_type.h"
+#if BUILD_INCLUDES_BLE_CLIENT
+
+#include <string.h>
+#include "body_fusion.h"
+#include "cordic.h"
+#include "history.h"
+#include "log.h"
+
+
+body_fusion_link_t body_fusion[CLIENT_MAX_SERVERS];
+
+static uint32_t body_fusion_start_ticks;
+static bool body_fusion_started;
+
+
+// Local time line, ms since the first sample
+static uint32_t body_fusion_now_ms(void)
+{
+	if (body_fusion_started == false)
+	{
+		body_fusion_start_ticks = history_time_ticks();
+		body_fusion_started = true;
+	}
+	return (uint32_t)((uint64_t)(history_time_ticks() - body_fusion_start_ticks) * 1000 / HISTORY_TIMER_FREQ);
+}
+
+static const body_fusion_sample_t *body_fusion_at(const body_fusion_link_t *link, uint32_t n)
+{
+	return &link->ring[n % BODY_FUSION_RING];
+}
+
+static uint32_t body_fusion_distance_ms(uint32_t a, uint32_t b)
+{
+	int32_t d = (int32_t)(a - b);
+
+	return (d < 0) ? (uint32_t)-d : (uint32_t)d;
+}
+
+// r = conj(a) * b, Q15
+static void body_fusion_relative(const int16_t *a, const int16_t *b, int16_t *r)
+{
+	r[0] = (int16_t)(((int32_t)a[0] * b[0] + (int32_t)a[1] * b[1] + (int32_t)a[2] * b[2] + (int32_t)a[3] * b[3]) >> 15);
+	r[1] = (int16_t)(((int32_t)a[0] * b[1] - (int32_t)a[1] * b[0] - (int32_t)a[2] * b[3] + (int32_t)a[3] * b[2]) >> 15);
+	r[2] = (int16_t)(((int32_t)a[0] * b[2] + (int32_t)a[1] * b[3] - (int32_t)a[2] * b[0] - (int32_t)a[3] * b[1]) >> 15);
+	r[3] = (int16_t)(((int32_t)a[0] * b[3] - (int32_t)a[1] * b[2] + (int32_t)a[2] * b[1] - (int32_t)a[3] * b[0]) >> 15);
+}
+
+// Rotation angle of a Q15 quaternion, 0 to 18000 cdeg
+static uint16_t body_fusion_angle_cdeg(const int16_t *q)
+{
+	uint32_t v = cordic_hypot((int32_t)cordic_hypot(q[1], q[2]), q[3]);
+	int32_t w = (q[0] < 0) ? -q[0] : q[0];
+
+	return (uint16_t)(2 * cordic_atan2_cdeg((int32_t)v, w));
+}
+
+/** -------------------------------------------------------------------------------------------
+ * @brief one aligned pair: relative orientation, its angle from the calibrated one and the
+ * posture of the link
+ *-------------------------------------------------------------------------------------------- **/
+static void body_fusion_pair(body_fusion_link_t *link, const body_fusion_sample_t *reference,
+		const body_fusion_sample_t *sample)
+{
+	int16_t relative[4];
+	int16_t deviation[4];
+	uint32_t skew = body_fusion_distance_ms(reference->t_ms, sample->t_ms);
+
+	body_fusion_relative(reference->q, sample->q, relative);
+
+	if (link->calibrate)
+	{
+		memcpy(link->reference, relative, sizeof(link->reference));
+		link->reference_valid = true;
+		link->calibrate = false;
+	}
+
+	link->pairs++;
+	link->skew_sum_ms += skew;
+	link->skew_max_ms = (skew > link->skew_max_ms) ? skew : link->skew_max_ms;
+	link->angle_t_ms = sample->t_ms;
+
+	if (link->reference_valid)
+	{
+		body_fusion_relative(link->reference, relative, deviation);
+		link->angle_cdeg = body_fusion_angle_cdeg(deviation);
+		link->bad_posture = (link->angle_cdeg > BODY_FUSION_BAD_CDEG);
+	}
+}
+
+/** -------------------------------------------------------------------------------------------
+ * @brief pairs the samples of link k not paired yet with link 0. Waits while link 0 has no
+ * sample at or after the one to pair. Every sample of link k is looked at once and the link 0
+ * cursor only moves forward.
+ *-------------------------------------------------------------------------------------------- **/
+static void body_fusion_match(body_fusion_link_t *link)
+{
+	body_fusion_link_t *reference = &body_fusion[0];
+
+	while (link->next != link->head && reference->head != 0)
+	{
+		if (link->head - link->next > BODY_FUSION_RING)
+		{
+			link->dropped += link->head - link->next - BODY_FUSION_RING;
+			link->next = link->head - BODY_FUSION_RING;
+		}
+
+		const body_fusion_sample_t *sample = body_fusion_at(link, link->next);
+
+		if ((int32_t)(body_fusion_at(reference, reference->head - 1)->t_ms - sample->t_ms) < 0)
+		{
+			break;
+		}
+
+		if (reference->head - link->cursor > BODY_FUSION_RING)
+		{
+			link->cursor = reference->head - BODY_FUSION_RING;
+		}
+		while (link->cursor + 1 != reference->head
+				&& (int32_t)(body_fusion_at(reference, link->cursor + 1)->t_ms - sample->t_ms) <= 0)
+		{
+			link->cursor++;
+		}
+
+		const body_fusion_sample_t *nearest = body_fusion_at(reference, link->cursor);
+		if (link->cursor + 1 != reference->head
+				&& body_fusion_distance_ms(body_fusion_at(reference, link->cursor + 1)->t_ms, sample->t_ms)
+					< body_fusion_distance_ms(nearest->t_ms, sample->t_ms))
+		{
+			nearest = body_fusion_at(reference, link->cursor + 1);
+		}
+
+		if (body_fusion_distance_ms(nearest->t_ms, sample->t_ms) <= BODY_FUSION_MAX_SKEW_MS)
+		{
+			body_fusion_pair(link, nearest, sample);
+		}
+		else
+		{
+			link->skipped++;
+		}
+		link->next++;
+	}
+}
+
+
+// Connection opened or closed, the session time of the server starts over
+void body_fusion_link_reset(uint8_t link)
+{
+	bool reference_valid = body_fusion[link].reference_valid;
+	int16_t reference[4];
+
+	memcpy(reference, body_fusion[link].reference, sizeof(reference));
+	memset(&body_fusion[link], 0, sizeof(body_fusion[link]));
+
+	// the calibrated pose is kept for a reconnect
+	body_fusion[link].reference_valid = reference_valid;
+	memcpy(body_fusion[link].reference, reference, sizeof(reference));
+
+	if (link == 0)
+	{
+		for (uint8_t k = 1; k < CLIENT_MAX_SERVERS; k++)
+		{
+			body_fusion[k].next = body_fusion[k].head;
+			body_fusion[k].cursor = 0;
+		}
+	}
+}
+
+// Posture reference taken on a link: the next pair of it (of every link for link 0) is the calibrated pose
+void body_fusion_calibrate(uint8_t link)
+{
+
+	for (uint8_t k = 1; k < CLIENT_MAX_SERVERS; k++)
+	{
+		if (link == 0 || link == k)
+		{
+			body_fusion[k].calibrate = true;
+		}
+	}
+
+}
+
+/** -------------------------------------------------------------------------------------------
+ * @brief new samples of a link, oldest first (not resent ones, they are older than the ring).
+ * The newest sample sets the arrival delay.
+ *-------------------------------------------------------------------------------------------- **/
+void body_fusion_samples(uint8_t link, const live_sample_t *samples, uint8_t count)
+{
+	body_fusion_link_t *l = &body_fusion[link];
+	int32_t offset;
+
+	// older single value frames have no sample time
+	if (count == 0 || samples[count - 1].t_ms == 0)
+	{
+		return;
+	}
+
+	offset = (int32_t)(body_fusion_now_ms() - samples[count - 1].t_ms);
+	if (l->offset_valid == false || offset < l->offset_ms)
+	{
+		l->offset_ms = offset;
+		l->offset_valid = true;
+	}
+
+	for (uint8_t i = 0; i < count; i++)
+	{
+		body_fusion_sample_t *s = &l->ring[l->head % BODY_FUSION_RING];
+
+		s->t_ms = samples[i].t_ms + (uint32_t)l->offset_ms;
+		memcpy(s->q, samples[i].q, sizeof(s->q));
+		l->head++;
+	}
+
+	if (link != 0)
+	{
+		body_fusion_match(l);
+	}
+	else
+	{
+		for (uint8_t k = 1; k < CLIENT_MAX_SERVERS; k++)
+		{
+			body_fusion_match(&body_fusion[k]);
+		}
+	}
+}
+
+/** -------------------------------------------------------------------------------------------
+ * @brief posture from the relative orientations
+ *
+ * @return false if no link has a calibrated relative angle newer than BODY_FUSION_STALE_MS,
+ * the posture is judged per link then
+ *-------------------------------------------------------------------------------------------- **/
+bool body_fusion_posture(bool *bad_posture)
+{
+	uint32_t now_ms = body_fusion_now_ms();
+	bool valid = false;
+
+	*bad_posture = false;
+	for (uint8_t k = 1; k < CLIENT_MAX_SERVERS; k++)
+	{
+		if (body_fusion[k].reference_valid && body_fusion[k].pairs != 0
+				&& now_ms - body_fusion[k].angle_t_ms <= BODY_FUSION_STALE_MS)
+		{
+			valid = true;
+			*bad_posture = *bad_posture || body_fusion[k].bad_posture;
+		}
+	}
+	return valid;
+}
+
+void body_fusion_log_stats(uint8_t link)
+{
+
+	if (link == 0)
+	{
+		return;
+	}
+
+	LOG_INFO("Body fusion %u: %lu pairs, %lu skipped, %lu dropped, skew mean %lu ms max %lu ms, angle %u cdeg",
+			link, body_fusion[link].pairs, body_fusion[link].skipped, body_fusion[link].dropped,
+			(body_fusion[link].pairs != 0) ? body_fusion[link].skew_sum_ms / body_fusion[link].pairs : 0,
+			body_fusion[link].skew_max_ms, body_fusion[link].angle_cdeg);
+
+}
+
+#endif
@@ -0,0 +1,84 @@
+/*********************************************************************************************
+ *  @file  body_fusion.h
+ *	@brief Posture from the relative orientation of two wearables (e.g. neck against upper
+ *		   back) instead of the Y-axis tilt of one. The server of link 0 is the reference
+ *		   body segment, every other link is compared against it.
+ *
+ *		   The servers' clocks are not synced: a sample is put on the local time line at its
+ *		   session time plus the smallest arrival delay seen on its link. Each link keeps its
+ *		   newest BODY_FUSION_RING aligned samples. A sample of link k is paired with the
+ *		   link 0 sample nearest in time, with a cursor into the link 0 ring that only moves
+ *		   forward, so pairing is O(1) per sample. Pairs further apart than
+ *		   BODY_FUSION_MAX_SKEW_MS are skipped.
+ *
+ *		   For a pair, the relative orientation is conj(q0) * qk. Its rotation away from the
+ *		   relative orientation captured at calibration is the posture angle, bad beyond
+ *		   BODY_FUSION_BAD_CDEG. Integer only (Q15 quaternions, cordic.h).
+ *
+ *  @authors : Rajat Chaple (GATT client code)
+ *
+ *
+ *  @date      April 29, 2020 (last update)
+ *
+ **********************************************************************************************/
+#include "ble_device_type.h"
+#if BUILD_INCLUDES_BLE_CLIENT
+
+#ifndef __BODY_FUSION_H__
+#define __BODY_FUSION_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "live_frame.h"
+
+// 1: posture is judged from the relative orientation while two servers stream
+#define BODY_FUSION					(1)
+
+#define BODY_FUSION_RING			(16)	// aligned samples kept per link
+#define BODY_FUSION_MAX_SKEW_MS		(500)	// largest time between the two samples of a pair
+#define BODY_FUSION_STALE_MS		(15000)	// a relative angle older than this is not used
+#define BODY_FUSION_BAD_CDEG		(2000)	// rotation away from the calibrated pose
+
+typedef struct body_fusion_sample_s
+{
+	uint32_t t_ms;				// local time line, ms
+	int16_t q[4];				// orientation w, x, y, z (Q15)
+
+}body_fusion_sample_t;
+
+typedef struct body_fusion_link_s
+{
+	body_fusion_sample_t ring[BODY_FUSION_RING];
+	uint32_t head;				// samples pushed, the newest is ring[(head - 1) % BODY_FUSION_RING]
+	bool offset_valid;
+	int32_t offset_ms;			// local time minus session time, smallest seen
+
+	// Pairing of this link (k > 0) with link 0
+	uint32_t next;				// first sample of this link not paired yet
+	uint32_t cursor;			// link 0 sample at or just before it
+	bool reference_valid;
+	int16_t reference[4];		// relative orientation at calibration
+	bool calibrate;				// take the next pair as the reference
+	uint32_t angle_t_ms;		// local time of the last pair
+	uint16_t angle_cdeg;		// posture angle of the last pair
+	bool bad_posture;
+
+	uint32_t pairs;
+	uint32_t skipped;			// nearest link 0 sample too far off
+	uint32_t dropped;			// overwritten before link 0 caught up
+	uint32_t skew_sum_ms;
+	uint32_t skew_max_ms;
+
+}body_fusion_link_t;
+
+extern body_fusion_link_t body_fusion[CLIENT_MAX_SERVERS];
+
+void body_fusion_link_reset(uint8_t link);
+void body_fusion_calibrate(uint8_t link);
+void body_fusion_samples(uint8_t link, const live_sample_t *samples, uint8_t count);
+bool body_fusion_posture(bool *bad_posture);
+void body_fusion_log_stats(uint8_t link);
+
+#endif /* __BODY_FUSION_H__ */
+
+#endif
@@ -0,0 +1,406 @@
+/*********************************************************************************************
+ *  @file broadcast.c
+ *	@brief Posture broadcast in the advertising data: builds and authenticates it (server),
+ *		   checks it and drops replays (client). See broadcast.h for the format.
+ *
+ *  @authors : Rajat Chaple (GATT client code)
+ *  		   Sundar Krishnakumar (GATT server code)
+ *
+ *  @date      April 29, 2020 (last update)
+ **********************************************************************************************/
+#include "ble_device_type.h"
+#include <string.h>
+#include "broadcast.h"
+#include "infrastructure.h"
+#include "em_cmu.h"
+#include "em_crypto.h"
+
+#if POSTURE_BROADCAST
+
+#define BROADCAST_BLOCK_LEN			(16)
+
+// Address, company id and body
+#define BROADCAST_MSG_LEN			(BROADCAST_ADDRESS_LEN + 2 + BROADCAST_BODY_LEN)
+
+static const uint8_t broadcast_key[BROADCAST_KEY_LEN] = BROADCAST_KEY;
+
+
+static void broadcast_aes(const uint8_t *key, const uint8_t *in, uint8_t *out)
+{
+
+	CMU_ClockEnable(cmuClock_CRYPTO0, true);
+	CRYPTO_AES_ECB128(CRYPTO0, out, in, BROADCAST_BLOCK_LEN, key, true);
+
+}
+
+// Multiplication by x in GF(2^128), CMAC subkeys
+static void broadcast_cmac_subkey(const uint8_t *in, uint8_t *out)
+{
+	uint8_t carry = in[0] >> 7;
+
+	for (uint8_t i = 0; i < BROADCAST_BLOCK_LEN - 1; i++)
+	{
+		out[i] = (uint8_t)((in[i] << 1) | (in[i + 1] >> 7));
+	}
+	out[BROADCAST_BLOCK_LEN - 1] = (uint8_t)(in[BROADCAST_BLOCK_LEN - 1] << 1);
+
+	if (carry)
+	{
+		out[BROADCAST_BLOCK_LEN - 1] ^= 0x87;
+	}
+}
+
+
+/** -------------------------------------------------------------------------------------------
+ * @brief AES-CMAC (RFC 4493) of msg, the full 16 bytes. The broadcast keeps the first
+ * BROADCAST_MAC_LEN of them.
+ *-------------------------------------------------------------------------------------------- **/
+void broadcast_cmac(const uint8_t *key, const uint8_t *msg, uint8_t len, uint8_t *mac)
+{
+	uint8_t k[BROADCAST_BLOCK_LEN] = {0};
+	uint8_t subkey[BROADCAST_BLOCK_LEN];
+	uint8_t x[BROADCAST_BLOCK_LEN] = {0};
+	uint8_t blocks = (len + BROADCAST_BLOCK_LEN - 1) / BROADCAST_BLOCK_LEN;
+	uint8_t last_len;
+
+	// K1 for a last block that is full, K2 for a padded one
+	broadcast_aes(key, k, k);
+	broadcast_cmac_subkey(k, subkey);
+	if (blocks == 0 || len % BROADCAST_BLOCK_LEN != 0)
+	{
+		broadcast_cmac_subkey(subkey, subkey);
+	}
+	if (blocks == 0)
+	{
+		blocks = 1;
+	}
+	last_len = len - (blocks - 1) * BROADCAST_BLOCK_LEN;
+
+	for (uint8_t b = 0; b < blocks; b++)
+	{
+		const uint8_t *m = msg + b * BROADCAST_BLOCK_LEN;
+
+		if (b == blocks - 1)
+		{
+			for (uint8_t i = 0; i < BROADCAST_BLOCK_LEN; i++)
+			{
+				uint8_t byte = (i < last_len) ? m[i] : ((i == last_len) ? 0x80 : 0x00);
+				x[i] ^= byte ^ subkey[i];
+			}
+		}
+		else
+		{
+			for (uint8_t i = 0; i < BROADCAST_BLOCK_LEN; i++)
+			{
+				x[i] ^= m[i];
+			}
+		}
+		broadcast_aes(key, x, x);
+	}
+
+	memcpy(mac, x, BROADCAST_BLOCK_LEN);
+}
+
+// MAC of the structure at ad (from the length byte) sent by address
+static void broadcast_mac(const uint8_t *address, const uint8_t *ad, uint8_t *mac)
+{
+	uint8_t msg[BROADCAST_MSG_LEN];
+
+	memcpy(msg, address, BROADCAST_ADDRESS_LEN);
+	memcpy(msg + BROADCAST_ADDRESS_LEN, ad + 2, 2 + BROADCAST_BODY_LEN);
+	broadcast_cmac(broadcast_key, msg, BROADCAST_MSG_LEN, mac);
+}
+
+
+/** -------------------------------------------------------------------------------------------
+ * @brief writes the manufacturer specific AD structure for status, BROADCAST_AD_LEN bytes.
+ *
+ * @param address : advertiser address, as in the scan reports (least significant byte first)
+ * @return length written
+ *-------------------------------------------------------------------------------------------- **/
+uint8_t broadcast_pack(const uint8_t *address, const broadcast_status_t *status, uint8_t *ad)
+{
+	uint8_t *ptr = ad;
+	uint8_t mac[BROADCAST_BLOCK_LEN];
+
+	UINT8_TO_BITSTREAM(ptr, BROADCAST_AD_LEN - 1);
+	UINT8_TO_BITSTREAM(ptr, BROADCAST_AD_TYPE);
+	UINT16_TO_BITSTREAM(ptr, BROADCAST_COMPANY_ID);
+	UINT8_TO_BITSTREAM(ptr, BROADCAST_VERSION);
+	UINT8_TO_BITSTREAM(ptr, status->flags);
+	UINT16_TO_BITSTREAM(ptr, status->session);
+	UINT16_TO_BITSTREAM(ptr, status->seq);
+	UINT16_TO_BITSTREAM(ptr, status->tilt_cdeg);
+	UINT8_TO_BITSTREAM(ptr, status->battery);
+
+	broadcast_mac(address, ad, mac);
+	memcpy(ptr, mac, BROADCAST_MAC_LEN);
+
+	return BROADCAST_AD_LEN;
+}
+
+/** -------------------------------------------------------------------------------------------
+ * @brief looks for the posture broadcast in the advertising data of a scan report and checks
+ * its MAC.
+ *
+ * @return BROADCAST_VALID with status filled in, BROADCAST_BAD_MAC or BROADCAST_NOT_FOUND
+ *-------------------------------------------------------------------------------------------- **/
+broadcast_result_t broadcast_unpack(const uint8_t *address, const uint8_t *data, uint8_t len, broadcast_status_t *status)
+{
+	uint8_t i = 0;
+
+	while (i + 1 < len && data[i] != 0 && i + 1 + data[i] <= len)
+	{
+		const uint8_t *ad = &data[i];
+
+		i += 1 + ad[0];
+
+		if (ad[0] != BROADCAST_AD_LEN - 1 || ad[1] != BROADCAST_AD_TYPE
+				|| BYTES_TO_UINT16(ad[2], ad[3]) != BROADCAST_COMPANY_ID || ad[4] != BROADCAST_VERSION)
+		{
+			continue;
+		}
+
+		uint8_t mac[BROADCAST_BLOCK_LEN];
+		uint8_t diff = 0;
+
+		broadcast_mac(address, ad, mac);
+		for (uint8_t j = 0; j < BROADCAST_MAC_LEN; j++)
+		{
+			diff |= mac[j] ^ ad[4 + BROADCAST_BODY_LEN + j];
+		}
+		if (diff != 0)
+		{
+			return BROADCAST_BAD_MAC;
+		}
+
+		status->flags = ad[5];
+		status->session = BYTES_TO_UINT16(ad[6], ad[7]);
+		status->seq = BYTES_TO_UINT16(ad[8], ad[9]);
+		status->tilt_cdeg = BYTES_TO_UINT16(ad[10], ad[11]);
+		status->battery = ad[12];
+
+		return BROADCAST_VALID;
+	}
+
+	return BROADCAST_NOT_FOUND;
+}
+
+
+#if BUILD_INCLUDES_BLE_CLIENT
+
+#include "log.h"
+
+broadcast_client_t broadcast_client;
+
+
+static broadcast_sender_t *broadcast_client_sender(const uint8_t *address)
+{
+	for (uint8_t i = 0; i < BROADCAST_SENDERS; i++)
+	{
+		if (broadcast_client.sender[i].valid
+				&& memcmp(broadcast_client.sender[i].address, address, BROADCAST_ADDRESS_LEN) == 0)
+		{
+			return &broadcast_client.sender[i];
+		}
+	}
+
+	return NULL;
+}
+
+/** -------------------------------------------------------------------------------------------
+ * @brief takes the posture broadcast from a scan report. Every advertising event repeats the
+ * current status, only a newer one than the last taken from that advertiser is returned.
+ *
+ * @param address : advertiser address from the scan report
+ * @return true if status holds a new posture status
+ *-------------------------------------------------------------------------------------------- **/
+bool broadcast_client_scan_report(const uint8_t *address, const uint8_t *data, uint8_t len, broadcast_status_t *status)
+{
+	broadcast_result_t result = broadcast_unpack(address, data, len, status);
+
+	if (result == BROADCAST_NOT_FOUND)
+	{
+		return false;
+	}
+	if (result == BROADCAST_BAD_MAC)
+	{
+		broadcast_client.bad_mac++;
+		return false;
+	}
+
+	broadcast_sender_t *sender = broadcast_client_sender(address);
+
+	if (sender == NULL)
+	{
+		sender = &broadcast_client.sender[broadcast_client.next_sender];
+		broadcast_client.next_sender = (broadcast_client.next_sender + 1) % BROADCAST_SENDERS;
+		sender->valid = true;
+		memcpy(sender->address, address, BROADCAST_ADDRESS_LEN);
+	}
+	else if (status->session == sender->session && status->seq == sender->seq)
+	{
+		broadcast_client.repeated++;
+		return false;
+	}
+	else if ((status->session == sender->session && (int16_t)(status->seq - sender->seq) < 0)
+			|| (int16_t)(status->session - sender->session) < 0)
+	{
+		broadcast_client.replayed++;
+		return false;
+	}
+
+	sender->session = status->session;
+	sender->seq = status->seq;
+	broadcast_client.received++;
+
+	if (broadcast_client.received % BROADCAST_LOG_EVERY == 0)
+	{
+		broadcast_client_log_stats();
+	}
+
+	return true;
+}
+
+void broadcast_client_log_stats(void)
+{
+
+	LOG_INFO("Broadcast: %lu taken, %lu repeated, %lu bad MAC, %lu replayed", broadcast_client.received,
+			broadcast_client.repeated, broadcast_client.bad_mac, broadcast_client.replayed);
+
+}
+
+#else
+
+#include "native_gecko.h"
+#include "log.h"
+#include "imu.h"
+#include "imu_cal.h"
+#include "recorder.h"
+
+// Flags AD structure in front of the posture, so scanners in general discovery report it
+#define BROADCAST_FLAGS_AD_LEN		(3)
+#define BROADCAST_FLAGS				(0x06)	// LE General Discoverable, BR/EDR not supported
+
+static uint8_t broadcast_address[BROADCAST_ADDRESS_LEN];
+static uint16_t broadcast_seq;
+
+
+/** -------------------------------------------------------------------------------------------
+ * @brief AVDD (the coin cell) in percent between BROADCAST_BATTERY_EMPTY_MV and _FULL_MV.
+ * One 12 bit single conversion against the internal 5 V reference, ADC0 is clocked only for it.
+ *-------------------------------------------------------------------------------------------- **/
+static uint8_t broadcast_battery_read(void)
+{
+	uint32_t hfper_mhz;
+	uint32_t mv;
+
+	CMU_ClockEnable(cmuClock_HFPER, true);
+	CMU_ClockEnable(cmuClock_ADC0, true);
+
+	// ADC clock at most 16 MHz, TIMEBASE counts 1 us of warm-up
+	hfper_mhz = CMU_ClockFreqGet(cmuClock_HFPER) / 1000000;
+	ADC0->CTRL = ((((hfper_mhz + 15) / 16 - 1) << _ADC_CTRL_PRESC_SHIFT) & _ADC_CTRL_PRESC_MASK)
+			| ((hfper_mhz << _ADC_CTRL_TIMEBASE_SHIFT) & _ADC_CTRL_TIMEBASE_MASK)
+			| ADC_CTRL_WARMUPMODE_NORMAL;
+	ADC0->SINGLECTRL = ADC_SINGLECTRL_POSSEL_AVDD | ADC_SINGLECTRL_NEGSEL_VSS | ADC_SINGLECTRL_REF_5V
+			| ADC_SINGLECTRL_RES_12BIT | ADC_SINGLECTRL_AT_16CYCLES;
+
+	ADC0->CMD = ADC_CMD_SINGLESTART;
+	while ((ADC0->STATUS & ADC_STATUS_SINGLEDV) == 0)
+	{
+	}
+	mv = ADC0->SINGLEDATA * 5000 / 4096;
+
+	CMU_ClockEnable(cmuClock_ADC0, false);
+
+	if (mv <= BROADCAST_BATTERY_EMPTY_MV)
+	{
+		return 0;
+	}
+	if (mv >= BROADCAST_BATTERY_FULL_MV)
+	{
+		return 100;
+	}
+	return (uint8_t)((mv - BROADCAST_BATTERY_EMPTY_MV) * 100 / (BROADCAST_BATTERY_FULL_MV - BROADCAST_BATTERY_EMPTY_MV));
+}
+
+
+/** -------------------------------------------------------------------------------------------
+ * @brief starts the non-connectable broadcast set next to the connectable one (set 0).
+ * Called on boot, the data is filled in by broadcast_update().
+ *-------------------------------------------------------------------------------------------- **/
+void broadcast_start(void)
+{
+	struct gecko_msg_system_get_bt_address_rsp_t *addr = gecko_cmd_system_get_bt_address();
+
+	memcpy(broadcast_address, addr->address.addr, BROADCAST_ADDRESS_LEN);
+	broadcast_seq = 0;
+
+	broadcast_update(0);
+
+	struct gecko_msg_le_gap_set_advertise_timing_rsp_t *ret1 = gecko_cmd_le_gap_set_advertise_timing(BROADCAST_ADV_HANDLE,
+			BROADCAST_INTERVAL_MS * 8 / 5, BROADCAST_INTERVAL_MS * 8 / 5, 0, 0);
+	if (ret1->result != 0)
+	{
+		#if INCLUDE_LOGGING
+			LOG_ERROR("ERROR: %d | response code from gecko_cmd_le_gap_set_advertise_timing()", ret1->result);
+		#endif
+	}
+
+	struct gecko_msg_le_gap_start_advertising_rsp_t *ret2 = gecko_cmd_le_gap_start_advertising(BROADCAST_ADV_HANDLE,
+			le_gap_user_data, le_gap_non_connectable);
+	if (ret2->result != 0)
+	{
+		#if INCLUDE_LOGGING
+			LOG_ERROR("ERROR: %d | response code from gecko_cmd_le_gap_start_advertising()", ret2->result);
+		#endif
+	}
+}
+
+/** -------------------------------------------------------------------------------------------
+ * @brief puts the current posture into the broadcast, after every sample. The advertising
+ * set keeps running, the stack sends the new data from its next advertising event.
+ *
+ * @param connected : 1 if a client is connected over GATT
+ *-------------------------------------------------------------------------------------------- **/
+void broadcast_update(uint8_t connected)
+{
+	broadcast_status_t status;
+	uint8_t data[BROADCAST_FLAGS_AD_LEN + BROADCAST_AD_LEN];
+	uint8_t *ptr = data;
+
+	status.flags = connected ? BROADCAST_FLAG_CONNECTED : 0;
+	if (calibration_complete_flag == 1)
+	{
+		int32_t from_upright = (int32_t)tilt - (int32_t)imu_cal.record.upright_tilt_cdeg;
+
+		status.flags |= BROADCAST_FLAG_CALIBRATED;
+		if (from_upright > BROADCAST_BAD_POSTURE_CDEG || from_upright < -BROADCAST_BAD_POSTURE_CDEG)
+		{
+			status.flags |= BROADCAST_FLAG_BAD_POSTURE;
+		}
+	}
+	status.session = recorder.session;
+	status.seq = broadcast_seq++;
+	status.tilt_cdeg = tilt;
+	status.battery = broadcast_battery_read();
+
+	UINT8_TO_BITSTREAM(ptr, BROADCAST_FLAGS_AD_LEN - 1);
+	UINT8_TO_BITSTREAM(ptr, 0x01);	// flags
+	UINT8_TO_BITSTREAM(ptr, BROADCAST_FLAGS);
+	ptr += broadcast_pack(broadcast_address, &status, ptr);
+
+	struct gecko_msg_le_gap_bt5_set_adv_data_rsp_t *ret = gecko_cmd_le_gap_bt5_set_adv_data(BROADCAST_ADV_HANDLE, 0,
+			ptr - data, data);
+	if (ret->result != 0)
+	{
+		#if INCLUDE_LOGGING
+			LOG_ERROR("ERROR: %d | response code from gecko_cmd_le_gap_bt5_set_adv_data()", ret->result);
+		#endif
+	}
+}
+
+#endif
+
+#endif
@@ -0,0 +1,138 @@
+/*********************************************************************************************
+ *  @file  broadcast.h
+ *	@brief Connectionless posture broadcast. The server puts its posture state into the
+ *		   manufacturer specific data of a non-connectable advertising set, next to the
+ *		   connectable one, and updates it in place after every sample. Any number of
+ *		   clients read it from their scan reports without connecting.
+ *
+ *		   AD structure (little endian):
+ *		     length, type 0xFF, company id (uint16),
+ *		     version, flags, session (uint16), seq (uint16), tilt from vertical in
+ *		     centidegrees (uint16), battery in percent (uint8),
+ *		     MAC (4 bytes)
+ *
+ *		   The MAC is AES-CMAC (RFC 4493) with the key shared by both ends over the
+ *		   advertiser address, the company id and the fields above, truncated to 4 bytes.
+ *		   (session, seq) only moves forward, a receiver ignores anything older than what it
+ *		   has already taken from that advertiser, so a captured packet cannot be replayed.
+ *
+ *  @authors : Rajat Chaple (GATT client code)
+ *  		   Sundar Krishnakumar (GATT server code)
+ *
+ *  @date      April 29, 2020 (last update)
+ **********************************************************************************************/
+#include "ble_device_type.h"
+
+#ifndef __BROADCAST_H__
+#define __BROADCAST_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// 1: the server also advertises its posture next to the connectable set, and a client follows
+// it while it has no server connected over GATT (see POSTURE_BROADCAST_ONLY). Needs
+// BROADCAST_KEY, so it is off unless the build turns it on.
+#ifndef POSTURE_BROADCAST
+#define POSTURE_BROADCAST				(0)
+#endif
+
+#define BROADCAST_COMPANY_ID			(0xFFFF)	// reserved for internal use and testing
+#define BROADCAST_VERSION				(1)
+
+// Key shared by the server and its receivers, 16 bytes as an initializer list. It is not kept
+// in the sources, pass it to the compiler with the feature, e.g.
+// -DPOSTURE_BROADCAST=1 -DBROADCAST_KEY="{ 0x.., ... }".
+#define BROADCAST_KEY_LEN				(16)
+#if POSTURE_BROADCAST && !defined(BROADCAST_KEY)
+#error "POSTURE_BROADCAST needs BROADCAST_KEY, set the posture broadcast key of this device pair at build time"
+#endif
+
+#define BROADCAST_FLAG_BAD_POSTURE		(0x01)
+#define BROADCAST_FLAG_CALIBRATED		(0x02)	// posture is only judged once the IMU is calibrated
+#define BROADCAST_FLAG_CONNECTED		(0x04)	// a client is also connected over GATT
+
+#define BROADCAST_BATTERY_UNKNOWN		(0xFF)
+
+#define BROADCAST_AD_TYPE				(0xFF)	// manufacturer specific data
+#define BROADCAST_BODY_LEN				(9)
+#define BROADCAST_MAC_LEN				(4)
+#define BROADCAST_AD_LEN				(1 + 1 + 2 + BROADCAST_BODY_LEN + BROADCAST_MAC_LEN)
+
+#define BROADCAST_ADDRESS_LEN			(6)
+
+typedef struct broadcast_status_s
+{
+	uint8_t flags;
+	uint16_t session;			// server boot count
+	uint16_t seq;				// sample number within the session
+	uint16_t tilt_cdeg;			// from vertical
+	uint8_t battery;			// percent, BROADCAST_BATTERY_UNKNOWN if not measured
+
+}broadcast_status_t;
+
+typedef enum{
+	BROADCAST_NOT_FOUND,		// no posture broadcast in the advertising data
+	BROADCAST_BAD_MAC,			// found, but not sent by a holder of the key
+	BROADCAST_VALID
+}broadcast_result_t;
+
+void broadcast_cmac(const uint8_t *key, const uint8_t *msg, uint8_t len, uint8_t *mac);
+uint8_t broadcast_pack(const uint8_t *address, const broadcast_status_t *status, uint8_t *ad);
+broadcast_result_t broadcast_unpack(const uint8_t *address, const uint8_t *data, uint8_t len, broadcast_status_t *status);
+
+#if BUILD_INCLUDES_BLE_CLIENT
+
+// 1: never connect, posture only comes from the broadcast
+#define POSTURE_BROADCAST_ONLY			(0)
+
+// Advertisers followed for the replay check
+#define BROADCAST_SENDERS				(4)
+
+// Counters are logged every this many new reports
+#define BROADCAST_LOG_EVERY				(60)
+
+typedef struct broadcast_sender_s
+{
+	bool valid;
+	uint8_t address[BROADCAST_ADDRESS_LEN];
+	uint16_t session;
+	uint16_t seq;
+
+}broadcast_sender_t;
+
+typedef struct broadcast_client_s
+{
+	broadcast_sender_t sender[BROADCAST_SENDERS];
+	uint8_t next_sender;		// replaced when all are taken
+
+	uint32_t received;			// new status taken
+	uint32_t repeated;			// same status again (every advertising event carries it)
+	uint32_t bad_mac;
+	uint32_t replayed;			// older than the last one taken from that advertiser
+
+}broadcast_client_t;
+
+extern broadcast_client_t broadcast_client;
+
+bool broadcast_client_scan_report(const uint8_t *address, const uint8_t *data, uint8_t len, broadcast_status_t *status);
+void broadcast_client_log_stats(void);
+
+#else
+
+// Advertising set 0 stays the connectable one
+#define BROADCAST_ADV_HANDLE			(1)
+#define BROADCAST_INTERVAL_MS			(1000)
+
+// Tilt away from the upright reference taken at calibration that counts as bad posture
+#define BROADCAST_BAD_POSTURE_CDEG		(1500)
+
+// AVDD mapped to 0 - 100 %
+#define BROADCAST_BATTERY_EMPTY_MV		(2000)
+#define BROADCAST_BATTERY_FULL_MV		(3000)
+
+void broadcast_start(void);
+void broadcast_update(uint8_t connected);
+
+#endif
+
+#endif /* __BROADCAST_H__ */
@@ -0,0 +1,268 @@
+/*********************************************************************************************
+ *  @file cordic.c
+ *	@brief Integer CORDIC in vectoring mode. The input vector is rotated onto the +X axis
+ *		   with shift-and-add micro rotations; the accumulated rotation is atan2(y, x) and
+ *		   the final X (times the CORDIC gain 0.60725) is hypot(x, y).
+ *
+ *		   Inputs are pre-scaled so the larger component sits in [2^28, 2^29), which keeps
+ *		   full precision for small vectors and leaves headroom for the 1.647 growth.
+ *
+ *  @authors : Rajat Chaple (GATT client code)
+ *  		   Sundar Krishnakumar (GATT server code)
+ *
+ *  @date      April 29, 2020 (last update)
+ **********************************************************************************************/
+
+#include "ble_device_type.h"
+#include "cordic.h"
+#include "log.h"
+#include "em_device.h"
+
+#define CORDIC_GAIN_Q30			(652032874)		// prod(1 / sqrt(1 + 2^-2i)), i = 0..15
+#define CORDIC_180_DEG_Q16		(180 * CORDIC_DEG_Q16_ONE)
+
+// atan(2^-i) in degrees Q16
+static const int32_t cordic_atan_table[CORDIC_ITERATIONS] = {
+	2949120, 1740967, 919879, 466945, 234379, 117304, 58666, 29335,
+	14668, 7334, 3667, 1833, 917, 458, 229, 115
+};
+
+
+// Scale (x, y) so that max(|x|, |y|) is in [2^28, 2^29). Returns the left shift applied
+// (negative for a right shift). Both must not be zero.
+static int8_t cordic_prescale(int32_t *x, int32_t *y)
+{
+	uint32_t ax = (*x < 0) ? -(uint32_t)*x : (uint32_t)*x;
+	uint32_t ay = (*y < 0) ? -(uint32_t)*y : (uint32_t)*y;
+	uint32_t m = (ax > ay) ? ax : ay;
+	int8_t shift = (int8_t)__builtin_clz(m) - 3;
+
+	if (shift > 0)
+	{
+		*x = (int32_t)((uint32_t)*x << shift);
+		*y = (int32_t)((uint32_t)*y << shift);
+	}
+	else if (shift < 0)
+	{
+		*x >>= -shift;
+		*y >>= -shift;
+	}
+
+	return shift;
+}
+
+// Rotate (x, y), x >= 0, onto the X axis. Returns the rotation in degrees Q16.
+static int32_t cordic_vectoring(int32_t *x, int32_t *y)
+{
+	int32_t xi = *x;
+	int32_t yi = *y;
+	int32_t z = 0;
+
+	for (uint8_t i = 0; i < CORDIC_ITERATIONS; i++)
+	{
+		int32_t xs = xi >> i;
+		int32_t ys = yi >> i;
+
+		if (yi > 0)
+		{
+			xi += ys;
+			yi -= xs;
+			z += cordic_atan_table[i];
+		}
+		else
+		{
+			xi -= ys;
+			yi += xs;
+			z -= cordic_atan_table[i];
+		}
+	}
+
+	*x = xi;
+	*y = yi;
+	return z;
+}
+
+
+/** -------------------------------------------------------------------------------------------
+ * @brief four quadrant arc tangent
+ *
+ * @param y, x : vector components, any scale
+ * @return angle of (x, y) in degrees Q16, range (-180, 180]
+ *-------------------------------------------------------------------------------------------- **/
+int32_t cordic_atan2_deg_q16(int32_t y, int32_t x)
+{
+	int32_t offset = 0;
+
+	if (x == 0 && y == 0)
+	{
+		return 0;
+	}
+
+	cordic_prescale(&x, &y);
+
+	// Rotate left half plane by 180 degrees so CORDIC only sees x >= 0
+	if (x < 0)
+	{
+		offset = (y >= 0) ? CORDIC_180_DEG_Q16 : -CORDIC_180_DEG_Q16;
+		x = -x;
+		y = -y;
+	}
+
+	return cordic_vectoring(&x, &y) + offset;
+}
+
+/** -------------------------------------------------------------------------------------------
+ * @brief four quadrant arc tangent in centidegrees (rounded)
+ *-------------------------------------------------------------------------------------------- **/
+int16_t cordic_atan2_cdeg(int32_t y, int32_t x)
+{
+	int32_t angle = cordic_atan2_deg_q16(y, x);
+	int32_t rounding = (angle >= 0) ? (CORDIC_DEG_Q16_ONE / 2) : -(CORDIC_DEG_Q16_ONE / 2);
+
+	return (int16_t)(((int64_t)angle * 100 + rounding) / CORDIC_DEG_Q16_ONE);
+}
+
+/** -------------------------------------------------------------------------------------------
+ * @brief length of the vector (x, y)
+ *
+ * @param x, y : vector components, any scale
+ * @return sqrt(x^2 + y^2), same unit as the inputs
+ *-------------------------------------------------------------------------------------------- **/
+uint32_t cordic_hypot(int32_t x, int32_t y)
+{
+	if (x == 0 && y == 0)
+	{
+		return 0;
+	}
+
+	int8_t shift = cordic_prescale(&x, &y);
+
+	if (x < 0)
+	{
+		x = -x;
+		y = -y;
+	}
+
+	cordic_vectoring(&x, &y);
+
+	uint64_t magnitude = ((uint64_t)(uint32_t)x * CORDIC_GAIN_Q30) >> 30;
+
+	if (shift > 0)
+	{
+		magnitude = (magnitude + (1u << (shift - 1))) >> shift;
+	}
+	else if (shift < 0)
+	{
+		magnitude <<= -shift;
+	}
+
+	return (uint32_t)magnitude;
+}
+
+/** -------------------------------------------------------------------------------------------
+ * @brief integer square root, floor(sqrt(value))
+ *-------------------------------------------------------------------------------------------- **/
+uint32_t cordic_isqrt(uint32_t value)
+{
+	uint32_t result = 0;
+	uint32_t bit = 1u << 30;
+
+	while (bit > value)
+	{
+		bit >>= 2;
+	}
+
+	while (bit != 0)
+	{
+		if (value >= result + bit)
+		{
+			value -= result + bit;
+			result = (result >> 1) + bit;
+		}
+		else
+		{
+			result >>= 1;
+		}
+		bit >>= 2;
+	}
+
+	return result;
+}
+
+/** -------------------------------------------------------------------------------------------
+ * @brief angle between an accelerometer vector and the sensor Z axis
+ *
+ * @param x, y, z : acceleration, any unit (milli-g from accel_data)
+ * @return degrees from vertical in centidegrees, 0 (upright) to 18000 (upside down)
+ *-------------------------------------------------------------------------------------------- **/
+uint16_t cordic_tilt_from_vertical_cdeg(int32_t x, int32_t y, int32_t z)
+{
+
+	return (uint16_t)cordic_atan2_cdeg((int32_t)cordic_hypot(x, y), z);
+
+}
+
+
+#if CORDIC_SELF_TEST
+
+#if INCLUDE_LOGGING
+#include <math.h>
+#endif
+
+/** -------------------------------------------------------------------------------------------
+ * @brief compares cordic_atan2_deg_q16() / cordic_hypot() with libm over a grid of vectors and
+ * logs the worst case error and cycles per call. Not called during normal operation.
+ *-------------------------------------------------------------------------------------------- **/
+void cordic_self_test(void)
+{
+#if INCLUDE_LOGGING
+	const int32_t magnitudes[] = { 100, 1000, 4096, 65536, 1000000, 100000000 };
+	double max_angle_error = 0;
+	double max_hypot_error = 0;
+	uint32_t cordic_cycles = 0;
+	uint32_t libm_cycles = 0;
+	uint32_t calls = 0;
+	volatile float sink;
+
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+	for (uint8_t m = 0; m < sizeof(magnitudes) / sizeof(magnitudes[0]); m++)
+	{
+		for (int32_t deg = -179; deg <= 180; deg++)
+		{
+			int32_t x = (int32_t)(magnitudes[m] * cos(deg * M_PI / 180.0));
+			int32_t y = (int32_t)(magnitudes[m] * sin(deg * M_PI / 180.0));
+			uint32_t start;
+
+			start = DWT->CYCCNT;
+			int32_t angle = cordic_atan2_deg_q16(y, x);
+			uint32_t length = cordic_hypot(x, y);
+			cordic_cycles += DWT->CYCCNT - start;
+
+			start = DWT->CYCCNT;
+			sink = atan2f((float)y, (float)x);
+			sink = sqrtf((float)x * x + (float)y * y);
+			libm_cycles += DWT->CYCCNT - start;
+			calls++;
+
+			double angle_error = fabs(angle / 65536.0 - atan2(y, x) * 180.0 / M_PI);
+			if (angle_error > 180.0)
+			{
+				angle_error = 360.0 - angle_error;
+			}
+			double hypot_error = fabs(length - sqrt((double)x * x + (double)y * y)) / magnitudes[m];
+
+			max_angle_error = (angle_error > max_angle_error) ? angle_error : max_angle_error;
+			max_hypot_error = (hypot_error > max_hypot_error) ? hypot_error : max_hypot_error;
+		}
+	}
+	(void)sink;
+
+	LOG_INFO("cordic: max angle error %ld udeg, max hypot error %ld ppm, %lu cycles per atan2+hypot, "
+			"libm atan2f+sqrtf %lu cycles",
+			(int32_t)(max_angle_error * 1e6), (int32_t)(max_hypot_error * 1e6), cordic_cycles / calls, libm_cycles / calls);
+#endif
+}
+
+#endif
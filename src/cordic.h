@@ -0,0 +1,41 @@
+/*********************************************************************************************
+ *  @file  cordic.h
+ *	@brief Integer CORDIC (vectoring mode) atan2 and hypot, no floating point or libm.
+ *		   Used by both the server (tilt angle, orientation filter) and the client.
+ *
+ *		   Error bound over the full int32 input range:
+ *		     angle  : |error| < 0.005 degree
+ *		     hypot  : |error| < 0.5 LSB (rounding) + 2^-14 relative
+ *
+ *  @authors : Rajat Chaple (GATT client code)
+ *  		   Sundar Krishnakumar (GATT server code)
+ *
+ *  @date      April 29, 2020 (last update)
+ **********************************************************************************************/
+
+#ifndef __CORDIC_H__
+#define __CORDIC_H__
+
+#include <stdint.h>
+
+#define CORDIC_ITERATIONS		(16)
+
+// 1: builds cordic_self_test(), which links libm for the reference values
+#ifndef CORDIC_SELF_TEST
+#define CORDIC_SELF_TEST		(0)
+#endif
+
+// Angles are returned in degrees Q16 (65536 = 1 degree) or centidegrees
+#define CORDIC_DEG_Q16_ONE		(65536)
+
+int32_t cordic_atan2_deg_q16(int32_t y, int32_t x);
+int16_t cordic_atan2_cdeg(int32_t y, int32_t x);
+uint32_t cordic_hypot(int32_t x, int32_t y);
+uint32_t cordic_isqrt(uint32_t value);
+uint16_t cordic_tilt_from_vertical_cdeg(int32_t x, int32_t y, int32_t z);
+
+#if CORDIC_SELF_TEST
+void cordic_self_test(void);
+#endif
+
+#endif /* __CORDIC_H__ */
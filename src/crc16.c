@@ -0,0 +1,29 @@
+/*********************************************************************************************
+ *  @file crc16.c
+ *	@brief Bitwise CRC-16/CCITT-FALSE. Records are small and written rarely, so the
+ *		   table-less version is used to save flash.
+ *
+ *  @authors : Rajat Chaple (GATT client code)
+ *  		   Sundar Krishnakumar (GATT server code)
+ *
+ *  @date      April 29, 2020 (last update)
+ **********************************************************************************************/
+
+#include "crc16.h"
+
+uint16_t crc16_update(uint16_t crc, const uint8_t *data, uint32_t len)
+{
+
+	while (len--)
+	{
+		crc ^= (uint16_t)(*data++) << 8;
+
+		for (uint8_t bit = 0; bit < 8; bit++)
+		{
+			crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+		}
+	}
+
+	return crc;
+
+}
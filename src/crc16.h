@@ -0,0 +1,21 @@
+/*********************************************************************************************
+ *  @file  crc16.h
+ *	@brief CRC-16/CCITT-FALSE (poly 0x1021, init 0xFFFF) used to validate records kept in flash.
+ *
+ *  @authors : Rajat Chaple (GATT client code)
+ *  		   Sundar Krishnakumar (GATT server code)
+ *
+ *  @date      April 29, 2020 (last update)
+ **********************************************************************************************/
+
+#ifndef __CRC16_H__
+#define __CRC16_H__
+
+#include <stdint.h>
+
+#define CRC16_INIT		(0xFFFF)
+
+// Continue a CRC over another block, start with crc = CRC16_INIT
+uint16_t crc16_update(uint16_t crc, const uint8_t *data, uint32_t len);
+
+#endif /* __CRC16_H__ */
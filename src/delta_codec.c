@@ -0,0 +1,293 @@
+/*********************************************************************************************
+ *  @file delta_codec.c
+ *	@brief Delta / zigzag / varint codec for IMU sample streams, see delta_codec.h.
+ *
+ *  @authors : Rajat Chaple (GATT client code)
+ *  		   Sundar Krishnakumar (GATT server code)
+ *
+ *  @date      April 29, 2020 (last update)
+ **********************************************************************************************/
+
+#include <string.h>
+#include "delta_codec.h"
+#include "log.h"
+#include "em_device.h"
+
+
+////////////////////////////////////////////// Varint / zigzag ///////////////////////////////////////////////////////////////
+
+uint8_t delta_codec_put_varint(uint8_t *ptr, uint32_t value)
+{
+	uint8_t len = 0;
+
+	while (value >= 0x80)
+	{
+		ptr[len++] = (uint8_t)(value | 0x80);
+		value >>= 7;
+	}
+	ptr[len++] = (uint8_t)value;
+
+	return len;
+}
+
+// Returns the bytes used, 0 if the varint runs past 'end' or is longer than 5 bytes
+uint8_t delta_codec_get_varint(const uint8_t *ptr, const uint8_t *end, uint32_t *value)
+{
+	uint8_t len = 0;
+	uint32_t result = 0;
+
+	while (&ptr[len] < end && len < DELTA_CODEC_VARINT_MAX_LEN)
+	{
+		result |= (uint32_t)(ptr[len] & 0x7F) << (7 * len);
+		if ((ptr[len++] & 0x80) == 0)
+		{
+			*value = result;
+			return len;
+		}
+	}
+
+	return 0;
+}
+
+uint32_t delta_codec_zigzag(int32_t value)
+{
+	return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+int32_t delta_codec_unzigzag(uint32_t value)
+{
+	return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+}
+
+
+////////////////////////////////////////////// Stream ///////////////////////////////////////////////////////////////
+
+/** -------------------------------------------------------------------------------------------
+ * @brief sets up an encoder or decoder. The same 'channels' and 'keyframe_interval' must be
+ * used on both ends.
+ *-------------------------------------------------------------------------------------------- **/
+void delta_codec_init(delta_codec_t *codec, uint8_t channels, uint8_t keyframe_interval)
+{
+
+	memset(codec, 0, sizeof(*codec));
+	codec->channels = (channels > DELTA_CODEC_MAX_CHANNELS) ? DELTA_CODEC_MAX_CHANNELS : channels;
+	codec->keyframe_interval = keyframe_interval;
+
+}
+
+// Next sample is a keyframe (start of a block or frame)
+void delta_codec_reset(delta_codec_t *codec)
+{
+	codec->since_keyframe = 0;
+}
+
+// Uses a sample sent some other way (uncompressed) as the reference for the next delta
+void delta_codec_seed(delta_codec_t *codec, const int32_t *values)
+{
+
+	memcpy(codec->prev, values, codec->channels * sizeof(int32_t));
+	codec->since_keyframe = 1;
+
+}
+
+uint8_t delta_codec_next_is_keyframe(const delta_codec_t *codec)
+{
+	return (codec->since_keyframe == 0);
+}
+
+// Counts one sample, the one after every 'keyframe_interval' samples is a keyframe again
+static void delta_codec_advance(delta_codec_t *codec)
+{
+
+	if (codec->since_keyframe < 0xFF)
+	{
+		codec->since_keyframe++;
+	}
+	if (codec->keyframe_interval != 0 && codec->since_keyframe >= codec->keyframe_interval)
+	{
+		codec->since_keyframe = 0;
+	}
+
+}
+
+
+/** -------------------------------------------------------------------------------------------
+ * @brief encodes one sample of 'channels' values. 'out' must hold channels * 5 bytes
+ * (channels * DELTA_CODEC_INT16_MAX_LEN for int16 data).
+ *
+ * @return bytes written
+ *-------------------------------------------------------------------------------------------- **/
+uint8_t delta_codec_encode(delta_codec_t *codec, const int32_t *values, uint8_t *out)
+{
+	uint8_t keyframe = delta_codec_next_is_keyframe(codec);
+	uint8_t len = 0;
+
+	for (uint8_t i = 0; i < codec->channels; i++)
+	{
+		int32_t delta = keyframe ? values[i] : values[i] - codec->prev[i];
+		len += delta_codec_put_varint(&out[len], delta_codec_zigzag(delta));
+		codec->prev[i] = values[i];
+	}
+
+	delta_codec_advance(codec);
+
+	return len;
+}
+
+
+/** -------------------------------------------------------------------------------------------
+ * @brief decodes one sample into 'values'.
+ *
+ * @return bytes used, 0 if the input ends inside the sample (the codec is left unchanged)
+ *-------------------------------------------------------------------------------------------- **/
+uint8_t delta_codec_decode(delta_codec_t *codec, const uint8_t *ptr, const uint8_t *end, int32_t *values)
+{
+	uint8_t keyframe = delta_codec_next_is_keyframe(codec);
+	int32_t decoded[DELTA_CODEC_MAX_CHANNELS];
+	uint8_t len = 0;
+
+	for (uint8_t i = 0; i < codec->channels; i++)
+	{
+		uint32_t value;
+		uint8_t n = delta_codec_get_varint(&ptr[len], end, &value);
+
+		if (n == 0)
+		{
+			return 0;
+		}
+		len += n;
+		decoded[i] = (keyframe ? 0 : codec->prev[i]) + delta_codec_unzigzag(value);
+	}
+
+	memcpy(codec->prev, decoded, codec->channels * sizeof(int32_t));
+	memcpy(values, decoded, codec->channels * sizeof(int32_t));
+	delta_codec_advance(codec);
+
+	return len;
+}
+
+
+////////////////////////////////////////////// Benchmark ///////////////////////////////////////////////////////////////
+
+#define DELTA_BENCH_SAMPLES		(1000)		// 20 s at 50 Hz
+#define DELTA_BENCH_CHANNELS	(6)			// accel x/y/z mg, gyro x/y/z millirad/s
+#define DELTA_BENCH_KEYFRAME	(32)
+
+static uint32_t delta_bench_seed;
+
+// Uniform noise in [-amp, amp], LCG so every run sees the same trace
+static int32_t delta_bench_noise(int32_t amp)
+{
+
+	delta_bench_seed = delta_bench_seed * 1664525 + 1013904223;
+
+	return (int32_t)((delta_bench_seed >> 16) % (uint32_t)(2 * amp + 1)) - amp;
+
+}
+
+// Triangle wave in [-amp, amp] with a period of 'period' samples
+static int32_t delta_bench_wave(uint32_t n, uint32_t period, int32_t amp)
+{
+	int32_t phase = (int32_t)(n % period);
+	int32_t half = (int32_t)period / 2;
+	int32_t v = (phase < half) ? phase : (int32_t)period - phase;
+
+	return amp * (4 * v - (int32_t)period) / (int32_t)period;
+}
+
+// Seated: slow lean back and forth over 16 s plus a few counts of sensor noise
+static void delta_bench_seated(uint32_t n, int32_t *ch)
+{
+	int32_t lean = delta_bench_wave(n, 800, 60);
+
+	ch[0] = 20 + delta_bench_noise(3);
+	ch[1] = -970 + lean / 4 + delta_bench_noise(3);
+	ch[2] = 180 + lean + delta_bench_noise(3);
+	ch[3] = delta_bench_noise(6);
+	ch[4] = delta_bench_noise(6);
+	ch[5] = delta_bench_noise(6);
+}
+
+// Walking: ~2 Hz step cycle with large vertical and rotational swings
+static void delta_bench_walking(uint32_t n, int32_t *ch)
+{
+
+	ch[0] = delta_bench_wave(n, 50, 150) + delta_bench_noise(20);
+	ch[1] = -980 + delta_bench_wave(n, 25, 300) + delta_bench_noise(20);
+	ch[2] = 120 + delta_bench_wave(n + 6, 25, 120) + delta_bench_noise(20);
+	ch[3] = delta_bench_wave(n, 50, 900) + delta_bench_noise(30);
+	ch[4] = delta_bench_wave(n + 12, 50, 400) + delta_bench_noise(30);
+	ch[5] = delta_bench_wave(n + 3, 25, 600) + delta_bench_noise(30);
+
+}
+
+static void delta_bench_run(const char *name, void (*trace)(uint32_t n, int32_t *ch))
+{
+	delta_codec_t enc;
+	delta_codec_t dec;
+	uint8_t buf[DELTA_BENCH_CHANNELS * DELTA_CODEC_INT16_MAX_LEN];
+	uint32_t encoded = 0;
+	uint32_t enc_cycles = 0;
+	uint32_t dec_cycles = 0;
+	uint32_t errors = 0;
+
+	delta_bench_seed = 1;
+	delta_codec_init(&enc, DELTA_BENCH_CHANNELS, DELTA_BENCH_KEYFRAME);
+	delta_codec_init(&dec, DELTA_BENCH_CHANNELS, DELTA_BENCH_KEYFRAME);
+
+	for (uint32_t n = 0; n < DELTA_BENCH_SAMPLES; n++)
+	{
+		int32_t ch[DELTA_BENCH_CHANNELS];
+		int32_t out[DELTA_BENCH_CHANNELS];
+
+		trace(n, ch);
+
+		uint32_t start = DWT->CYCCNT;
+		uint8_t len = delta_codec_encode(&enc, ch, buf);
+		uint32_t mid = DWT->CYCCNT;
+		uint8_t used = delta_codec_decode(&dec, buf, &buf[len], out);
+		uint32_t stop = DWT->CYCCNT;
+
+		enc_cycles += mid - start;
+		dec_cycles += stop - mid;
+		encoded += len;
+
+		if (used != len || memcmp(ch, out, sizeof(ch)) != 0)
+		{
+			errors++;
+		}
+	}
+
+	uint32_t raw = DELTA_BENCH_SAMPLES * DELTA_BENCH_CHANNELS * sizeof(int16_t);
+
+	#if INCLUDE_LOGGING
+		LOG_INFO("delta_codec %s: %lu errors, %lu -> %lu bytes, ratio %lu.%02lu, %lu.%02lu bytes/sample, "
+				"encode %lu cycles/sample, decode %lu cycles/sample",
+				name, errors, raw, encoded, raw / encoded, (raw % encoded) * 100 / encoded,
+				encoded / DELTA_BENCH_SAMPLES, (encoded % DELTA_BENCH_SAMPLES) * 100 / DELTA_BENCH_SAMPLES,
+				enc_cycles / DELTA_BENCH_SAMPLES, dec_cycles / DELTA_BENCH_SAMPLES);
+	#else
+		(void)name;
+		(void)errors;
+		(void)raw;
+		(void)enc_cycles;
+		(void)dec_cycles;
+	#endif
+}
+
+
+/** -------------------------------------------------------------------------------------------
+ * @brief round-trips a synthetic seated and a walking trace (accelerometer and gyro, 50 Hz,
+ * keyframe every 32 samples as in a recorder block). Logs decode errors, compression ratio
+ * against raw int16 and the encode / decode cycles per sample. Not called during normal operation.
+ *-------------------------------------------------------------------------------------------- **/
+void delta_codec_benchmark(void)
+{
+
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+	delta_bench_run("seated", delta_bench_seated);
+	delta_bench_run("walking", delta_bench_walking);
+
+}
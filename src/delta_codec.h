@@ -0,0 +1,56 @@
+/*********************************************************************************************
+ *  @file  delta_codec.h
+ *	@brief Streaming delta codec for multi-channel IMU samples, used for the flash recorder
+ *		   blocks and the live BLE frames.
+ *
+ *		   Each channel is stored as the difference to the same channel of the previous
+ *		   sample, zigzag mapped (0, -1, 1, -2, ... -> 0, 1, 2, 3, ...) and written as a
+ *		   little endian base-128 varint. Posture changes slowly, so most deltas fit one byte
+ *		   instead of the two of a raw int16.
+ *
+ *		   A keyframe stores the channels absolute (delta to 0). The first sample after
+ *		   delta_codec_reset() is a keyframe, then one every 'keyframe_interval' samples, so a
+ *		   decoder can resynchronise after a lost block or frame. Encoder and decoder count
+ *		   samples the same way and need no flag in the stream.
+ *
+ *  @authors : Rajat Chaple (GATT client code)
+ *  		   Sundar Krishnakumar (GATT server code)
+ *
+ *  @date      April 29, 2020 (last update)
+ **********************************************************************************************/
+
+#ifndef __DELTA_CODEC_H__
+#define __DELTA_CODEC_H__
+
+#include <stdint.h>
+
+#define DELTA_CODEC_MAX_CHANNELS	(8)
+
+// Longest varint of a 32 bit value, and of a zigzag delta between two int16 values
+#define DELTA_CODEC_VARINT_MAX_LEN	(5)
+#define DELTA_CODEC_INT16_MAX_LEN	(3)
+
+typedef struct delta_codec_s
+{
+	int32_t prev[DELTA_CODEC_MAX_CHANNELS];		// last sample encoded / decoded
+	uint8_t channels;
+	uint8_t keyframe_interval;		// samples from one keyframe to the next, 0 = only after a reset
+	uint8_t since_keyframe;			// samples since the last keyframe, 0 = next one is a keyframe
+
+}delta_codec_t;
+
+void delta_codec_init(delta_codec_t *codec, uint8_t channels, uint8_t keyframe_interval);
+void delta_codec_reset(delta_codec_t *codec);
+void delta_codec_seed(delta_codec_t *codec, const int32_t *values);
+uint8_t delta_codec_next_is_keyframe(const delta_codec_t *codec);
+uint8_t delta_codec_encode(delta_codec_t *codec, const int32_t *values, uint8_t *out);
+uint8_t delta_codec_decode(delta_codec_t *codec, const uint8_t *ptr, const uint8_t *end, int32_t *values);
+
+uint8_t delta_codec_put_varint(uint8_t *ptr, uint32_t value);
+uint8_t delta_codec_get_varint(const uint8_t *ptr, const uint8_t *end, uint32_t *value);
+uint32_t delta_codec_zigzag(int32_t value);
+int32_t delta_codec_unzigzag(uint32_t value);
+
+void delta_codec_benchmark(void);
+
+#endif /* __DELTA_CODEC_H__ */
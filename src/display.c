@@ -51,6 +51,22 @@ struct display_data {
 	 * The char content of each row, null terminated
 	 */
 	char row_data[DISPLAY_ROW_NUMBER_OF_ROWS][DISPLAY_ROW_LEN+1];
+	/**
+	 * Ring buffer of the tilt samples currently plotted in the sparkline
+	 */
+	int16_t sparkline_samples[SPARKLINE_HISTORY_LEN];
+	/**
+	 * Index where the next sparkline sample is stored
+	 */
+	uint8_t sparkline_head;
+	/**
+	 * Number of valid samples in sparkline_samples
+	 */
+	uint8_t sparkline_count;
+	/**
+	 * Bytes per pixel row of the frame buffer (pixels + LCD control bytes)
+	 */
+	uint8_t bytes_per_row;
 };
 
 /**
@@ -69,6 +85,27 @@ static struct display_data *displayGetData() {
  */
 extern size_t strnlen(const char *, size_t);
 
+/**
+ * Clear only the text rows of the display, leaving the sparkline area below them untouched
+ * so the graph does not need to be redrawn every time a row changes.
+ */
+static EMSTATUS displayClearTextRegion(GLIB_Context_t *context)
+{
+	GLIB_Rectangle_t text_region = {
+		.xMin = 0,
+		.yMin = 0,
+		.xMax = context->pDisplayGeometry->xSize - 1,
+		.yMax = SPARKLINE_Y_TOP - 1
+	};
+	EMSTATUS result = GLIB_setClippingRegion(context, &text_region);
+	if( result == GLIB_OK ) {
+		result = GLIB_clearRegion(context);
+	}
+	GLIB_resetClippingRegion(context);
+	GLIB_resetDisplayClippingArea(context);
+	return result;
+}
+
 /**
  * Write the display data in the buffer represented by @param display to the device
  */
@@ -76,9 +113,9 @@ static void displayUpdateWriteBuffer(struct display_data *display)
 {
 	enum display_row row = DISPLAY_ROW_NAME;
 	GLIB_Context_t *context = &display->context;
-	EMSTATUS result = GLIB_clear(context);
+	EMSTATUS result = displayClearTextRegion(context);
 	if( result != GLIB_OK ) {
-		LOG_ERROR("GLIB_Clear failed with result %d",(int)result);
+		LOG_ERROR("displayClearTextRegion failed with result %d",(int)result);
 	} else {
 		/**
 		 * See example in graphics.c graphPrintCenter()
@@ -152,6 +189,70 @@ static void displayGlibInit(GLIB_Context_t *context)
 
 
 
+/**
+ * Map a tilt sample to a pixel row of the sparkline, larger values are drawn higher up
+ */
+static uint8_t displaySparklineRow(int16_t sample)
+{
+	int32_t value = sample;
+
+	if( value > SPARKLINE_RANGE_MG ) {
+		value = SPARKLINE_RANGE_MG;
+	} else if( value < -SPARKLINE_RANGE_MG ) {
+		value = -SPARKLINE_RANGE_MG;
+	}
+
+	return SPARKLINE_Y_TOP + (SPARKLINE_HEIGHT - 1)
+			- (((value + SPARKLINE_RANGE_MG) * (SPARKLINE_HEIGHT - 1)) / (2 * SPARKLINE_RANGE_MG));
+}
+
+/**
+ * Scroll the sparkline area of the frame buffer one pixel to the left.
+ * The frame buffer is 1 bit per pixel with pixel x stored in bit (x & 7) of byte (x >> 3),
+ * so a one pixel shift is a one bit right shift carried across the bytes of each row.
+ * Cost depends only on the graph area, not on the number of samples in the history.
+ */
+static void displaySparklineScroll(struct display_data *display)
+{
+	uint8_t *framebuffer;
+	uint8_t pixel_bytes = display->context.pDisplayGeometry->xSize >> 3;
+
+	DMD_getFrameBuffer((void **)&framebuffer);
+
+	for( uint8_t y = SPARKLINE_Y_TOP; y < (SPARKLINE_Y_TOP + SPARKLINE_HEIGHT); y++ ) {
+		uint8_t *row = framebuffer + (y * display->bytes_per_row);
+		for( uint8_t i = 0; i < (pixel_bytes - 1); i++ ) {
+			row[i] = (row[i] >> 1) | (row[i + 1] << 7);
+		}
+		row[pixel_bytes - 1] >>= 1;
+	}
+}
+
+/**
+ * Draw the right-most sparkline column, joining the previous sample to the new one.
+ * Clearing the column through GLIB also marks every graph row dirty, so the rows
+ * shifted by displaySparklineScroll() are sent by the next DMD_updateDisplay().
+ */
+static void displaySparklineDrawColumn(struct display_data *display, int16_t previous, int16_t sample)
+{
+	GLIB_Context_t *context = &display->context;
+	int32_t x = context->pDisplayGeometry->xSize - 1;
+	uint32_t foreground = context->foregroundColor;
+	EMSTATUS result;
+
+	context->foregroundColor = context->backgroundColor;
+	result = GLIB_drawLineV(context, x, SPARKLINE_Y_TOP, SPARKLINE_Y_TOP + SPARKLINE_HEIGHT - 1);
+	context->foregroundColor = foreground;
+	if( result != GLIB_OK ) {
+		LOG_ERROR("GLIB_drawLineV failed to clear sparkline column with result %d",(int)result);
+	}
+
+	result = GLIB_drawLineV(context, x, displaySparklineRow(previous), displaySparklineRow(sample));
+	if( result != GLIB_OK ) {
+		LOG_ERROR("GLIB_drawLineV failed to draw sparkline sample with result %d",(int)result);
+	}
+}
+
 // ****************************************************************
 // The following routines are the public functions
 // ****************************************************************
@@ -187,6 +288,42 @@ void displayPrintf(enum display_row row, const char *format, ... )
 } // displayPrintf()
 
 
+/**
+ * Append a tilt sample to the sparkline. Only the graph rows are scrolled by one pixel and
+ * the new column is drawn, so the cost per sample is constant regardless of history length.
+ * @param sample tilt value in milli-g as received in the axis orientation indication
+ */
+void displaySparklineAddSample(int16_t sample)
+{
+	struct display_data *display = displayGetData();
+	int16_t previous = sample;
+	EMSTATUS result;
+
+	if( display->bytes_per_row == 0 ) {
+		return;	// frame buffer layout unknown, see displayInit()
+	}
+
+	if( display->sparkline_count > 0 ) {
+		previous = display->sparkline_samples[(display->sparkline_head + SPARKLINE_HISTORY_LEN - 1) % SPARKLINE_HISTORY_LEN];
+	}
+
+	display->sparkline_samples[display->sparkline_head] = sample;
+	display->sparkline_head = (display->sparkline_head + 1) % SPARKLINE_HISTORY_LEN;
+	if( display->sparkline_count < SPARKLINE_HISTORY_LEN ) {
+		display->sparkline_count++;
+	}
+
+	displaySparklineScroll(display);
+	displaySparklineDrawColumn(display, previous, sample);
+
+	result = DMD_updateDisplay();
+	if( result != DMD_OK ) {
+		LOG_ERROR("DMD_updateDisplay failed with result %d",(int)result);
+	}
+
+} // displaySparklineAddSample()
+
+
 
 
 /**
@@ -214,6 +351,16 @@ void displayInit()
 
 	displayGlibInit(&display->context);
 
+	DISPLAY_Device_t display_device;
+	if( DISPLAY_DeviceGet(0, &display_device) != DISPLAY_EMSTATUS_OK ) {
+		LOG_ERROR("Failed to get display device, sparkline disabled");
+	} else {
+		display->bytes_per_row = display_device.geometry.stride >> 3;
+	}
+
+	// start from a blank screen, afterwards only the text rows are cleared on update
+	GLIB_clear(&display->context);
+
 	// clear each row of the display
 	for( row = DISPLAY_ROW_NAME; row < DISPLAY_ROW_MAX; row++ ) {
 		displayPrintf(row,"%s"," ");
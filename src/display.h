@@ -73,15 +73,26 @@ enum display_row {
 	DISPLAY_ROW_MAX,
 };
 
+/**
+ * Tilt history graph (sparkline) drawn below the text rows.
+ * One column per received tilt sample, newest sample on the right.
+ */
+#define SPARKLINE_Y_TOP				(86)	//first pixel row below DISPLAY_ROW_INACTIVITY
+#define SPARKLINE_HEIGHT			(40)	//pixel rows used by the graph
+#define SPARKLINE_HISTORY_LEN		(128)	//one sample per pixel column of the LCD
+#define SPARKLINE_RANGE_MG			(1000)	//samples are clamped to +/- this value
+
 // function prototypes
 #if ECEN5823_INCLUDE_DISPLAY_SUPPORT
 void displayInit();
 void displayUpdate();
 void displayPrintf(enum display_row row, const char *format, ... );
+void displaySparklineAddSample(int16_t sample);
 #else
 static inline void displayInit() { }
 static inline void displayUpdate() { return true; }
 static inline void displayPrintf(enum display_row row, const char *format, ... ) { row=row; format=format;}
+static inline void displaySparklineAddSample(int16_t sample) { sample=sample; }
 #endif
 
 
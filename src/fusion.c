@@ -0,0 +1,357 @@
+/*********************************************************************************************
+ *  @file fusion.c
+ *	@brief Fixed-point orientation filter. The gyroscope rate is integrated into a Q30
+ *		   quaternion and corrected towards the gravity direction measured by the
+ *		   accelerometer (proportional term of the Mahony filter). No floating point is
+ *		   used, all intermediate products are done in 64-bit integers.
+ *
+ *		   Q formats:  quaternion Q30, angular rate and half angles Q20 rad(/s),
+ *		               normalized accelerometer Q15, angles out in centidegrees.
+ *
+ *  @authors : Sundar Krishnakumar (GATT server code)
+ *
+ *
+ *  @date      April 29, 2020 (last update)
+ *
+ **********************************************************************************************/
+#include "ble_device_type.h"
+#if BUILD_INCLUDES_BLE_CLIENT
+
+#else
+
+#include <string.h>
+#include "fusion.h"
+#include "cordic.h"
+#include "infrastructure.h"
+#include "log.h"
+
+
+fusion_state_typedef fusion_state;
+
+
+static inline int32_t fusion_mul_q30(int32_t a, int32_t b)
+{
+	return (int32_t)(((int64_t)a * b) >> 30);
+}
+
+static uint32_t fusion_isqrt64(uint64_t value)
+{
+	uint64_t result = 0;
+	uint64_t bit = (uint64_t)1 << 62;
+
+	while (bit > value)
+	{
+		bit >>= 2;
+	}
+
+	while (bit != 0)
+	{
+		if (value >= result + bit)
+		{
+			value -= result + bit;
+			result = (result >> 1) + bit;
+		}
+		else
+		{
+			result >>= 1;
+		}
+		bit >>= 2;
+	}
+
+	return (uint32_t)result;
+}
+
+
+// Scale a quaternion that may have drifted off unit length back to |q| = 1.
+// Inputs are Q30 in 64-bit containers; they are reduced to Q28 for the squared
+// norm so the sum of squares fits in 64 bits.
+static void fusion_normalize(int64_t w, int64_t x, int64_t y, int64_t z)
+{
+	int64_t a = w >> 2;
+	int64_t b = x >> 2;
+	int64_t c = y >> 2;
+	int64_t d = z >> 2;
+	uint32_t norm = fusion_isqrt64((uint64_t)(a * a + b * b + c * c + d * d)); // Q28
+
+	if (norm == 0)
+	{
+		fusion_reset();
+		return;
+	}
+
+	int64_t inv = ((int64_t)1 << 58) / norm; // Q30
+
+	fusion_state.q.w = (int32_t)((a * inv) >> 28);
+	fusion_state.q.x = (int32_t)((b * inv) >> 28);
+	fusion_state.q.y = (int32_t)((c * inv) >> 28);
+	fusion_state.q.z = (int32_t)((d * inv) >> 28);
+}
+
+
+// Shortest rotation taking earth Z onto the measured gravity vector (Q15 unit vector).
+// Used once on the first sample so the filter does not have to converge from identity.
+static void fusion_init_from_accel(int32_t ax, int32_t ay, int32_t az)
+{
+	int64_t w = (int64_t)FUSION_Q30_ONE + (int64_t)az * 32768;
+
+	if (w < (FUSION_Q30_ONE >> 10))
+	{
+		// Upside down, rotate half a turn about X
+		fusion_normalize(0, FUSION_Q30_ONE, 0, 0);
+		return;
+	}
+
+	fusion_normalize(w, (int64_t)ay * 32768, -(int64_t)ax * 32768, 0);
+}
+
+
+static void fusion_update_angles(void)
+{
+	const fusion_quat_typedef *q = &fusion_state.q;
+
+	// Sums of products in 64 bits, x*x + y*y reaches Q30 one upside down
+	int64_t sinp = 2 * ((int64_t)fusion_mul_q30(q->w, q->y) - fusion_mul_q30(q->z, q->x));
+	if (sinp > FUSION_Q30_ONE)
+	{
+		sinp = FUSION_Q30_ONE;
+	}
+	if (sinp < -FUSION_Q30_ONE)
+	{
+		sinp = -FUSION_Q30_ONE;
+	}
+	int32_t cosp = (int32_t)fusion_isqrt64(((uint64_t)1 << 60) - (uint64_t)(sinp * sinp));
+
+	int32_t roll_num = (int32_t)(2 * ((int64_t)fusion_mul_q30(q->w, q->x) + fusion_mul_q30(q->y, q->z)));
+	int32_t roll_den = (int32_t)(FUSION_Q30_ONE - 2 * ((int64_t)fusion_mul_q30(q->x, q->x) + fusion_mul_q30(q->y, q->y)));
+
+	fusion_state.pitch_cdeg = cordic_atan2_cdeg((int32_t)sinp, cosp);
+	fusion_state.roll_cdeg = cordic_atan2_cdeg(roll_num, roll_den);
+}
+
+
+void fusion_reset(void)
+{
+
+	memset(&fusion_state.q, 0, sizeof(fusion_state.q));
+	fusion_state.q.w = FUSION_Q30_ONE;
+	fusion_state.pitch_cdeg = 0;
+	fusion_state.roll_cdeg = 0;
+	fusion_state.initialized = 0;
+
+}
+
+
+void fusion_init(void)
+{
+
+	// DWT cycle counter is used to report the cost of each update
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+	fusion_state.update_cycles = 0;
+	fusion_state.update_cycles_max = 0;
+	fusion_reset();
+
+}
+
+
+// accel in milli-g, gyro in millirad/s, dt_ms time since the previous update
+void fusion_update(const accel_data_typedef *accel, const gyro_data_typedef *gyro, uint32_t dt_ms)
+{
+	uint32_t start = DWT->CYCCNT;
+	const fusion_quat_typedef *q = &fusion_state.q;
+
+	int32_t ax = accel->x;
+	int32_t ay = accel->y;
+	int32_t az = accel->z;
+	uint32_t accel_mag = fusion_isqrt64((uint64_t)(ax * ax + ay * ay + az * az));
+	uint8_t accel_valid = (accel_mag > FUSION_ACCEL_MIN_MG) && (accel_mag < FUSION_ACCEL_MAX_MG);
+
+	if (accel_valid)
+	{
+		// Q15 unit vector
+		ax = ax * 32768 / (int32_t)accel_mag;
+		ay = ay * 32768 / (int32_t)accel_mag;
+		az = az * 32768 / (int32_t)accel_mag;
+	}
+
+	if (fusion_state.initialized == 0)
+	{
+		if (accel_valid)
+		{
+			fusion_init_from_accel(ax, ay, az);
+			fusion_update_angles();
+			fusion_state.initialized = 1;
+		}
+		return;
+	}
+
+	if (dt_ms == 0)
+	{
+		return;
+	}
+
+	// millirad/s to Q20 rad/s (2^30 / 1000 = 1073741.8)
+	int64_t gx = ((int64_t)gyro->x * 1073742) >> 10;
+	int64_t gy = ((int64_t)gyro->y * 1073742) >> 10;
+	int64_t gz = ((int64_t)gyro->z * 1073742) >> 10;
+
+	if (accel_valid)
+	{
+		// Gravity direction predicted by the current orientation, Q30
+		int32_t vx = 2 * (fusion_mul_q30(q->x, q->z) - fusion_mul_q30(q->w, q->y));
+		int32_t vy = 2 * (fusion_mul_q30(q->w, q->x) + fusion_mul_q30(q->y, q->z));
+		int32_t vz = fusion_mul_q30(q->w, q->w) - fusion_mul_q30(q->x, q->x)
+				   - fusion_mul_q30(q->y, q->y) + fusion_mul_q30(q->z, q->z);
+
+		// Error = measured x predicted, Q15 * Q30 = Q45 -> Q20
+		int64_t ex = ((int64_t)ay * vz - (int64_t)az * vy) >> 25;
+		int64_t ey = ((int64_t)az * vx - (int64_t)ax * vz) >> 25;
+		int64_t ez = ((int64_t)ax * vy - (int64_t)ay * vx) >> 25;
+
+		// Limit the blend per update (kp * dt) for long sample periods
+		int64_t kp = FUSION_KP_Q16;
+		int64_t kp_max = ((int64_t)FUSION_MAX_BLEND_PERMILLE << 16) / dt_ms;
+		if (kp > kp_max)
+		{
+			kp = kp_max;
+		}
+
+		gx += (ex * kp) >> 16;
+		gy += (ey * kp) >> 16;
+		gz += (ez * kp) >> 16;
+	}
+
+	// Half rotation over dt, Q20 rad
+	int64_t hx = (gx * (int64_t)dt_ms) / 2000;
+	int64_t hy = (gy * (int64_t)dt_ms) / 2000;
+	int64_t hz = (gz * (int64_t)dt_ms) / 2000;
+
+	hx = (hx > FUSION_MAX_HALF_ANGLE_Q20) ? FUSION_MAX_HALF_ANGLE_Q20 : ((hx < -FUSION_MAX_HALF_ANGLE_Q20) ? -FUSION_MAX_HALF_ANGLE_Q20 : hx);
+	hy = (hy > FUSION_MAX_HALF_ANGLE_Q20) ? FUSION_MAX_HALF_ANGLE_Q20 : ((hy < -FUSION_MAX_HALF_ANGLE_Q20) ? -FUSION_MAX_HALF_ANGLE_Q20 : hy);
+	hz = (hz > FUSION_MAX_HALF_ANGLE_Q20) ? FUSION_MAX_HALF_ANGLE_Q20 : ((hz < -FUSION_MAX_HALF_ANGLE_Q20) ? -FUSION_MAX_HALF_ANGLE_Q20 : hz);
+
+	// q += q (x) (0, h), Q30 * Q20 >> 20 = Q30
+	int64_t w = q->w + ((-(int64_t)q->x * hx - (int64_t)q->y * hy - (int64_t)q->z * hz) >> 20);
+	int64_t x = q->x + (( (int64_t)q->w * hx + (int64_t)q->y * hz - (int64_t)q->z * hy) >> 20);
+	int64_t y = q->y + (( (int64_t)q->w * hy - (int64_t)q->x * hz + (int64_t)q->z * hx) >> 20);
+	int64_t z = q->z + (( (int64_t)q->w * hz + (int64_t)q->x * hy - (int64_t)q->y * hx) >> 20);
+
+	fusion_normalize(w, x, y, z);
+	fusion_update_angles();
+
+	fusion_state.update_cycles = DWT->CYCCNT - start;
+	if (fusion_state.update_cycles > fusion_state.update_cycles_max)
+	{
+		fusion_state.update_cycles_max = fusion_state.update_cycles;
+	}
+
+}
+
+
+// Orientation as sent in the axis orientation characteristic after the tilt value:
+// pitch, roll (centidegrees) and quaternion w, x, y, z (Q14), all int16 little endian.
+uint8_t fusion_orientation_payload(uint8_t *buf)
+{
+	uint8_t *ptr = buf;
+
+	UINT16_TO_BITSTREAM(ptr, (uint16_t)fusion_state.pitch_cdeg);
+	UINT16_TO_BITSTREAM(ptr, (uint16_t)fusion_state.roll_cdeg);
+	UINT16_TO_BITSTREAM(ptr, (uint16_t)(fusion_state.q.w >> 16));
+	UINT16_TO_BITSTREAM(ptr, (uint16_t)(fusion_state.q.x >> 16));
+	UINT16_TO_BITSTREAM(ptr, (uint16_t)(fusion_state.q.y >> 16));
+	UINT16_TO_BITSTREAM(ptr, (uint16_t)(fusion_state.q.z >> 16));
+
+	return FUSION_PAYLOAD_LEN;
+}
+
+
+#if FUSION_SELF_TEST
+
+#if INCLUDE_LOGGING
+#include <math.h>
+#endif
+
+// Wrapped difference of two angles in centidegrees
+static int32_t fusion_angle_error_cdeg(int32_t a, int32_t b)
+{
+	int32_t e = (a - b) % 36000;
+
+	e = (e > 18000) ? e - 36000 : ((e < -18000) ? e + 36000 : e);
+	return (e < 0) ? -e : e;
+}
+
+/** -------------------------------------------------------------------------------------------
+ * @brief runs the filter on synthetic traces and logs the worst angle errors: static gravity
+ * over a pitch/roll grid (including upside down), and a gyro only rotation about X and Y from
+ * level. Resets the filter, not called during normal operation.
+ *-------------------------------------------------------------------------------------------- **/
+void fusion_self_test(void)
+{
+#if INCLUDE_LOGGING
+	accel_data_typedef accel;
+	gyro_data_typedef gyro = { 0, 0, 0 };
+	int32_t static_error = 0;
+	int32_t gyro_error = 0;
+
+	fusion_init();
+
+	// Gravity in the sensor frame is (-sin p, sin r cos p, cos r cos p)
+	for (int32_t pitch = -75; pitch <= 75; pitch += 15)
+	{
+		for (int32_t roll = -180; roll <= 180; roll += 15)
+		{
+			double p = pitch * M_PI / 180.0;
+			double r = roll * M_PI / 180.0;
+
+			accel.x = (int16_t)lround(-1000.0 * sin(p));
+			accel.y = (int16_t)lround(1000.0 * sin(r) * cos(p));
+			accel.z = (int16_t)lround(1000.0 * cos(r) * cos(p));
+
+			fusion_reset();
+			for (uint8_t i = 0; i < 10; i++)
+			{
+				fusion_update(&accel, &gyro, 100);
+			}
+
+			int32_t e = fusion_angle_error_cdeg(fusion_state.pitch_cdeg, pitch * 100);
+			static_error = (e > static_error) ? e : static_error;
+			e = fusion_angle_error_cdeg(fusion_state.roll_cdeg, roll * 100);
+			static_error = (e > static_error) ? e : static_error;
+		}
+	}
+
+	// 0.5 rad/s for 1 s in 10 ms steps, the accelerometer reads 0 g so only the gyro is used
+	for (uint8_t axis = 0; axis < 2; axis++)
+	{
+		accel.x = 0;
+		accel.y = 0;
+		accel.z = 1000;
+		fusion_reset();
+		fusion_update(&accel, &gyro, 10);
+
+		accel.z = 0;
+		gyro.x = (axis == 0) ? 500 : 0;
+		gyro.y = (axis == 1) ? 500 : 0;
+		for (uint8_t i = 0; i < 100; i++)
+		{
+			fusion_update(&accel, &gyro, 10);
+		}
+
+		int32_t expected = (int32_t)lround(0.5 * 18000.0 / M_PI);
+		int32_t e = fusion_angle_error_cdeg((axis == 0) ? fusion_state.roll_cdeg : fusion_state.pitch_cdeg, expected);
+		gyro_error = (e > gyro_error) ? e : gyro_error;
+		e = fusion_angle_error_cdeg((axis == 0) ? fusion_state.pitch_cdeg : fusion_state.roll_cdeg, 0);
+		gyro_error = (e > gyro_error) ? e : gyro_error;
+	}
+
+	LOG_INFO("fusion: max static error %ld cdeg, max gyro only error %ld cdeg, %lu cycles per update max",
+			static_error, gyro_error, fusion_state.update_cycles_max);
+
+	fusion_init();
+#endif
+}
+
+#endif
+
+#endif
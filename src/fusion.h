@@ -0,0 +1,82 @@
+/*********************************************************************************************
+ *  @file  fusion.h
+ *	@brief Fixed-point accelerometer + gyroscope orientation filter (complementary / Mahony
+ *		   style) producing a quaternion and pitch/roll angles.
+ *
+ *  @authors : Sundar Krishnakumar (GATT server code)
+ *
+ *
+ *  @date      April 29, 2020 (last update)
+ *
+ *  @reference R. Mahony, T. Hamel, J-M. Pflimlin, "Nonlinear Complementary Filters on the
+ *             Special Orthogonal Group", IEEE TAC 2008.
+ *
+ **********************************************************************************************/
+#include "ble_device_type.h"
+#if BUILD_INCLUDES_BLE_CLIENT
+
+#else
+
+#ifndef __FUSION_H__
+#define __FUSION_H__
+
+#include <stdint.h>
+#include "imu.h"
+
+#define FUSION_Q30_ONE			(1 << 30)
+#define FUSION_Q20_ONE			(1 << 20)
+
+// Proportional gain pulling the gyro integration towards the accelerometer, Q16 (0.5 /s).
+// The effective gain is limited to FUSION_MAX_BLEND per update for long sample periods.
+#define FUSION_KP_Q16			(32768)
+#define FUSION_MAX_BLEND_PERMILLE	(500)
+
+// Largest half rotation angle integrated in a single update, Q20 radians
+#define FUSION_MAX_HALF_ANGLE_Q20	(FUSION_Q20_ONE)
+
+// Accelerometer magnitude accepted as gravity, milli-g. Outside this band only the gyro is used.
+#define FUSION_ACCEL_MIN_MG		(500)
+#define FUSION_ACCEL_MAX_MG		(1500)
+
+// 1: builds fusion_self_test(), which links libm for the reference angles
+#ifndef FUSION_SELF_TEST
+#define FUSION_SELF_TEST		(0)
+#endif
+
+// Unit quaternion, Q30. Rotation from sensor (body) frame to earth frame.
+typedef struct
+{
+	int32_t w;
+	int32_t x;
+	int32_t y;
+	int32_t z;
+
+}fusion_quat_typedef;
+
+typedef struct
+{
+	fusion_quat_typedef q;
+	int16_t pitch_cdeg;			// rotation about Y, centidegrees
+	int16_t roll_cdeg;			// rotation about X, centidegrees
+	uint8_t initialized;		// 0 until the first valid accelerometer sample
+	uint32_t update_cycles;		// DWT cycles taken by the last fusion_update()
+	uint32_t update_cycles_max;
+
+}fusion_state_typedef;
+
+extern fusion_state_typedef fusion_state;
+
+void fusion_init(void);
+void fusion_reset(void);
+void fusion_update(const accel_data_typedef *accel, const gyro_data_typedef *gyro, uint32_t dt_ms);
+uint8_t fusion_orientation_payload(uint8_t *buf);
+#if FUSION_SELF_TEST
+void fusion_self_test(void);
+#endif
+
+// Size of the payload written by fusion_orientation_payload()
+#define FUSION_PAYLOAD_LEN		(12)
+
+#endif /* __FUSION_H__ */
+
+#endif
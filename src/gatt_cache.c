@@ -0,0 +1,180 @@
+/*********************************************************************************************
+ *  @file gatt_cache.c
+ *	@brief Per-server GATT handle cache in the persistent store, see gatt_cache.h.
+ *
+ *  @authors : Rajat Chaple (GATT client code)
+ *
+ *
+ *  @date      April 29, 2020 (last update)
+ *
+ **********************************************************************************************/
+#include "ble_device_type.h"
+#if BUILD_INCLUDES_BLE_CLIENT
+
+#include <string.h>
+#include "gatt_cache.h"
+#include "crc16.h"
+#include "native_gecko.h"
+#include "infrastructure.h"
+#include "log.h"
+
+
+static void gatt_cache_serialize(const gatt_cache_record_t *record, uint8_t *buf)
+{
+	uint8_t *ptr = buf;
+
+	UINT8_TO_BITSTREAM(ptr, GATT_CACHE_VERSION);
+	UINT16_TO_BITSTREAM(ptr, record->seq);
+	memcpy(ptr, record->address.addr, sizeof(record->address.addr));
+	ptr += sizeof(record->address.addr);
+	memcpy(ptr, record->database_hash, DATABASE_HASH_LEN);
+	ptr += DATABASE_HASH_LEN;
+	for (uint8_t i = 0; i < SERVICE_COUNT; i++)
+	{
+		UINT32_TO_BITSTREAM(ptr, record->service[i]);
+	}
+	for (uint8_t i = 0; i < CHARACTERISTIC_COUNT; i++)
+	{
+		UINT16_TO_BITSTREAM(ptr, record->characteristic[i]);
+	}
+
+	uint16_t crc = crc16_update(CRC16_INIT, buf, (uint32_t)(ptr - buf));
+	UINT16_TO_BITSTREAM(ptr, crc);
+}
+
+// Returns true and fills record if buf holds a record of the current version
+static bool gatt_cache_deserialize(const uint8_t *buf, uint8_t len, gatt_cache_record_t *record)
+{
+	const uint8_t *ptr = buf;
+
+	if (len != GATT_CACHE_RECORD_LEN || buf[0] != GATT_CACHE_VERSION)
+	{
+		return false;
+	}
+
+	uint16_t crc = crc16_update(CRC16_INIT, buf, GATT_CACHE_RECORD_LEN - 2);
+	if (crc != BYTES_TO_UINT16(buf[GATT_CACHE_RECORD_LEN - 2], buf[GATT_CACHE_RECORD_LEN - 1]))
+	{
+		return false;
+	}
+
+	ptr++;
+	record->seq = BYTES_TO_UINT16(ptr[0], ptr[1]);
+	ptr += 2;
+	memcpy(record->address.addr, ptr, sizeof(record->address.addr));
+	ptr += sizeof(record->address.addr);
+	memcpy(record->database_hash, ptr, DATABASE_HASH_LEN);
+	ptr += DATABASE_HASH_LEN;
+	for (uint8_t i = 0; i < SERVICE_COUNT; i++)
+	{
+		record->service[i] = BYTES_TO_UINT32(ptr[0], ptr[1], ptr[2], ptr[3]);
+		ptr += 4;
+	}
+	for (uint8_t i = 0; i < CHARACTERISTIC_COUNT; i++)
+	{
+		record->characteristic[i] = BYTES_TO_UINT16(ptr[0], ptr[1]);
+		ptr += 2;
+	}
+
+	return true;
+}
+
+// Record stored under slot, false if the key is empty or invalid
+static bool gatt_cache_load(uint8_t slot, gatt_cache_record_t *record)
+{
+	struct gecko_msg_flash_ps_load_rsp_t *ret = gecko_cmd_flash_ps_load(GATT_CACHE_PS_KEY + slot);
+
+	if (ret->result != 0)
+	{
+		// Nothing stored under this key yet is reported as an error too
+		return false;
+	}
+
+	return gatt_cache_deserialize(ret->value.data, ret->value.len, record);
+}
+
+
+/** -------------------------------------------------------------------------------------------
+ * @brief looks up the handles stored for a server
+ *
+ * @return true if a record was found for address
+ *-------------------------------------------------------------------------------------------- **/
+bool gatt_cache_lookup(bd_addr address, gatt_cache_record_t *record)
+{
+
+	for (uint8_t slot = 0; slot < GATT_CACHE_PEERS; slot++)
+	{
+		if (gatt_cache_load(slot, record) && memcmp(record->address.addr, address.addr, sizeof(address.addr)) == 0)
+		{
+			return true;
+		}
+	}
+
+	return false;
+
+}
+
+
+/** -------------------------------------------------------------------------------------------
+ * @brief stores the handles of a server: over its old record, else in an empty slot, else over
+ * the least recently stored record. Sets record->seq.
+ *-------------------------------------------------------------------------------------------- **/
+void gatt_cache_store(gatt_cache_record_t *record)
+{
+	gatt_cache_record_t stored;
+	uint8_t buf[GATT_CACHE_RECORD_LEN];
+	uint8_t slot = GATT_CACHE_PEERS;
+	uint8_t empty = GATT_CACHE_PEERS;
+	uint8_t oldest = 0;
+	uint16_t oldest_seq = 0;
+	uint16_t newest_seq = 0;
+	bool any = false;
+
+	for (uint8_t i = 0; i < GATT_CACHE_PEERS; i++)
+	{
+		if (gatt_cache_load(i, &stored) == false)
+		{
+			if (empty == GATT_CACHE_PEERS)
+			{
+				empty = i;
+			}
+			continue;
+		}
+
+		if (memcmp(stored.address.addr, record->address.addr, sizeof(stored.address.addr)) == 0)
+		{
+			slot = i;
+		}
+		if (any == false || (int16_t)(stored.seq - oldest_seq) < 0)
+		{
+			oldest = i;
+			oldest_seq = stored.seq;
+		}
+		if (any == false || (int16_t)(stored.seq - newest_seq) > 0)
+		{
+			newest_seq = stored.seq;
+		}
+		any = true;
+	}
+
+	if (slot == GATT_CACHE_PEERS)
+	{
+		slot = (empty != GATT_CACHE_PEERS) ? empty : oldest;
+	}
+
+	record->seq = any ? (uint16_t)(newest_seq + 1) : 0;
+	gatt_cache_serialize(record, buf);
+
+	struct gecko_msg_flash_ps_save_rsp_t *ret = gecko_cmd_flash_ps_save(GATT_CACHE_PS_KEY + slot, GATT_CACHE_RECORD_LEN, buf);
+	if (ret->result != 0)
+	{
+		#if INCLUDE_LOGGING
+			LOG_ERROR("ERROR: %d | response code from gecko_cmd_flash_ps_save()", ret->result);
+		#endif
+	}
+
+}
+
+#else
+
+#endif
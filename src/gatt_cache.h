@@ -0,0 +1,56 @@
+/*********************************************************************************************
+ *  @file  gatt_cache.h
+ *	@brief Handles discovered on a bonded server, kept in the persistent store so a reconnect
+ *		   does not run the GATT discovery again.
+ *
+ *		   One record per server address, up to GATT_CACHE_PEERS (as many as the stack keeps
+ *		   bonds for), the least recently stored one is replaced. A record carries the
+ *		   server's Database hash (0x2B2A): on reconnect the client reads the hash at the
+ *		   cached handle and uses the other handles only if it is unchanged, otherwise it
+ *		   discovers again and stores a new record.
+ *
+ *		   Record (little endian): version, seq (uint16), address (6), database hash (16),
+ *		   SERVICE_COUNT x service handle (uint32), CHARACTERISTIC_COUNT x characteristic
+ *		   handle (uint16), crc16
+ *
+ *  @authors : Rajat Chaple (GATT client code)
+ *
+ *
+ *  @date      April 29, 2020 (last update)
+ *
+ **********************************************************************************************/
+#include "ble_device_type.h"
+#if BUILD_INCLUDES_BLE_CLIENT
+
+#ifndef __GATT_CACHE_H__
+#define __GATT_CACHE_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "ble.h"
+
+// PS keys 0x4000 - 0x407F are reserved for the application, one key per peer
+#define GATT_CACHE_PS_KEY			(0x4010)
+#define GATT_CACHE_PEERS			(BOND_MAX_PEERS)
+
+#define GATT_CACHE_VERSION			(1)
+#define GATT_CACHE_RECORD_LEN		(1 + 2 + 6 + DATABASE_HASH_LEN + SERVICE_COUNT * 4 + CHARACTERISTIC_COUNT * 2 + 2)
+
+typedef struct gatt_cache_record_s
+{
+	uint16_t seq;								// store order, the lowest is replaced first
+	bd_addr address;
+	uint8_t database_hash[DATABASE_HASH_LEN];
+	uint32_t service[SERVICE_COUNT];
+	uint16_t characteristic[CHARACTERISTIC_COUNT];
+
+}gatt_cache_record_t;
+
+bool gatt_cache_lookup(bd_addr address, gatt_cache_record_t *record);
+void gatt_cache_store(gatt_cache_record_t *record);
+
+#endif /* __GATT_CACHE_H__ */
+
+#else
+
+#endif
@@ -0,0 +1,287 @@
+/*********************************************************************************************
+ *  @file gatt_queue.c
+ *	@brief Outbound GATT queue of the server, see gatt_queue.h.
+ *
+ *  @authors : Sundar Krishnakumar (GATT server code)
+ *
+ *
+ *  @date      April 29, 2020 (last update)
+ *
+ **********************************************************************************************/
+#include "ble_device_type.h"
+#if BUILD_INCLUDES_BLE_CLIENT
+
+#else
+
+#include <string.h>
+#include "gatt_queue.h"
+#include "native_gecko.h"
+#include "link_phy.h"
+#include "history.h"
+#include "log.h"
+
+
+gatt_queue_typedef gatt_queue;
+
+
+// Single shot, 0 stops it
+static void gatt_queue_timer_set(uint32_t ticks)
+{
+	struct gecko_msg_hardware_set_soft_timer_rsp_t *ret = gecko_cmd_hardware_set_soft_timer(ticks, GATT_QUEUE_TIMER_HANDLE, 1);
+	if (ret->result != 0)
+	{
+		#if INCLUDE_LOGGING
+			LOG_ERROR("ERROR: %d | response code from gecko_cmd_hardware_set_soft_timer()", ret->result);
+		#endif
+	}
+}
+
+
+static gatt_queue_entry_typedef *gatt_queue_find(uint16_t characteristic)
+{
+	gatt_queue_entry_typedef *free_entry = NULL;
+
+	for (uint8_t i = 0; i < GATT_QUEUE_ENTRIES; i++)
+	{
+		if (gatt_queue.entry[i].characteristic == characteristic)
+		{
+			return &gatt_queue.entry[i];
+		}
+		if (gatt_queue.entry[i].characteristic == 0 && free_entry == NULL)
+		{
+			free_entry = &gatt_queue.entry[i];
+		}
+	}
+
+	if (free_entry != NULL)
+	{
+		free_entry->characteristic = characteristic;
+	}
+
+	return free_entry;
+}
+
+// Next entry to send: highest priority, oldest request. Indications wait while one is in flight.
+static gatt_queue_entry_typedef *gatt_queue_next(void)
+{
+	gatt_queue_entry_typedef *next = NULL;
+
+	for (uint8_t i = 0; i < GATT_QUEUE_ENTRIES; i++)
+	{
+		gatt_queue_entry_typedef *e = &gatt_queue.entry[i];
+
+		if (e->pending == 0 || (e->indicate && gatt_queue.in_flight))
+		{
+			continue;
+		}
+		if (next == NULL || e->priority < next->priority || (e->priority == next->priority && (int32_t)(e->order - next->order) < 0))
+		{
+			next = e;
+		}
+	}
+
+	return next;
+}
+
+
+/** -------------------------------------------------------------------------------------------
+ * @brief clears the queue for a new connection. The counters cover one connection, they
+ * are logged when it closes.
+ *-------------------------------------------------------------------------------------------- **/
+void gatt_queue_connection_opened(uint8_t connection)
+{
+
+	memset(&gatt_queue, 0, sizeof(gatt_queue));
+	gatt_queue.connection = connection;
+
+}
+
+// Requests still pending are lost with the link
+void gatt_queue_connection_closed(void)
+{
+
+	for (uint8_t i = 0; i < GATT_QUEUE_ENTRIES; i++)
+	{
+		if (gatt_queue.entry[i].pending)
+		{
+			gatt_queue.entry[i].pending = 0;
+			gatt_queue.entry[i].dropped++;
+		}
+	}
+
+	if (gatt_queue.held_len != 0)
+	{
+		gatt_queue.entry[gatt_queue.held_entry].dropped++;
+		gatt_queue.held_len = 0;
+		gatt_queue_timer_set(0);
+	}
+
+	gatt_queue_log_stats();
+	gatt_queue.in_flight = 0;
+
+}
+
+
+/** -------------------------------------------------------------------------------------------
+ * @brief asks for the characteristic to be sent, now if the link is free, otherwise as soon
+ * as it is. A request for a characteristic that is already pending is merged into it; 'fill'
+ * builds the newest value when it goes out.
+ *
+ * @param indicate : 1 if the client has enabled indications (wait for the confirmation)
+ *-------------------------------------------------------------------------------------------- **/
+void gatt_queue_request(uint16_t characteristic, gatt_queue_priority_typedef priority, uint8_t indicate,
+		gatt_queue_fill_typedef fill)
+{
+	gatt_queue_entry_typedef *e = gatt_queue_find(characteristic);
+
+	if (e == NULL)
+	{
+		gatt_queue.full++;
+		#if INCLUDE_LOGGING
+			LOG_ERROR("ERROR: GATT queue full, characteristic %d not sent", characteristic);
+		#endif
+		return;
+	}
+
+	e->requests++;
+	e->priority = priority;
+	e->indicate = indicate;
+	e->fill = fill;
+
+	if (e->pending)
+	{
+		e->coalesced++;
+	}
+	else
+	{
+		e->pending = 1;
+		e->order = gatt_queue.next_order++;
+	}
+
+	gatt_queue_service();
+}
+
+// gecko_evt_gatt_server_characteristic_status_id with gatt_server_confirmation
+void gatt_queue_indication_confirmed(uint16_t characteristic)
+{
+
+	if (gatt_queue.in_flight && gatt_queue.in_flight_characteristic == characteristic)
+	{
+		gatt_queue.in_flight = 0;
+	}
+
+	gatt_queue_service();
+
+}
+
+
+/** -------------------------------------------------------------------------------------------
+ * @brief sends pending entries until an indication is in flight, the stack runs out of
+ * buffers or nothing is left. A value refused for lack of buffers is kept and goes out
+ * first on the next call, fill() already took it from its source. That call is at the
+ * latest GATT_QUEUE_TIMER_HANDLE, GATT_QUEUE_RETRY_MS later.
+ *-------------------------------------------------------------------------------------------- **/
+void gatt_queue_service(void)
+{
+	gatt_queue_entry_typedef *e;
+	uint8_t len;
+
+	for (;;)
+	{
+		if (gatt_queue.held_len != 0)
+		{
+			e = &gatt_queue.entry[gatt_queue.held_entry];
+			len = gatt_queue.held_len;
+		}
+		else
+		{
+			e = gatt_queue_next();
+			if (e == NULL)
+			{
+				return;
+			}
+
+			e->pending = 0;
+			len = e->fill(gatt_queue.held);
+			if (len == 0)
+			{
+				continue;		// nothing new since the value went out some other way
+			}
+		}
+
+		struct gecko_msg_gatt_server_send_characteristic_notification_rsp_t *ret = gecko_cmd_gatt_server_send_characteristic_notification(
+				gatt_queue.connection, e->characteristic, len, gatt_queue.held);
+
+		if (ret->result == bg_err_out_of_memory)
+		{
+			gatt_queue.held_len = len;
+			gatt_queue.held_entry = e - gatt_queue.entry;
+			gatt_queue.retries++;
+			gatt_queue_timer_set(HISTORY_TIMER_FREQ * GATT_QUEUE_RETRY_MS / 1000);
+			return;
+		}
+
+		gatt_queue.held_len = 0;
+
+		if (ret->result != 0)
+		{
+			e->dropped++;
+			#if INCLUDE_LOGGING
+				LOG_ERROR("ERROR: %d | response code from gecko_cmd_gatt_server_send_characteristic_notification()", ret->result);
+			#endif
+			continue;
+		}
+
+		e->sent++;
+		link_phy_value(0, len);
+
+		if (e->indicate)
+		{
+			gatt_queue.in_flight = 1;
+			gatt_queue.in_flight_characteristic = e->characteristic;
+			return;
+		}
+	}
+}
+
+// 1 if nothing is waiting to go out or to be confirmed
+uint8_t gatt_queue_is_idle(void)
+{
+
+	if (gatt_queue.in_flight || gatt_queue.held_len != 0)
+	{
+		return 0;
+	}
+
+	for (uint8_t i = 0; i < GATT_QUEUE_ENTRIES; i++)
+	{
+		if (gatt_queue.entry[i].pending)
+		{
+			return 0;
+		}
+	}
+
+	return 1;
+
+}
+
+void gatt_queue_log_stats(void)
+{
+
+	#if INCLUDE_LOGGING
+		for (uint8_t i = 0; i < GATT_QUEUE_ENTRIES; i++)
+		{
+			const gatt_queue_entry_typedef *e = &gatt_queue.entry[i];
+
+			if (e->characteristic != 0)
+			{
+				LOG_INFO("GATT queue: characteristic %d, %lu requests, %lu sent, %lu coalesced, %lu dropped",
+						e->characteristic, e->requests, e->sent, e->coalesced, e->dropped);
+			}
+		}
+		LOG_INFO("GATT queue: %lu out of buffer retries, %lu refused", gatt_queue.retries, gatt_queue.full);
+	#endif
+
+}
+
+#endif
@@ -0,0 +1,102 @@
+/*********************************************************************************************
+ *  @file  gatt_queue.h
+ *	@brief Outbound GATT queue of the server, one entry per characteristic.
+ *
+ *		   Only one indication may wait for its confirmation at a time. Updates of a
+ *		   characteristic are queued as a request, not as a copy of the value: the value is
+ *		   built by the entry's fill function when it actually goes out, so a request made
+ *		   while an indication is in flight never sends a stale value, and a second request
+ *		   for the same characteristic is merged into the first (coalesced).
+ *
+ *		   Pending entries go out in priority order (then in request order) whenever the
+ *		   link is free: right away, on the confirmation of the previous indication
+ *		   (gatt_queue_indication_confirmed()), or GATT_QUEUE_RETRY_MS later from
+ *		   GATT_QUEUE_TIMER_HANDLE if the stack was out of buffers. Notifications do not
+ *		   wait for a confirmation and are sent while an indication is in flight.
+ *
+ *  @authors : Sundar Krishnakumar (GATT server code)
+ *
+ *
+ *  @date      April 29, 2020 (last update)
+ *
+ **********************************************************************************************/
+#include "ble_device_type.h"
+#if BUILD_INCLUDES_BLE_CLIENT
+
+#else
+
+#ifndef __GATT_QUEUE_H__
+#define __GATT_QUEUE_H__
+
+#include <stdint.h>
+
+// Characteristics sent through the queue (Axis orientation, Time until trigger)
+#define GATT_QUEUE_ENTRIES			(4)
+
+// Longest value, payload of the largest ATT MTU (247)
+#define GATT_QUEUE_MAX_LEN			(244)
+
+// A value the stack had no buffer for is sent again from this soft timer
+#define GATT_QUEUE_TIMER_HANDLE		(6)
+#define GATT_QUEUE_RETRY_MS			(10)
+
+// Lower value goes out first
+typedef enum
+{
+	GATT_QUEUE_PRIORITY_HIGH = 0,		// user settings
+	GATT_QUEUE_PRIORITY_NORMAL,			// sensor data
+
+}gatt_queue_priority_typedef;
+
+// Builds the value into buf (GATT_QUEUE_MAX_LEN bytes) when it is sent, returns its
+// length or 0 if there is nothing to send any more
+typedef uint8_t (*gatt_queue_fill_typedef)(uint8_t *buf);
+
+typedef struct
+{
+	uint16_t characteristic;			// 0 = entry unused
+	gatt_queue_priority_typedef priority;
+	gatt_queue_fill_typedef fill;
+	uint8_t indicate;					// 1 if the client confirms it
+	uint8_t pending;
+	uint32_t order;						// request order, older first within a priority
+
+	uint32_t requests;
+	uint32_t sent;
+	uint32_t coalesced;					// requests merged into one already pending
+	uint32_t dropped;					// requests that never went out (send failed, link closed)
+
+}gatt_queue_entry_typedef;
+
+typedef struct
+{
+	uint8_t connection;
+	uint8_t in_flight;					// 1 while an indication waits for its confirmation
+	uint16_t in_flight_characteristic;
+	uint32_t next_order;
+	uint32_t retries;					// sends put off because the stack was out of buffers
+	uint32_t full;						// requests refused, no free entry
+
+	// Value being sent, kept here if the stack had no buffer for it
+	uint8_t held[GATT_QUEUE_MAX_LEN];
+	uint8_t held_len;
+	uint8_t held_entry;
+
+	gatt_queue_entry_typedef entry[GATT_QUEUE_ENTRIES];
+
+}gatt_queue_typedef;
+
+extern gatt_queue_typedef gatt_queue;
+
+void gatt_queue_connection_opened(uint8_t connection);
+void gatt_queue_connection_closed(void);
+void gatt_queue_request(uint16_t characteristic, gatt_queue_priority_typedef priority, uint8_t indicate,
+		gatt_queue_fill_typedef fill);
+void gatt_queue_indication_confirmed(uint16_t characteristic);
+void gatt_queue_service(void);
+uint8_t gatt_queue_is_idle(void);
+void gatt_queue_log_stats(void);
+
+#endif /* __GATT_QUEUE_H__ */
+
+#endif
@@ -0,0 +1,181 @@
+/*********************************************************************************************
+ *  @file gyro_bias.c
+ *	@brief Online gyroscope bias estimation. Every measurement cycle is classified as still
+ *		   or moving; still samples pull the per-axis bias towards the measured rate. The
+ *		   first samples are averaged (alpha = 1/n) so the estimate settles quickly, later
+ *		   ones use a fixed exponential smoothing factor to track slow temperature drift.
+ *
+ *  @authors : Sundar Krishnakumar (GATT server code)
+ *
+ *
+ *  @date      April 29, 2020 (last update)
+ *
+ **********************************************************************************************/
+#include "ble_device_type.h"
+#if BUILD_INCLUDES_BLE_CLIENT
+
+#else
+
+#include <stdlib.h>
+#include <string.h>
+#include "gyro_bias.h"
+#include "cordic.h"
+
+
+gyro_bias_state_typedef gyro_bias_state;
+
+
+static int16_t gyro_bias_axis(uint8_t axis)
+{
+	int32_t bias = gyro_bias_state.bias_q8[axis];
+
+	// Round to nearest millirad/s
+	return (int16_t)((bias + (1 << (GYRO_BIAS_FRAC_BITS - 1))) >> GYRO_BIAS_FRAC_BITS);
+}
+
+
+static uint8_t gyro_bias_check_still(const accel_data_typedef *accel, const gyro_data_typedef *gyro)
+{
+	uint32_t accel_mag = cordic_hypot((int32_t)cordic_hypot(accel->x, accel->y), accel->z);
+
+	if (abs((int32_t)accel_mag - 1000) > GYRO_BIAS_STILL_ACCEL_MG)
+	{
+		return 0;
+	}
+
+	if (gyro_bias_state.have_prev == 0)
+	{
+		return 0;
+	}
+
+	const accel_data_typedef *pa = &gyro_bias_state.prev_accel;
+	const gyro_data_typedef *pg = &gyro_bias_state.prev_gyro;
+
+	if (abs(accel->x - pa->x) > GYRO_BIAS_STILL_ACCEL_DELTA_MG ||
+		abs(accel->y - pa->y) > GYRO_BIAS_STILL_ACCEL_DELTA_MG ||
+		abs(accel->z - pa->z) > GYRO_BIAS_STILL_ACCEL_DELTA_MG)
+	{
+		return 0;
+	}
+
+	if (abs(gyro->x - pg->x) > GYRO_BIAS_STILL_GYRO_DELTA_MRAD ||
+		abs(gyro->y - pg->y) > GYRO_BIAS_STILL_GYRO_DELTA_MRAD ||
+		abs(gyro->z - pg->z) > GYRO_BIAS_STILL_GYRO_DELTA_MRAD)
+	{
+		return 0;
+	}
+
+	// A steady slow rotation looks still sample to sample, reject it once the bias is known
+	if (gyro_bias_is_valid())
+	{
+		if (abs(gyro->x - gyro_bias_axis(0)) > GYRO_BIAS_STILL_RATE_MRAD ||
+			abs(gyro->y - gyro_bias_axis(1)) > GYRO_BIAS_STILL_RATE_MRAD ||
+			abs(gyro->z - gyro_bias_axis(2)) > GYRO_BIAS_STILL_RATE_MRAD)
+		{
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+
+void gyro_bias_reset(void)
+{
+
+	memset(&gyro_bias_state, 0, sizeof(gyro_bias_state));
+
+}
+
+
+// Call once per measurement cycle with the converted samples (milli-g, millirad/s)
+void gyro_bias_update(const accel_data_typedef *accel, const gyro_data_typedef *gyro)
+{
+	const int16_t rate[3] = { gyro->x, gyro->y, gyro->z };
+
+	gyro_bias_state.still = gyro_bias_check_still(accel, gyro);
+
+	if (gyro_bias_state.still)
+	{
+		if (gyro_bias_state.still_samples < (1 << GYRO_BIAS_EMA_SHIFT))
+		{
+			gyro_bias_state.still_samples++;
+		}
+
+		for (uint8_t axis = 0; axis < 3; axis++)
+		{
+			int32_t error = ((int32_t)rate[axis] << GYRO_BIAS_FRAC_BITS) - gyro_bias_state.bias_q8[axis];
+
+			if (gyro_bias_state.still_samples < (1 << GYRO_BIAS_EMA_SHIFT))
+			{
+				// Running mean until enough samples have been seen
+				gyro_bias_state.bias_q8[axis] += error / gyro_bias_state.still_samples;
+			}
+			else
+			{
+				gyro_bias_state.bias_q8[axis] += error >> GYRO_BIAS_EMA_SHIFT;
+			}
+		}
+	}
+
+	gyro_bias_state.prev_accel = *accel;
+	gyro_bias_state.prev_gyro = *gyro;
+	gyro_bias_state.have_prev = 1;
+
+}
+
+
+// Current bias in millirad/s
+void gyro_bias_get(gyro_data_typedef *bias)
+{
+
+	bias->x = gyro_bias_axis(0);
+	bias->y = gyro_bias_axis(1);
+	bias->z = gyro_bias_axis(2);
+
+}
+
+
+// Start from a previously stored estimate (millirad/s Q8). It is treated as converged,
+// later still samples only adjust it with the slow smoothing factor.
+void gyro_bias_restore(const int32_t bias_q8[3])
+{
+
+	gyro_bias_reset();
+	for (uint8_t axis = 0; axis < 3; axis++)
+	{
+		gyro_bias_state.bias_q8[axis] = bias_q8[axis];
+	}
+	gyro_bias_state.still_samples = (1 << GYRO_BIAS_EMA_SHIFT);
+
+}
+
+
+// corrected = gyro - bias. corrected may alias gyro.
+void gyro_bias_correct(const gyro_data_typedef *gyro, gyro_data_typedef *corrected)
+{
+
+	corrected->x = gyro->x - gyro_bias_axis(0);
+	corrected->y = gyro->y - gyro_bias_axis(1);
+	corrected->z = gyro->z - gyro_bias_axis(2);
+
+}
+
+
+// 1 once enough still samples have been averaged for the bias to be used
+uint8_t gyro_bias_is_valid(void)
+{
+
+	return (gyro_bias_state.still_samples >= GYRO_BIAS_MIN_STILL_SAMPLES);
+
+}
+
+
+uint8_t gyro_bias_is_still(void)
+{
+
+	return gyro_bias_state.still;
+
+}
+
+#endif
@@ -0,0 +1,65 @@
+/*********************************************************************************************
+ *  @file  gyro_bias.h
+ *	@brief Online gyroscope zero-rate (bias) estimator. Still intervals are detected from
+ *		   the accelerometer and gyroscope samples and the per-axis offsets are tracked with
+ *		   exponential smoothing, so no periodic full recalibration is needed.
+ *
+ *  @authors : Sundar Krishnakumar (GATT server code)
+ *
+ *
+ *  @date      April 29, 2020 (last update)
+ *
+ **********************************************************************************************/
+#include "ble_device_type.h"
+#if BUILD_INCLUDES_BLE_CLIENT
+
+#else
+
+#ifndef __GYRO_BIAS_H__
+#define __GYRO_BIAS_H__
+
+#include <stdint.h>
+#include "imu.h"
+
+// Bias is kept in millirad/s Q8 so small smoothing steps are not lost to truncation
+#define GYRO_BIAS_FRAC_BITS			(8)
+
+// Stillness test, checked on every sample:
+//  - accelerometer magnitude within GYRO_BIAS_STILL_ACCEL_MG of 1 g
+//  - accelerometer and gyroscope change since the previous sample below the limits
+//  - once a bias is known, the corrected rate below GYRO_BIAS_STILL_RATE_MRAD
+#define GYRO_BIAS_STILL_ACCEL_MG		(100)
+#define GYRO_BIAS_STILL_ACCEL_DELTA_MG	(30)
+#define GYRO_BIAS_STILL_GYRO_DELTA_MRAD	(20)
+#define GYRO_BIAS_STILL_RATE_MRAD		(35)
+
+// Still samples needed before the estimate is used (replaces the old 4 sample calibration)
+#define GYRO_BIAS_MIN_STILL_SAMPLES		(4)
+
+// Smoothing: running mean over the first samples, then alpha = 2^-GYRO_BIAS_EMA_SHIFT
+#define GYRO_BIAS_EMA_SHIFT			(4)
+
+typedef struct
+{
+	int32_t bias_q8[3];				// x, y, z, millirad/s Q8
+	gyro_data_typedef prev_gyro;
+	accel_data_typedef prev_accel;
+	uint16_t still_samples;			// still samples folded into the estimate, saturates
+	uint8_t still;					// 1 if the last sample was still
+	uint8_t have_prev;				// 1 once prev_gyro / prev_accel hold a sample
+
+}gyro_bias_state_typedef;
+
+extern gyro_bias_state_typedef gyro_bias_state;
+
+void gyro_bias_reset(void);
+void gyro_bias_update(const accel_data_typedef *accel, const gyro_data_typedef *gyro);
+void gyro_bias_get(gyro_data_typedef *bias);
+void gyro_bias_restore(const int32_t bias_q8[3]);
+void gyro_bias_correct(const gyro_data_typedef *gyro, gyro_data_typedef *corrected);
+uint8_t gyro_bias_is_valid(void);
+uint8_t gyro_bias_is_still(void);
+
+#endif /* __GYRO_BIAS_H__ */
+
+#endif
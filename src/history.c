@@ -0,0 +1,598 @@
+/*********************************************************************************************
+ *  @file history.c
+ *	@brief Store-and-forward catch-up of IMU samples after a reconnect, see history.h for the
+ *		   protocol.
+ *
+ *		   Server: the stream is built from recorder blocks (flash, and the block still being
+ *		   filled in RAM) and pushed with notifications until the stack runs out of buffers;
+ *		   a soft timer resumes it. A frame refused by the stack is kept and sent again, so
+ *		   nothing is skipped.
+ *
+ *		   Client: writes the request once notifications are enabled, unpacks the frames and
+ *		   measures the catch-up throughput in samples per second.
+ *
+ *  @authors : Rajat Chaple (GATT client code)
+ *  		   Sundar Krishnakumar (GATT server code)
+ *
+ *  @date      April 29, 2020 (last update)
+ **********************************************************************************************/
+#include "ble_device_type.h"
+#if BUILD_INCLUDES_BLE_CLIENT
+#include "log.h"
+#include "history.h"
+#include "native_gecko.h"
+#include "infrastructure.h"
+#include "display.h"
+
+
+history_client_t history_client[CLIENT_MAX_SERVERS];
+
+
+/** -------------------------------------------------------------------------------------------
+ * @brief writes a catch-up request. Resumes after the last sample received when the previous
+ * catch-up was cut off by a disconnect, otherwise asks for everything since the server's
+ * last disconnect.
+ *
+ * @param link, the client link of the server
+ * @param connection, connection handle of the link
+ * @param characteristic, handle of the History control characteristic
+ *-------------------------------------------------------------------------------------------- **/
+void history_client_request(uint8_t link, uint8_t connection, uint16_t characteristic)
+{
+	history_client_t *client = &history_client[link];
+	uint8_t request[HISTORY_REQUEST_LEN];
+	uint8_t *ptr = request;
+
+	UINT8_TO_BITSTREAM(ptr, HISTORY_OP_CATCH_UP);
+	UINT16_TO_BITSTREAM(ptr, client->resume_valid ? client->session : HISTORY_SESSION_LAST_DISCONNECT);
+	UINT32_TO_BITSTREAM(ptr, client->resume_valid ? client->t_ms : 0);
+
+	struct gecko_msg_gatt_write_characteristic_value_rsp_t *ret = gecko_cmd_gatt_write_characteristic_value(connection,
+			characteristic, HISTORY_REQUEST_LEN, request);
+	if (ret->result != 0)
+	{
+		#if INCLUDE_LOGGING
+			LOG_ERROR("ERROR: %d | response code from gecko_cmd_gatt_write_characteristic_value()", ret->result);
+		#endif
+		return;
+	}
+
+	client->active = true;
+	client->samples = 0;
+	client->start_ticks = history_time_ticks();
+}
+
+/** -------------------------------------------------------------------------------------------
+ * @brief unpacks one History data notification
+ *-------------------------------------------------------------------------------------------- **/
+void history_client_frame(uint8_t link, const uint8_t *frame, uint8_t len)
+{
+	history_client_t *client = &history_client[link];
+
+	if (len == 0)
+	{
+		return;
+	}
+
+	switch (frame[0])
+	{
+		case HISTORY_FRAME_SESSION:
+			if (len >= HISTORY_SESSION_FRAME_LEN)
+			{
+				client->session = BYTES_TO_UINT16(frame[1], frame[2]);
+			}
+			break;
+
+		case HISTORY_FRAME_SAMPLES:
+		{
+			if (len < HISTORY_SAMPLES_HEADER_LEN)
+			{
+				break;
+			}
+
+			uint8_t count = MIN(frame[1], (len - HISTORY_SAMPLES_HEADER_LEN) / HISTORY_SAMPLE_LEN);
+			uint32_t t_ms = BYTES_TO_UINT32(frame[2], frame[3], frame[4], frame[5]);
+			const uint8_t *ptr = &frame[HISTORY_SAMPLES_HEADER_LEN];
+
+			for (uint8_t i = 0; i < count; i++, ptr += HISTORY_SAMPLE_LEN)
+			{
+				t_ms += BYTES_TO_UINT16(ptr[0], ptr[1]);
+
+				// Accelerometer y, same value as the live axis orientation indication
+				displaySparklineAddSample((int16_t)BYTES_TO_UINT16(ptr[4], ptr[5]));
+			}
+
+			if (count != 0)
+			{
+				client->t_ms = t_ms;
+				client->samples += count;
+			}
+		}
+			break;
+
+		case HISTORY_FRAME_END:
+		{
+			uint32_t elapsed = history_time_ticks() - client->start_ticks;
+
+			client->active = false;
+			client->resume_valid = false;
+			client->samples_per_s = (elapsed != 0) ? (uint32_t)((uint64_t)client->samples * HISTORY_TIMER_FREQ / elapsed) : 0;
+
+			#if INCLUDE_LOGGING
+				LOG_INFO("Catch-up %u end (status %u): %lu samples in %lu ms, %lu samples/s", link, (len > 1) ? frame[1] : 0,
+						client->samples, (uint32_t)((uint64_t)elapsed * 1000 / HISTORY_TIMER_FREQ), client->samples_per_s);
+			#endif
+		}
+			break;
+
+		default:
+			break;
+	}
+}
+
+/** -------------------------------------------------------------------------------------------
+ * @brief a catch-up cut off after some samples is resumed from the last one on reconnect
+ *-------------------------------------------------------------------------------------------- **/
+void history_client_disconnected(uint8_t link)
+{
+	history_client_t *client = &history_client[link];
+
+	if (client->active && client->samples != 0)
+	{
+		client->resume_valid = true;
+	}
+	client->active = false;
+
+}
+
+#else
+
+#include <string.h>
+#include "history.h"
+#include "native_gecko.h"
+#include "gatt_db.h"
+#include "infrastructure.h"
+#include "link_phy.h"
+#include "log.h"
+
+
+history_typedef history;
+
+
+static void history_timer(uint8_t on)
+{
+	uint32_t ticks = on ? (HISTORY_TIMER_FREQ * HISTORY_PUMP_INTERVAL_MS / 1000) : 0;
+
+	struct gecko_msg_hardware_set_soft_timer_rsp_t *ret = gecko_cmd_hardware_set_soft_timer(ticks, HISTORY_TIMER_HANDLE, 0);
+	if (ret->result != 0)
+	{
+		#if INCLUDE_LOGGING
+			LOG_ERROR("ERROR: %d | response code from gecko_cmd_hardware_set_soft_timer()", ret->result);
+		#endif
+	}
+}
+
+// 1 if (session, t_ms) comes after the stream position
+static uint8_t history_is_new(uint16_t session, uint32_t t_ms)
+{
+
+	if (session != history.session)
+	{
+		return (session > history.session);
+	}
+
+	return history.inclusive ? (t_ms >= history.t_ms) : (t_ms > history.t_ms);
+}
+
+static uint8_t history_load_block(uint32_t seq)
+{
+	uint8_t block[RECORDER_BLOCK_SIZE];
+
+	if (history.cache_valid && history.cache_seq == seq && history.cache_from_ram == 0)
+	{
+		return 1;
+	}
+
+	history.cache_valid = 0;
+
+	if (recorder_read_block(seq, block) == 0)
+	{
+		return 0;
+	}
+
+	history.cache_seq = seq;
+	history.cache_session = BYTES_TO_UINT16(block[8], block[9]);	// see recorder.h
+	history.cache_count = recorder_decode_block(block, history.cache, RECORDER_BLOCK_MAX_SAMPLES);
+	history.cache_valid = 1;
+	history.cache_from_ram = (seq == recorder.next_seq);
+
+	return 1;
+}
+
+static void history_build_end(void)
+{
+	uint8_t *ptr = history.frame;
+	uint8_t status = history.end_status;
+
+	if (status == HISTORY_END_DONE && history.samples == 0)
+	{
+		status = HISTORY_END_EMPTY;
+	}
+
+	UINT8_TO_BITSTREAM(ptr, HISTORY_FRAME_END);
+	UINT8_TO_BITSTREAM(ptr, status);
+	UINT32_TO_BITSTREAM(ptr, history.samples);
+	history.frame_len = HISTORY_END_FRAME_LEN;
+}
+
+// Builds the next frame into history.frame. Samples are taken from as many blocks of one
+// session as fit.
+static void history_build_frame(void)
+{
+	uint8_t max_samples = (MIN(history.mtu - 3, HISTORY_FRAME_MAX_LEN) - HISTORY_SAMPLES_HEADER_LEN) / HISTORY_SAMPLE_LEN;
+	uint8_t *ptr = &history.frame[HISTORY_SAMPLES_HEADER_LEN];
+	uint8_t count = 0;
+	uint32_t prev_t_ms = 0;
+
+	history.frame_len = 0;
+	history.frame_samples = 0;
+
+	if (history.end_status == HISTORY_END_ABORTED)
+	{
+		history_build_end();
+		return;
+	}
+
+	while (count < max_samples)
+	{
+		if (history.seq > recorder.next_seq)
+		{
+			break;
+		}
+		if (recorder.valid && history.seq < recorder.oldest_seq)
+		{
+			// Overwritten while streaming
+			history.seq = recorder.oldest_seq;
+		}
+		if (history_load_block(history.seq) == 0)
+		{
+			if (history.seq == recorder.next_seq)
+			{
+				break;		// no sample in RAM yet
+			}
+			history.seq++;
+			continue;
+		}
+
+		// Samples of one frame share a session; announce a new session with its own frame
+		if (history.session_sent == 0 || history.frame_session != history.cache_session)
+		{
+			if (count != 0)
+			{
+				break;
+			}
+
+			uint8_t i;
+			for (i = 0; i < history.cache_count && !history_is_new(history.cache_session, history.cache[i].t_ms); i++)
+			{
+			}
+			if (i < history.cache_count)
+			{
+				uint8_t *p = history.frame;
+				UINT8_TO_BITSTREAM(p, HISTORY_FRAME_SESSION);
+				UINT16_TO_BITSTREAM(p, history.cache_session);
+				history.frame_session = history.cache_session;
+				history.session_sent = 0;
+				history.frame_len = HISTORY_SESSION_FRAME_LEN;
+				return;
+			}
+		}
+		else
+		{
+			for (uint8_t i = 0; i < history.cache_count && count < max_samples; i++)
+			{
+				const recorder_sample_typedef *s = &history.cache[i];
+
+				if ((count == 0 && !history_is_new(history.cache_session, s->t_ms)) ||
+					(count != 0 && s->t_ms <= prev_t_ms))
+				{
+					continue;
+				}
+				if (count != 0 && s->t_ms - prev_t_ms > 0xFFFF)
+				{
+					max_samples = count;	// gap too long for a delta, next frame starts here
+					break;
+				}
+
+				if (count == 0)
+				{
+					uint8_t *p = &history.frame[2];
+					UINT32_TO_BITSTREAM(p, s->t_ms);
+					prev_t_ms = s->t_ms;
+				}
+				UINT16_TO_BITSTREAM(ptr, (uint16_t)(s->t_ms - prev_t_ms));
+				UINT16_TO_BITSTREAM(ptr, (uint16_t)s->accel.x);
+				UINT16_TO_BITSTREAM(ptr, (uint16_t)s->accel.y);
+				UINT16_TO_BITSTREAM(ptr, (uint16_t)s->accel.z);
+				UINT16_TO_BITSTREAM(ptr, (uint16_t)s->gyro.x);
+				UINT16_TO_BITSTREAM(ptr, (uint16_t)s->gyro.y);
+				UINT16_TO_BITSTREAM(ptr, (uint16_t)s->gyro.z);
+				prev_t_ms = s->t_ms;
+				count++;
+			}
+
+			if (count == max_samples)
+			{
+				break;
+			}
+		}
+
+		// Block exhausted. The RAM block is the newest data there is.
+		if (history.seq == recorder.next_seq)
+		{
+			break;
+		}
+		history.seq++;
+	}
+
+	if (count == 0)
+	{
+		history_build_end();
+		return;
+	}
+
+	history.frame[0] = HISTORY_FRAME_SAMPLES;
+	history.frame[1] = count;
+	history.frame_samples = count;
+	history.frame_t_ms = prev_t_ms;
+	history.frame_len = HISTORY_SAMPLES_HEADER_LEN + count * HISTORY_SAMPLE_LEN;
+}
+
+// The stack took the frame: move the stream position past it
+static void history_commit_frame(void)
+{
+
+	history.frames++;
+
+	switch (history.frame[0])
+	{
+		case HISTORY_FRAME_SESSION:
+			history.session_sent = 1;
+			break;
+
+		case HISTORY_FRAME_SAMPLES:
+			history.session = history.frame_session;
+			history.t_ms = history.frame_t_ms;
+			history.inclusive = 0;
+			history.samples += history.frame_samples;
+			break;
+
+		case HISTORY_FRAME_END:
+		{
+			uint32_t elapsed = history_time_ticks() - history.start_ticks;
+
+			history.active = 0;
+			history_timer(0);
+			history.samples_per_s = (elapsed != 0) ? (uint32_t)((uint64_t)history.samples * HISTORY_TIMER_FREQ / elapsed) : 0;
+
+			#if INCLUDE_LOGGING
+				LOG_INFO("Catch-up end (status %d): %lu samples, %lu frames, %lu ms, %lu samples/s", history.frame[1],
+						history.samples, history.frames, (uint32_t)((uint64_t)elapsed * 1000 / HISTORY_TIMER_FREQ), history.samples_per_s);
+			#endif
+		}
+			break;
+
+		default:
+			break;
+	}
+
+	history.frame_len = 0;
+}
+
+static void history_start(uint16_t session, uint32_t t_ms, uint8_t inclusive)
+{
+
+	history.session = session;
+	history.t_ms = t_ms;
+	history.inclusive = inclusive;
+	history.session_sent = 0;
+	history.end_status = HISTORY_END_DONE;
+	history.cache_valid = 0;
+	history.frame_len = 0;
+	history.samples = 0;
+	history.frames = 0;
+
+	if (recorder_locate(session, t_ms, &history.seq) == 0)
+	{
+		history.seq = recorder.valid ? recorder.oldest_seq : recorder.next_seq;
+	}
+
+	history.active = 1;
+	history.start_ticks = history_time_ticks();
+	history_timer(1);
+
+	#if INCLUDE_LOGGING
+		LOG_INFO("Catch-up from session %d, %lu ms, block %lu", session, t_ms, history.seq);
+	#endif
+
+	history_pump();
+}
+
+
+/** -------------------------------------------------------------------------------------------
+ * @brief clears the stream state, call once at boot
+ *-------------------------------------------------------------------------------------------- **/
+void history_init(void)
+{
+
+	memset(&history, 0, sizeof(history));
+	history.mtu = HISTORY_ATT_MTU_DEFAULT;
+
+}
+
+void history_connection_opened(uint8_t connection)
+{
+
+	history.connection = connection;
+	history.mtu = HISTORY_ATT_MTU_DEFAULT;
+	history.active = 0;
+	history.pending = 0;
+
+}
+
+/** -------------------------------------------------------------------------------------------
+ * @brief remembers where the client stopped receiving: the stream position if a catch-up was
+ * running, otherwise the newest recorded sample (live data was being sent up to there)
+ *-------------------------------------------------------------------------------------------- **/
+void history_connection_closed(void)
+{
+
+	if (history.active)
+	{
+		history.mark_session = history.session;
+		history.mark_t_ms = history.t_ms;
+		history.mark_inclusive = history.inclusive;
+		history.active = 0;
+		history_timer(0);
+	}
+	else if (recorder.stats.samples != 0)
+	{
+		history.mark_session = recorder.session;
+		history.mark_t_ms = recorder.last.t_ms;
+		history.mark_inclusive = 0;
+	}
+	else
+	{
+		// Nothing recorded yet in this session, all of it is new
+		history.mark_session = recorder.session;
+		history.mark_t_ms = 0;
+		history.mark_inclusive = 1;
+	}
+
+	history.mark_valid = 1;
+	history.pending = 0;
+}
+
+void history_set_mtu(uint16_t mtu)
+{
+	history.mtu = MIN(mtu, HISTORY_ATT_MTU_MAX);
+}
+
+/** -------------------------------------------------------------------------------------------
+ * @brief History control write. A catch-up request is kept until history_start_pending() is
+ * called on a bonded link.
+ *-------------------------------------------------------------------------------------------- **/
+void history_request(const uint8_t *data, uint8_t len)
+{
+
+	if (len == 0)
+	{
+		return;
+	}
+
+	if (data[0] == HISTORY_OP_ABORT)
+	{
+		history.pending = 0;
+		if (history.active)
+		{
+			history.end_status = HISTORY_END_ABORTED;
+			history.frame_len = 0;
+			history_pump();
+		}
+	}
+	else if (data[0] == HISTORY_OP_CATCH_UP && len >= HISTORY_REQUEST_LEN)
+	{
+		history.pending = 1;
+		history.pending_session = BYTES_TO_UINT16(data[1], data[2]);
+		history.pending_t_ms = BYTES_TO_UINT32(data[3], data[4], data[5], data[6]);
+	}
+
+}
+
+void history_start_pending(void)
+{
+
+	if (history.pending == 0)
+	{
+		return;
+	}
+	history.pending = 0;
+
+	if (history.pending_session != HISTORY_SESSION_LAST_DISCONNECT)
+	{
+		history_start(history.pending_session, history.pending_t_ms, 0);
+	}
+	else if (history.mark_valid)
+	{
+		history_start(history.mark_session, history.mark_t_ms, history.mark_inclusive);
+	}
+	else
+	{
+		// First connection since boot: everything recorded in this session
+		history_start(recorder.session, 0, 1);
+	}
+
+}
+
+/** -------------------------------------------------------------------------------------------
+ * @brief sends frames until the stack has no buffers left or the stream has ended. Called
+ * from the History soft timer while a catch-up runs.
+ *-------------------------------------------------------------------------------------------- **/
+void history_pump(void)
+{
+
+	while (history.active)
+	{
+		// A refused END is rebuilt, samples may have been recorded since
+		if (history.frame_len != 0 && history.frame[0] == HISTORY_FRAME_END && history.end_status != HISTORY_END_ABORTED)
+		{
+			history.frame_len = 0;
+		}
+
+		if (history.frame_len == 0)
+		{
+			history_build_frame();
+		}
+
+		struct gecko_msg_gatt_server_send_characteristic_notification_rsp_t *ret = gecko_cmd_gatt_server_send_characteristic_notification(
+				history.connection, gattdb_history_data, history.frame_len, history.frame);
+
+		if (ret->result == bg_err_out_of_memory)
+		{
+			return;
+		}
+
+		if (ret->result != 0)
+		{
+			#if INCLUDE_LOGGING
+				LOG_ERROR("ERROR: %d | response code from gecko_cmd_gatt_server_send_characteristic_notification()", ret->result);
+			#endif
+			history.active = 0;
+			history_timer(0);
+			return;
+		}
+
+		link_phy_value(0, history.frame_len);
+		history_commit_frame();
+	}
+
+}
+
+uint8_t history_is_active(void)
+{
+	return history.active;
+}
+
+#endif
+
+
+/** -------------------------------------------------------------------------------------------
+ * @brief RTCC time since reset in HISTORY_TIMER_FREQ ticks (wraps after 36 hours, use for
+ * differences only)
+ *-------------------------------------------------------------------------------------------- **/
+uint32_t history_time_ticks(void)
+{
+	struct gecko_msg_hardware_get_time_rsp_t *ret = gecko_cmd_hardware_get_time();
+
+	return ret->seconds * HISTORY_TIMER_FREQ + ret->ticks;
+}
@@ -0,0 +1,156 @@
+/*********************************************************************************************
+ *  @file  history.h
+ *	@brief Store-and-forward of IMU samples. The server records every sample (recorder.c),
+ *		   connected or not. After a reconnect the client asks for what it missed on the
+ *		   History control characteristic and the server streams it from the recorder as
+ *		   notifications of the History data characteristic, each frame as large as the ATT
+ *		   MTU allows. Live axis orientation indications resume once the catch-up has ended.
+ *
+ *		   Request (History control, written by the client, little endian):
+ *		     opcode (uint8), session (uint16), ms since session start (uint32)
+ *		     HISTORY_OP_CATCH_UP streams every sample after (session, ms). Session
+ *		     HISTORY_SESSION_LAST_DISCONNECT means "since the last disconnect".
+ *
+ *		   Frames (History data, notified by the server, little endian):
+ *		     SESSION : type, session (uint16). The following samples belong to this session.
+ *		     SAMPLES : type, count (uint8), time of the first sample in ms (uint32), then
+ *		               count x { ms since the previous sample (uint16, 0 for the first),
+ *		               accel x/y/z mg (3 x int16), gyro x/y/z millirad/s (3 x int16) }
+ *		     END     : type, status (uint8), samples sent (uint32)
+ *
+ *		   One sample fits the 20 byte payload of the default MTU, 17 fit an MTU of 247.
+ *
+ *  @authors : Rajat Chaple (GATT client code)
+ *  		   Sundar Krishnakumar (GATT server code)
+ *
+ *  @date      April 29, 2020 (last update)
+ **********************************************************************************************/
+#include "ble_device_type.h"
+
+#ifndef __HISTORY_H__
+#define __HISTORY_H__
+
+#include <stdint.h>
+
+#define HISTORY_OP_CATCH_UP				(0x01)
+#define HISTORY_OP_ABORT				(0x02)
+#define HISTORY_REQUEST_LEN				(7)
+
+#define HISTORY_SESSION_LAST_DISCONNECT	(0xFFFF)
+
+#define HISTORY_FRAME_SESSION			(0x01)
+#define HISTORY_FRAME_SAMPLES			(0x02)
+#define HISTORY_FRAME_END				(0x03)
+
+#define HISTORY_SESSION_FRAME_LEN		(3)
+#define HISTORY_SAMPLES_HEADER_LEN		(6)
+#define HISTORY_SAMPLE_LEN				(14)
+#define HISTORY_END_FRAME_LEN			(6)
+
+// END status
+#define HISTORY_END_DONE				(0)		// caught up with the newest sample
+#define HISTORY_END_EMPTY				(1)		// nothing recorded after the requested point
+#define HISTORY_END_ABORTED				(2)
+
+#define HISTORY_ATT_MTU_DEFAULT			(23)
+#define HISTORY_ATT_MTU_MAX				(247)
+#define HISTORY_FRAME_MAX_LEN			(HISTORY_ATT_MTU_MAX - 3)
+
+// Soft timer time base, ticks per second
+#define HISTORY_TIMER_FREQ				(32768)
+
+#if BUILD_INCLUDES_BLE_CLIENT
+
+#include <stdbool.h>
+
+typedef struct history_client_s
+{
+	bool active;				// request written, END not received yet
+	bool resume_valid;			// a catch-up was cut off, resume after (session, t_ms)
+	uint16_t session;			// session of the last sample received
+	uint32_t t_ms;				// time of the last sample received
+
+	uint32_t samples;			// samples received in the current catch-up
+	uint32_t start_ticks;		// RTCC ticks when the request was written
+	uint32_t samples_per_s;		// throughput of the last completed catch-up
+
+}history_client_t;
+
+// One per link of the client (ble.h). A link goes back to the server it had before, so a
+// cut off catch-up resumes on the right one.
+extern history_client_t history_client[CLIENT_MAX_SERVERS];
+
+void history_client_request(uint8_t link, uint8_t connection, uint16_t characteristic);
+void history_client_frame(uint8_t link, const uint8_t *frame, uint8_t len);
+void history_client_disconnected(uint8_t link);
+
+#else
+
+#include "recorder.h"
+
+// The stream is pumped from this soft timer while a catch-up runs
+#define HISTORY_TIMER_HANDLE			(3)
+#define HISTORY_PUMP_INTERVAL_MS		(15)
+
+typedef struct
+{
+	uint8_t active;
+	uint8_t connection;
+	uint16_t mtu;
+
+	uint16_t session;			// last sample sent, or the requested start point
+	uint32_t t_ms;
+	uint8_t inclusive;			// 1 if the sample at (session, t_ms) has not been sent yet
+	uint32_t seq;				// recorder block being streamed
+	uint8_t session_sent;		// SESSION frame for the current session sent
+	uint8_t end_status;
+
+	// Disconnect mark, default start point of a catch-up
+	uint8_t mark_valid;
+	uint16_t mark_session;
+	uint32_t mark_t_ms;
+	uint8_t mark_inclusive;
+
+	// Request written before the link was bonded, started by history_start_pending()
+	uint8_t pending;
+	uint16_t pending_session;
+	uint32_t pending_t_ms;
+
+	// Decoded block cache
+	uint32_t cache_seq;
+	uint8_t cache_valid;
+	uint16_t cache_session;
+	uint8_t cache_count;
+	uint8_t cache_from_ram;		// block was still being filled and may have grown
+	recorder_sample_typedef cache[RECORDER_BLOCK_MAX_SAMPLES];
+
+	// Frame built but not accepted by the stack yet
+	uint8_t frame[HISTORY_FRAME_MAX_LEN];
+	uint8_t frame_len;
+	uint8_t frame_samples;
+	uint16_t frame_session;
+	uint32_t frame_t_ms;
+
+	uint32_t samples;			// samples sent in the current catch-up
+	uint32_t frames;
+	uint32_t start_ticks;
+	uint32_t samples_per_s;		// throughput of the last completed catch-up
+
+}history_typedef;
+
+extern history_typedef history;
+
+void history_init(void);
+void history_connection_opened(uint8_t connection);
+void history_connection_closed(void);
+void history_set_mtu(uint16_t mtu);
+void history_request(const uint8_t *data, uint8_t len);
+void history_start_pending(void);
+void history_pump(void);
+uint8_t history_is_active(void);
+
+#endif
+
+uint32_t history_time_ticks(void);
+
+#endif /* __HISTORY_H__ */
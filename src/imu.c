@@ -21,6 +21,14 @@
 #else
 
 #include "imu.h"
+#include "imu_convert.h"
+#include "fusion.h"
+#include "cordic.h"
+#include "gyro_bias.h"
+#include "imu_cal.h"
+#include "recorder.h"
+#include "postmortem.h"
+#include "main.h"
 
 I2CSPM_Init_TypeDef i2cspm_init_custom =
 { I2C0,                       /* Use I2C instance 0 */                       \
@@ -55,9 +63,8 @@ gyro_data_typedef gyro_data;
 uint8_t calibration_complete_flag = 0; // 0=not complete
 										// 1=calibration complete.
 										// 2=stop calibration
-uint8_t calibration_count = 0;
 
-uint16_t tilt = 0; // Will hold the average of Y-axis accelerometer reading.
+uint16_t tilt = 0; // Degrees from vertical of the accelerometer vector, centidegrees (see cordic.c)
 
 void I2C0_init(void)
 {
@@ -422,11 +429,11 @@ void FXAS_measure_stop_off_read(void)
 
 
 	    // +/- 4g selected during FXOS8700 configuration
-	    // Conversion from raw readings to milliGs
-	    accel_data.x = accel_raw.x * ACCEL_MG_LSB_4G;
-	    accel_data.y = accel_raw.y * ACCEL_MG_LSB_4G;
-	    accel_data.z = accel_raw.z * ACCEL_MG_LSB_4G;
+	    // Conversion from raw readings to milliGs (fixed-point, see imu_convert.c)
+	    imu_convert_accel_block((const int16_t *)&accel_raw, (int16_t *)&accel_data, 1);
+	    imu_cal_apply_accel_offset(&accel_data);
 
+	    tilt = cordic_tilt_from_vertical_cdeg(accel_data.x, accel_data.y, accel_data.z);
 
 	}
 
@@ -453,21 +460,15 @@ void FXAS_measure_stop_off_read(void)
 	    gyro_raw.z = (gyro_buff[5] << 8) | gyro_buff[6];
 
 
-	    // Conversion from raw readings to millidps
-	    gyro_data.x = gyro_raw.x * GYRO_SENSITIVITY_2000DPS;
-	    gyro_data.y = gyro_raw.y * GYRO_SENSITIVITY_2000DPS;
-	    gyro_data.z = gyro_raw.z * GYRO_SENSITIVITY_2000DPS;
-
-	    // Conversion from dps to millrad/s
-	    gyro_data.x *= FXAS21002C_MDPS_TO_MRAD;
-	    gyro_data.y *= FXAS21002C_MDPS_TO_MRAD;
-	    gyro_data.z *= FXAS21002C_MDPS_TO_MRAD;
+	    // Conversion from raw readings to millirad/s in one fixed-point step
+	    // (GYRO_SENSITIVITY_2000DPS * FXAS21002C_MDPS_TO_MRAD, see imu_convert.c)
+	    imu_convert_gyro_block((const int16_t *)&gyro_raw, (int16_t *)&gyro_data, 1);
 
 	}
 
 	#if INCLUDE_LOGGING
 		{
-			LOG_INFO("Accelerometer::: X: %d Y: %d Z: %d", accel_data.x, accel_data.y, accel_data.z);
+			LOG_INFO("Accelerometer::: X: %d Y: %d Z: %d tilt: %d cdeg", accel_data.x, accel_data.y, accel_data.z, tilt);
 		}
 
 		{
@@ -475,28 +476,51 @@ void FXAS_measure_stop_off_read(void)
 		}
 	#endif
 
-	// While calibration the person must be still. Checked using gyroscope.
-	// If person moves start calibration from beginning.
-	if (calibration_complete_flag == 0 && (abs(gyro_data.x) > 20 || abs(gyro_data.y) > 20 || abs(gyro_data.z) > 20))
+	// Track the gyroscope zero-rate offset over still intervals
+	gyro_bias_update(&accel_data, &gyro_data);
+	if (gyro_bias_is_still())
 	{
-		calibration_count = 0;
-		tilt = 0;
+		imu_cal_track_accel_offset(&accel_data);
 	}
 
+	#if INCLUDE_LOGGING
+		{
+			gyro_data_typedef bias;
+			gyro_bias_get(&bias);
+			LOG_INFO("Gyro bias::: X: %d Y: %d Z: %d still: %d", bias.x, bias.y, bias.z, gyro_bias_is_still());
+		}
+	#endif
+
+	// Orientation filter, one update per measurement cycle, on bias corrected rates
+	gyro_data_typedef gyro_corrected;
+	gyro_bias_correct(&gyro_data, &gyro_corrected);
+	fusion_update(&accel_data, &gyro_corrected, LETIMER_PERIOD_MS);
 
+	// Keep the sample in the session log on the SPI flash, connected or not
+	recorder_append(&accel_data, &gyro_corrected, LETIMER_PERIOD_MS);
+
+	// Calibration completes right away when the record stored in flash passes the one
+	// sample check, otherwise once the bias estimator has seen enough still samples.
+	// Movement only pauses the estimate, it does not restart it.
 	if (calibration_complete_flag == 0)
 	{
+		if (imu_cal_revalidate(&accel_data, &gyro_data))
+		{
+			calibration_complete_flag = 1;
+			postmortem_log("calibration restored");
+		}
+		else if (gyro_bias_is_valid())
+		{
+			calibration_complete_flag = 1; // Start sending indications only when calibration_complete_flag = 1
 
-		calibration_count++;
+			// The user is still and upright at this point
+			imu_cal_set_upright(&accel_data);
+			postmortem_log("calibration done, upright tilt %u cdeg", imu_cal.record.upright_tilt_cdeg);
+		}
 	}
-
-
-	// Ignore first 4 readings. Let the sensor stabilize.
-	if (calibration_count == 4)
+	else
 	{
-		calibration_complete_flag = 1; // Start sending indications only when calibration_complete_flag = 1
-		calibration_count++;
-
+		imu_cal_track();
 	}
 
 
@@ -0,0 +1,317 @@
+/*********************************************************************************************
+ *  @file imu_cal.c
+ *	@brief Save / restore of the IMU calibration (accelerometer offsets, gyroscope bias and
+ *		   the upright reference) through the Bluetooth stack persistent store.
+ *
+ *		   At boot the record is loaded and the gyro bias estimator is seeded with it. The
+ *		   first sample is then checked once (imu_cal_revalidate()); if it is consistent the
+ *		   calibration is complete right away, otherwise the record is dropped and the normal
+ *		   still-interval calibration runs.
+ *
+ *  @authors : Sundar Krishnakumar (GATT server code)
+ *
+ *
+ *  @date      April 29, 2020 (last update)
+ *
+ **********************************************************************************************/
+#include "ble_device_type.h"
+#if BUILD_INCLUDES_BLE_CLIENT
+
+#else
+
+#include <stdlib.h>
+#include <string.h>
+#include "imu_cal.h"
+#include "gyro_bias.h"
+#include "cordic.h"
+#include "crc16.h"
+#include "native_gecko.h"
+#include "infrastructure.h"
+
+
+imu_cal_typedef imu_cal;
+
+
+static int16_t imu_cal_get_int16(const uint8_t **ptr)
+{
+	int16_t value = (int16_t)BYTES_TO_UINT16((*ptr)[0], (*ptr)[1]);
+
+	*ptr += 2;
+	return value;
+}
+
+static int32_t imu_cal_get_int32(const uint8_t **ptr)
+{
+	const uint8_t *p = *ptr;
+	int32_t value = (int32_t)((uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24));
+
+	*ptr += 4;
+	return value;
+}
+
+
+// Running offset estimate of one axis, rounded to mg
+static int16_t imu_cal_accel_offset_axis(uint8_t axis)
+{
+	int32_t offset = imu_cal.accel_offset_q8[axis];
+
+	return (int16_t)((offset + (1 << (GYRO_BIAS_FRAC_BITS - 1))) >> GYRO_BIAS_FRAC_BITS);
+}
+
+// Copies the running accelerometer offset and gyro bias into the record
+static void imu_cal_update_record(void)
+{
+
+	imu_cal.record.accel_offset.x = imu_cal_accel_offset_axis(0);
+	imu_cal.record.accel_offset.y = imu_cal_accel_offset_axis(1);
+	imu_cal.record.accel_offset.z = imu_cal_accel_offset_axis(2);
+	memcpy(imu_cal.record.gyro_bias_q8, gyro_bias_state.bias_q8, sizeof(imu_cal.record.gyro_bias_q8));
+
+}
+
+
+static void imu_cal_serialize(uint8_t *buf)
+{
+	const imu_cal_record_typedef *rec = &imu_cal.record;
+	uint8_t *ptr = buf;
+
+	UINT8_TO_BITSTREAM(ptr, IMU_CAL_VERSION);
+	UINT16_TO_BITSTREAM(ptr, (uint16_t)rec->accel_offset.x);
+	UINT16_TO_BITSTREAM(ptr, (uint16_t)rec->accel_offset.y);
+	UINT16_TO_BITSTREAM(ptr, (uint16_t)rec->accel_offset.z);
+	for (uint8_t axis = 0; axis < 3; axis++)
+	{
+		UINT32_TO_BITSTREAM(ptr, (uint32_t)rec->gyro_bias_q8[axis]);
+	}
+	UINT16_TO_BITSTREAM(ptr, (uint16_t)rec->upright.x);
+	UINT16_TO_BITSTREAM(ptr, (uint16_t)rec->upright.y);
+	UINT16_TO_BITSTREAM(ptr, (uint16_t)rec->upright.z);
+	UINT16_TO_BITSTREAM(ptr, rec->upright_tilt_cdeg);
+
+	uint16_t crc = crc16_update(CRC16_INIT, buf, (uint32_t)(ptr - buf));
+	UINT16_TO_BITSTREAM(ptr, crc);
+}
+
+
+// Returns 1 and fills imu_cal.record if buf holds a record of the current version
+static uint8_t imu_cal_deserialize(const uint8_t *buf, uint8_t len)
+{
+	imu_cal_record_typedef *rec = &imu_cal.record;
+	const uint8_t *ptr = buf;
+
+	if (len != IMU_CAL_RECORD_LEN || buf[0] != IMU_CAL_VERSION)
+	{
+		return 0;
+	}
+
+	uint16_t crc = crc16_update(CRC16_INIT, buf, IMU_CAL_RECORD_LEN - 2);
+	if (crc != BYTES_TO_UINT16(buf[IMU_CAL_RECORD_LEN - 2], buf[IMU_CAL_RECORD_LEN - 1]))
+	{
+		return 0;
+	}
+
+	ptr++;
+	rec->accel_offset.x = imu_cal_get_int16(&ptr);
+	rec->accel_offset.y = imu_cal_get_int16(&ptr);
+	rec->accel_offset.z = imu_cal_get_int16(&ptr);
+	for (uint8_t axis = 0; axis < 3; axis++)
+	{
+		rec->gyro_bias_q8[axis] = imu_cal_get_int32(&ptr);
+	}
+	rec->upright.x = imu_cal_get_int16(&ptr);
+	rec->upright.y = imu_cal_get_int16(&ptr);
+	rec->upright.z = imu_cal_get_int16(&ptr);
+	rec->upright_tilt_cdeg = (uint16_t)imu_cal_get_int16(&ptr);
+
+	return 1;
+}
+
+
+/** -------------------------------------------------------------------------------------------
+ * @brief reads the calibration record from flash, seeds the gyro bias estimator with it.
+ * Must be called after the stack has booted.
+ *
+ * @return 1 if a valid record was found
+ *-------------------------------------------------------------------------------------------- **/
+uint8_t imu_cal_load(void)
+{
+
+	memset(&imu_cal, 0, sizeof(imu_cal));
+
+	struct gecko_msg_flash_ps_load_rsp_t *ret = gecko_cmd_flash_ps_load(IMU_CAL_PS_KEY);
+	if (ret->result != 0)
+	{
+		// Nothing stored yet (first boot) is reported as an error too
+		#if INCLUDE_LOGGING
+			LOG_INFO("No IMU calibration in flash: %d", ret->result);
+		#endif
+		return 0;
+	}
+
+	if (imu_cal_deserialize(ret->value.data, ret->value.len) == 0)
+	{
+		#if INCLUDE_LOGGING
+			LOG_ERROR("ERROR: IMU calibration in flash is invalid (len %d, version %d)", ret->value.len, ret->value.data[0]);
+		#endif
+		memset(&imu_cal, 0, sizeof(imu_cal));
+		return 0;
+	}
+
+	gyro_bias_restore(imu_cal.record.gyro_bias_q8);
+	imu_cal.accel_offset_q8[0] = (int32_t)imu_cal.record.accel_offset.x << GYRO_BIAS_FRAC_BITS;
+	imu_cal.accel_offset_q8[1] = (int32_t)imu_cal.record.accel_offset.y << GYRO_BIAS_FRAC_BITS;
+	imu_cal.accel_offset_q8[2] = (int32_t)imu_cal.record.accel_offset.z << GYRO_BIAS_FRAC_BITS;
+	imu_cal.loaded = 1;
+	imu_cal.revalidate_pending = 1;
+
+	return 1;
+
+}
+
+
+/** -------------------------------------------------------------------------------------------
+ * @brief writes imu_cal.record to flash
+ *-------------------------------------------------------------------------------------------- **/
+void imu_cal_save(void)
+{
+	uint8_t buf[IMU_CAL_RECORD_LEN];
+
+	imu_cal_serialize(buf);
+
+	struct gecko_msg_flash_ps_save_rsp_t *ret = gecko_cmd_flash_ps_save(IMU_CAL_PS_KEY, IMU_CAL_RECORD_LEN, buf);
+	if (ret->result != 0)
+	{
+		#if INCLUDE_LOGGING
+			LOG_ERROR("ERROR: %d | response code from gecko_cmd_flash_ps_save()", ret->result);
+		#endif
+		return;
+	}
+
+	imu_cal.loaded = 1;
+
+}
+
+
+/** -------------------------------------------------------------------------------------------
+ * @brief one-sample check of a record loaded at boot. Only acts on the first call after
+ * imu_cal_load(); if the sample does not fit the stored bias the record is dropped and the
+ * gyro bias estimator starts from scratch.
+ *
+ * @return 1 if the stored calibration can be used
+ *-------------------------------------------------------------------------------------------- **/
+uint8_t imu_cal_revalidate(const accel_data_typedef *accel, const gyro_data_typedef *gyro)
+{
+	gyro_data_typedef corrected;
+
+	if (imu_cal.revalidate_pending == 0)
+	{
+		return 0;
+	}
+	imu_cal.revalidate_pending = 0;
+
+	uint32_t accel_mag = cordic_hypot((int32_t)cordic_hypot(accel->x, accel->y), accel->z);
+	gyro_bias_correct(gyro, &corrected);
+
+	if (abs((int32_t)accel_mag - 1000) <= GYRO_BIAS_STILL_ACCEL_MG &&
+		abs(corrected.x) < IMU_CAL_REVALIDATE_RATE_MRAD &&
+		abs(corrected.y) < IMU_CAL_REVALIDATE_RATE_MRAD &&
+		abs(corrected.z) < IMU_CAL_REVALIDATE_RATE_MRAD)
+	{
+		return 1;
+	}
+
+	#if INCLUDE_LOGGING
+		LOG_INFO("Stored IMU calibration rejected, recalibrating");
+	#endif
+
+	imu_cal.loaded = 0;
+	memset(imu_cal.accel_offset_q8, 0, sizeof(imu_cal.accel_offset_q8));
+	gyro_bias_reset();
+
+	return 0;
+}
+
+
+/** -------------------------------------------------------------------------------------------
+ * @brief records the current accelerometer vector as the upright reference together with the
+ * current accelerometer offset and gyro bias and saves the record
+ *-------------------------------------------------------------------------------------------- **/
+void imu_cal_set_upright(const accel_data_typedef *accel)
+{
+
+	imu_cal.record.upright = *accel;
+	imu_cal.record.upright_tilt_cdeg = cordic_tilt_from_vertical_cdeg(accel->x, accel->y, accel->z);
+	imu_cal_update_record();
+
+	imu_cal_save();
+
+}
+
+
+void imu_cal_apply_accel_offset(accel_data_typedef *accel)
+{
+
+	accel->x -= imu_cal_accel_offset_axis(0);
+	accel->y -= imu_cal_accel_offset_axis(1);
+	accel->z -= imu_cal_accel_offset_axis(2);
+
+}
+
+
+/** -------------------------------------------------------------------------------------------
+ * @brief one step of the zero-g offset fit on a still, offset corrected sample: a still sensor
+ * reads 1 g, the magnitude error is taken out along the direction of the sample
+ *-------------------------------------------------------------------------------------------- **/
+void imu_cal_track_accel_offset(const accel_data_typedef *accel)
+{
+	const int32_t max_q8 = IMU_CAL_ACCEL_OFFSET_MAX_MG << GYRO_BIAS_FRAC_BITS;
+	const int16_t axis_mg[3] = {accel->x, accel->y, accel->z};
+	uint32_t mag = cordic_hypot((int32_t)cordic_hypot(accel->x, accel->y), accel->z);
+
+	if (mag == 0)
+	{
+		return;
+	}
+
+	int32_t error = (int32_t)mag - 1000;
+	for (uint8_t axis = 0; axis < 3; axis++)
+	{
+		int32_t step_q8 = error * axis_mg[axis] * (1 << GYRO_BIAS_FRAC_BITS) / (int32_t)mag;
+		int32_t offset = imu_cal.accel_offset_q8[axis] + step_q8 / (1 << IMU_CAL_ACCEL_OFFSET_SHIFT);
+
+		offset = (offset > max_q8) ? max_q8 : offset;
+		offset = (offset < -max_q8) ? -max_q8 : offset;
+		imu_cal.accel_offset_q8[axis] = offset;
+	}
+
+}
+
+
+/** -------------------------------------------------------------------------------------------
+ * @brief rewrites the record when the running gyro bias has drifted IMU_CAL_RESAVE_DELTA_MRAD
+ * or the accelerometer offset IMU_CAL_RESAVE_DELTA_MG away from the stored one, so the next
+ * boot starts from a recent estimate without a flash write on every sample
+ *-------------------------------------------------------------------------------------------- **/
+void imu_cal_track(void)
+{
+	const int32_t delta_q8 = IMU_CAL_RESAVE_DELTA_MRAD << GYRO_BIAS_FRAC_BITS;
+	const int16_t stored_mg[3] = {imu_cal.record.accel_offset.x, imu_cal.record.accel_offset.y, imu_cal.record.accel_offset.z};
+
+	if (imu_cal.loaded == 0 || gyro_bias_is_valid() == 0)
+	{
+		return;
+	}
+
+	for (uint8_t axis = 0; axis < 3; axis++)
+	{
+		if (abs(gyro_bias_state.bias_q8[axis] - imu_cal.record.gyro_bias_q8[axis]) > delta_q8 ||
+			abs(imu_cal_accel_offset_axis(axis) - stored_mg[axis]) > IMU_CAL_RESAVE_DELTA_MG)
+		{
+			imu_cal_update_record();
+			imu_cal_save();
+			return;
+		}
+	}
+}
+
+#endif
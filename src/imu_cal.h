@@ -0,0 +1,80 @@
+/*********************************************************************************************
+ *  @file  imu_cal.h
+ *	@brief IMU calibration record kept in the Bluetooth stack persistent store (flash), so a
+ *		   reset or power cycle does not have to wait for a full bias calibration again.
+ *
+ *		   Record layout (little endian, IMU_CAL_RECORD_LEN bytes):
+ *		     version (1), accel offset x/y/z mg (3 x int16), gyro bias x/y/z millirad/s Q8
+ *		     (3 x int32), upright reference x/y/z mg (3 x int16), upright tilt cdeg (uint16),
+ *		     CRC-16 over all previous bytes (uint16)
+ *
+ *  @authors : Sundar Krishnakumar (GATT server code)
+ *
+ *
+ *  @date      April 29, 2020 (last update)
+ *
+ **********************************************************************************************/
+#include "ble_device_type.h"
+#if BUILD_INCLUDES_BLE_CLIENT
+
+#else
+
+#ifndef __IMU_CAL_H__
+#define __IMU_CAL_H__
+
+#include <stdint.h>
+#include "imu.h"
+
+// PS keys 0x4000 - 0x407F are reserved for the application
+#define IMU_CAL_PS_KEY				(0x4000)
+
+// Increment when the record layout changes, older records are then ignored
+#define IMU_CAL_VERSION				(1)
+#define IMU_CAL_RECORD_LEN			(1 + 6 + 12 + 6 + 2 + 2)
+
+// The stored record is rewritten when the running bias moves this far from it (millirad/s)
+#define IMU_CAL_RESAVE_DELTA_MRAD	(5)
+
+// Accelerometer zero-g offset, fitted on still samples: the offset moves the corrected vector
+// towards 1 g by 2^-IMU_CAL_ACCEL_OFFSET_SHIFT of the magnitude error along its direction. One
+// pose only shows the offset along gravity, the user changing pose fills in the other axes.
+#define IMU_CAL_ACCEL_OFFSET_SHIFT		(5)
+#define IMU_CAL_ACCEL_OFFSET_MAX_MG		(150)
+#define IMU_CAL_RESAVE_DELTA_MG			(5)
+
+// First sample after boot must look like this for the stored record to be trusted:
+// accelerometer magnitude within GYRO_BIAS_STILL_ACCEL_MG of 1 g and every corrected
+// gyro rate below the limit below.
+#define IMU_CAL_REVALIDATE_RATE_MRAD	(100)
+
+typedef struct
+{
+	accel_data_typedef accel_offset;	// zero-g offsets subtracted from accel_data, mg
+	int32_t gyro_bias_q8[3];			// gyro_bias_state.bias_q8 when saved
+	accel_data_typedef upright;			// accelerometer vector with the user sitting upright, mg
+	uint16_t upright_tilt_cdeg;			// tilt of 'upright' from vertical
+
+}imu_cal_record_typedef;
+
+typedef struct
+{
+	imu_cal_record_typedef record;
+	int32_t accel_offset_q8[3];			// running offset estimate, mg Q8
+	uint8_t loaded;						// 1 if flash holds a valid record (loaded or saved)
+	uint8_t revalidate_pending;			// 1 until the first sample after boot was checked
+
+}imu_cal_typedef;
+
+extern imu_cal_typedef imu_cal;
+
+uint8_t imu_cal_load(void);
+void imu_cal_save(void);
+uint8_t imu_cal_revalidate(const accel_data_typedef *accel, const gyro_data_typedef *gyro);
+void imu_cal_set_upright(const accel_data_typedef *accel);
+void imu_cal_apply_accel_offset(accel_data_typedef *accel);
+void imu_cal_track_accel_offset(const accel_data_typedef *accel);
+void imu_cal_track(void);
+
+#endif /* __IMU_CAL_H__ */
+
+#endif
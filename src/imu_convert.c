@@ -0,0 +1,215 @@
+/*********************************************************************************************
+ *  @file imu_convert.c
+ *	@brief Fixed-point conversion kernels for accelerometer and gyroscope samples.
+ *
+ *		   A raw count is converted as  out = trunc(raw * NUM / DEN)  saturated to int16.
+ *		   The multiply by NUM is done on two 16-bit lanes at once (SMUAD against a packed
+ *		   constant), the division by DEN is a multiply-high by a Q32 reciprocal with the
+ *		   sign correction folded into the accumulate operand (SMMLA), and the two results
+ *		   are saturated (SSAT) and re-packed (PKHBT) into one 32-bit store.
+ *
+ *		   The kernels are bit-accurate against imu_convert_accel_reference() (the float
+ *		   expression previously used in FXAS_measure_stop_off_read()) and
+ *		   imu_convert_gyro_reference(). imu_convert_self_test() checks every raw code and
+ *		   reports cycles per triplet measured with the DWT cycle counter.
+ *
+ *  @authors : Sundar Krishnakumar (GATT server code)
+ *
+ *
+ *  @date      April 29, 2020 (last update)
+ *
+ **********************************************************************************************/
+#include "ble_device_type.h"
+#if BUILD_INCLUDES_BLE_CLIENT
+
+#else
+
+#include <string.h>
+#include "imu_convert.h"
+#include "imu.h"
+
+
+// Truncating division of a product by DEN, given ceil(2^32 / DEN).
+// Multiply-high floors, so one is added back for negative products.
+static inline int32_t imu_convert_div(int32_t product, int32_t recip_q32)
+{
+#if defined(__ARM_FEATURE_DSP) && (__ARM_FEATURE_DSP == 1)
+	return __SMMLA(product, recip_q32, (int32_t)((uint32_t)product >> 31));
+#else
+	return (int32_t)(((int64_t)product * recip_q32) >> 32) + (int32_t)((uint32_t)product >> 31);
+#endif
+}
+
+static inline int16_t imu_convert_saturate(int32_t value)
+{
+#if defined(__ARM_FEATURE_DSP) && (__ARM_FEATURE_DSP == 1)
+	return (int16_t)__SSAT(value, 16);
+#else
+	if (value > INT16_MAX)
+	{
+		return INT16_MAX;
+	}
+	if (value < INT16_MIN)
+	{
+		return INT16_MIN;
+	}
+	return (int16_t)value;
+#endif
+}
+
+
+static void imu_convert_block(const int16_t *raw, int16_t *out, uint32_t n_values, int32_t num, int32_t recip_q32)
+{
+	uint32_t i = 0;
+
+#if defined(__ARM_FEATURE_DSP) && (__ARM_FEATURE_DSP == 1)
+	const uint32_t k_bottom = (uint32_t)num;		// multiplies the low lane only
+	const uint32_t k_top    = (uint32_t)num << 16;	// multiplies the high lane only
+
+	for (; (i + 1) < n_values; i += 2)
+	{
+		uint32_t pair;
+		memcpy(&pair, &raw[i], sizeof(pair)); // single LDR, buffers are not required to be word aligned
+
+		int32_t lo = imu_convert_div((int32_t)__SMUAD(pair, k_bottom), recip_q32);
+		int32_t hi = imu_convert_div((int32_t)__SMUAD(pair, k_top), recip_q32);
+
+		pair = __PKHBT(__SSAT(lo, 16), __SSAT(hi, 16), 16);
+		memcpy(&out[i], &pair, sizeof(pair));
+	}
+#endif
+
+	// Odd tail (or the whole block without the DSP extension)
+	for (; i < n_values; i++)
+	{
+		out[i] = imu_convert_saturate(imu_convert_div((int32_t)raw[i] * num, recip_q32));
+	}
+
+}
+
+
+// Raw 14-bit accelerometer counts (+/-4g) to milli-g
+void imu_convert_accel_block(const int16_t *raw, int16_t *out, uint16_t count)
+{
+
+	imu_convert_block(raw, out, (uint32_t)count * 3, ACCEL_4G_MG_NUM, ACCEL_4G_MG_DEN_RECIP_Q32);
+
+}
+
+
+// Raw 16-bit gyroscope counts (+/-2000dps) to millirad/s
+void imu_convert_gyro_block(const int16_t *raw, int16_t *out, uint16_t count)
+{
+
+	imu_convert_block(raw, out, (uint32_t)count * 3, GYRO_2000DPS_MRAD_NUM, GYRO_2000DPS_MRAD_DEN_RECIP_Q32);
+
+}
+
+
+// Float conversion as done before the fixed-point kernels existed.
+// 0.488F is slightly above 61/125, so the truncated result equals trunc(raw * 61 / 125).
+int16_t imu_convert_accel_reference(int16_t raw)
+{
+
+	return (int16_t)(raw * ACCEL_MG_LSB_4G);
+
+}
+
+
+// The float constants GYRO_SENSITIVITY_2000DPS * FXAS21002C_MDPS_TO_MRAD are 349/320.
+// The old two-step float conversion truncated (and wrapped) the intermediate mdps value
+// into an int16 above ~32 dps, so the reference is the exact single-step ratio instead.
+int16_t imu_convert_gyro_reference(int16_t raw)
+{
+	int32_t value = ((int32_t)raw * GYRO_2000DPS_MRAD_NUM) / GYRO_2000DPS_MRAD_DEN;
+
+	if (value > INT16_MAX)
+	{
+		value = INT16_MAX;
+	}
+	if (value < INT16_MIN)
+	{
+		value = INT16_MIN;
+	}
+
+	return (int16_t)value;
+
+}
+
+
+// Checks the kernels against the references for every raw code and logs the
+// cycles per XYZ triplet for the kernel and for the float reference.
+// Not called during normal operation, enable the call in appMain() to run it.
+void imu_convert_self_test(void)
+{
+	int16_t raw[IMU_CONVERT_TEST_BLOCK_LEN * 3];
+	int16_t out[IMU_CONVERT_TEST_BLOCK_LEN * 3];
+	uint32_t accel_mismatch = 0;
+	uint32_t gyro_mismatch = 0;
+	uint32_t kernel_cycles = 0;
+	uint32_t reference_cycles = 0;
+	uint32_t triplets = 0;
+	uint32_t start;
+
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CYCCNT = 0;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+	// Accelerometer, 14-bit range
+	for (int32_t base = -8192; base < 8192; base += IMU_CONVERT_TEST_BLOCK_LEN * 3)
+	{
+		for (int i = 0; i < IMU_CONVERT_TEST_BLOCK_LEN * 3; i++)
+		{
+			raw[i] = (int16_t)((base + i) > 8191 ? 8191 : (base + i));
+		}
+
+		start = DWT->CYCCNT;
+		imu_convert_accel_block(raw, out, IMU_CONVERT_TEST_BLOCK_LEN);
+		kernel_cycles += DWT->CYCCNT - start;
+
+		start = DWT->CYCCNT;
+		for (int i = 0; i < IMU_CONVERT_TEST_BLOCK_LEN * 3; i++)
+		{
+			if (out[i] != imu_convert_accel_reference(raw[i]))
+			{
+				accel_mismatch++;
+			}
+		}
+		reference_cycles += DWT->CYCCNT - start;
+		triplets += IMU_CONVERT_TEST_BLOCK_LEN;
+	}
+
+	// Gyroscope, full 16-bit range
+	for (int32_t base = INT16_MIN; base <= INT16_MAX; base += IMU_CONVERT_TEST_BLOCK_LEN * 3)
+	{
+		for (int i = 0; i < IMU_CONVERT_TEST_BLOCK_LEN * 3; i++)
+		{
+			raw[i] = (int16_t)((base + i) > INT16_MAX ? INT16_MAX : (base + i));
+		}
+
+		imu_convert_gyro_block(raw, out, IMU_CONVERT_TEST_BLOCK_LEN);
+
+		for (int i = 0; i < IMU_CONVERT_TEST_BLOCK_LEN * 3; i++)
+		{
+			if (out[i] != imu_convert_gyro_reference(raw[i]))
+			{
+				gyro_mismatch++;
+			}
+		}
+	}
+
+	#if INCLUDE_LOGGING
+		LOG_INFO("imu_convert: accel mismatches %lu, gyro mismatches %lu, %lu cycles/triplet fixed-point, "
+				"%lu cycles/triplet float (incl. compare)",
+				accel_mismatch, gyro_mismatch, kernel_cycles / triplets, reference_cycles / triplets);
+	#else
+		(void)accel_mismatch;
+		(void)gyro_mismatch;
+		(void)kernel_cycles;
+		(void)reference_cycles;
+		(void)triplets;
+	#endif
+
+}
+
+#endif
@@ -0,0 +1,51 @@
+/*********************************************************************************************
+ *  @file  imu_convert.h
+ *	@brief Fixed-point conversion of raw FXOS8700 / FXAS21002C counts to engineering units.
+ *		   Converts whole blocks of XYZ triplets using the Cortex-M4 DSP (packed 16-bit SIMD)
+ *		   instructions, with a plain C fallback for builds without the DSP extension.
+ *
+ *  @authors : Sundar Krishnakumar (GATT server code)
+ *
+ *
+ *  @date      April 29, 2020 (last update)
+ *
+ **********************************************************************************************/
+#include "ble_device_type.h"
+#if BUILD_INCLUDES_BLE_CLIENT
+
+#else
+
+#ifndef __IMU_CONVERT_H__
+#define __IMU_CONVERT_H__
+
+#include <stdint.h>
+#include "em_device.h"
+
+// Accelerometer, +/-4g: 0.488 mg/LSB == 61/125 mg/LSB
+#define ACCEL_4G_MG_NUM				(61)
+#define ACCEL_4G_MG_DEN				(125)
+
+// Gyroscope, +/-2000dps: 62.5 mdps/LSB * 0.01745 mrad/mdeg == 349/320 mrad/s per LSB
+#define GYRO_2000DPS_MRAD_NUM		(349)
+#define GYRO_2000DPS_MRAD_DEN		(320)
+
+// Reciprocals of the denominators in Q32 (rounded up). Multiply-high by these is an exact
+// truncating division for every product of a 16-bit raw count and the numerator above.
+#define ACCEL_4G_MG_DEN_RECIP_Q32		(34359739)	// ceil(2^32 / 125)
+#define GYRO_2000DPS_MRAD_DEN_RECIP_Q32	(13421773)	// ceil(2^32 / 320)
+
+// Number of XYZ triplets converted per block in imu_convert_self_test()
+#define IMU_CONVERT_TEST_BLOCK_LEN	(32)
+
+// raw: 'count' interleaved XYZ triplets (3 * count int16). out may alias raw.
+void imu_convert_accel_block(const int16_t *raw, int16_t *out, uint16_t count);
+void imu_convert_gyro_block(const int16_t *raw, int16_t *out, uint16_t count);
+
+int16_t imu_convert_accel_reference(int16_t raw);
+int16_t imu_convert_gyro_reference(int16_t raw);
+
+void imu_convert_self_test(void);
+
+#endif /* __IMU_CONVERT_H__ */
+
+#endif
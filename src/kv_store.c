@@ -0,0 +1,638 @@
+/*********************************************************************************************
+ *  @file kv_store.c
+ *	@brief Log-structured key-value store, see kv_store.h for the flash layout.
+ *
+ *		   Invariant: the page following the active page in the ring is always erased, so
+ *		   advancing to a new page never needs an erase before the first write. At boot an
+ *		   interrupted garbage collection (that page still holds data) is finished first.
+ *
+ *  @authors : Rajat Chaple (GATT client code)
+ *  		   Sundar Krishnakumar (GATT server code)
+ *
+ *  @date      April 29, 2020 (last update)
+ **********************************************************************************************/
+
+#include <string.h>
+#include "kv_store.h"
+#include "crc16.h"
+#include "log.h"
+#include "em_device.h"
+#include "em_msc.h"
+
+
+#define KV_ALIGN4(n)			(((n) + 3u) & ~3u)
+#define KV_RECORD_LEN(len)		(KV_RECORD_HEADER_LEN + KV_ALIGN4(len))
+
+
+static uint32_t kv_page_addr(const kv_store_t *store, uint8_t page)
+{
+	return store->base + (uint32_t)page * store->page_size;
+}
+
+static uint8_t kv_next_page(const kv_store_t *store, uint8_t page)
+{
+	return (uint8_t)((page + 1) % store->page_count);
+}
+
+static uint8_t kv_page_of(const kv_store_t *store, uint32_t addr)
+{
+	return (uint8_t)((addr - store->base) / store->page_size);
+}
+
+static uint32_t kv_read_word(const kv_store_t *store, uint32_t addr)
+{
+	uint32_t word;
+
+	store->ops->read(addr, &word, sizeof(word));
+	return word;
+}
+
+static uint16_t kv_record_crc(uint8_t key, uint8_t len, const uint8_t *value)
+{
+	uint8_t hdr[2] = { key, len };
+	uint16_t crc = crc16_update(CRC16_INIT, hdr, sizeof(hdr));
+
+	return crc16_update(crc, value, len);
+}
+
+// Sequence number of a formatted page, 0 if the page has no valid header
+static uint32_t kv_page_seq(const kv_store_t *store, uint8_t page)
+{
+	uint32_t hdr[2];
+
+	store->ops->read(kv_page_addr(store, page), hdr, sizeof(hdr));
+	if (hdr[0] != KV_PAGE_MAGIC || hdr[1] == KV_ERASED_WORD || hdr[1] == 0)
+	{
+		return 0;
+	}
+	return hdr[1];
+}
+
+static uint8_t kv_page_is_blank(const kv_store_t *store, uint8_t page)
+{
+	uint32_t addr = kv_page_addr(store, page);
+
+	for (uint32_t offset = 0; offset < store->page_size; offset += 4)
+	{
+		if (kv_read_word(store, addr + offset) != KV_ERASED_WORD)
+		{
+			return 0;
+		}
+	}
+	return 1;
+}
+
+static kv_status_t kv_erase(kv_store_t *store, uint8_t page)
+{
+	store->stats.page_erases++;
+	return store->ops->erase_page(kv_page_addr(store, page));
+}
+
+static kv_status_t kv_program(kv_store_t *store, uint32_t addr, const void *buf, uint32_t len)
+{
+	store->stats.flash_bytes += len;
+	return store->ops->write(addr, buf, len);
+}
+
+static kv_status_t kv_format_page(kv_store_t *store, uint8_t page, uint32_t seq)
+{
+	uint32_t hdr[2] = { KV_PAGE_MAGIC, seq };
+	kv_status_t status = kv_program(store, kv_page_addr(store, page), hdr, sizeof(hdr));
+
+	store->active_page = page;
+	store->active_seq = seq;
+	store->write_offset = KV_PAGE_HEADER_LEN;
+
+	return status;
+}
+
+
+// Replays one page into the index. For the active page the end of the log is
+// recorded as the write offset.
+static void kv_replay_page(kv_store_t *store, uint8_t page)
+{
+	uint32_t addr = kv_page_addr(store, page);
+	uint32_t offset = KV_PAGE_HEADER_LEN;
+	uint8_t value[KV_MAX_VALUE_LEN];
+
+	while (offset + KV_RECORD_HEADER_LEN <= store->page_size)
+	{
+		uint32_t hdr = kv_read_word(store, addr + offset);
+
+		if (hdr == KV_ERASED_WORD)
+		{
+			break;
+		}
+
+		uint8_t key = (uint8_t)hdr;
+		uint8_t len = (uint8_t)(hdr >> 8);
+		uint16_t crc = (uint16_t)(hdr >> 16);
+
+		if (len > KV_MAX_VALUE_LEN || offset + KV_RECORD_LEN(len) > store->page_size)
+		{
+			// Damaged header, the rest of this page cannot be parsed
+			offset = store->page_size;
+			break;
+		}
+
+		store->ops->read(addr + offset + KV_RECORD_HEADER_LEN, value, len);
+
+		if (key < KV_MAX_KEYS && crc == kv_record_crc(key, len, value))
+		{
+			store->index[key] = (len == 0) ? 0 : (addr + offset);
+			store->stats.boot_records++;
+		}
+
+		offset += KV_RECORD_LEN(len);
+	}
+
+	if (page == store->active_page)
+	{
+		store->write_offset = offset;
+	}
+}
+
+
+// Copies the live records of 'page' to the active page and erases it. Every live record is
+// copied, also the one about to be rewritten: until its new record is programmed the copy is
+// the only one left.
+static kv_status_t kv_collect_page(kv_store_t *store, uint8_t page)
+{
+	uint32_t record[(KV_RECORD_HEADER_LEN + KV_MAX_VALUE_LEN) / 4];
+
+	for (uint8_t key = 0; key < KV_MAX_KEYS; key++)
+	{
+		uint32_t src = store->index[key];
+
+		if (src == 0 || kv_page_of(store, src) != page)
+		{
+			continue;
+		}
+
+		uint8_t len = (uint8_t)(kv_read_word(store, src) >> 8);
+		uint32_t record_len = KV_RECORD_LEN(len);
+
+		if (store->write_offset + record_len > store->page_size)
+		{
+			return KV_ERR_FULL;
+		}
+
+		store->ops->read(src, record, record_len);
+
+		uint32_t dst = kv_page_addr(store, store->active_page) + store->write_offset;
+		if (kv_program(store, dst, record, record_len) != KV_OK)
+		{
+			return KV_ERR_FLASH;
+		}
+
+		store->stats.gc_bytes += record_len;
+		store->index[key] = dst;
+		store->write_offset += record_len;
+	}
+
+	return kv_erase(store, page);
+}
+
+
+// Moves to the next (erased) page and reclaims the oldest page behind it
+static kv_status_t kv_advance_page(kv_store_t *store)
+{
+	uint8_t next = kv_next_page(store, store->active_page);
+	kv_status_t status = kv_format_page(store, next, store->active_seq + 1);
+
+	if (status != KV_OK)
+	{
+		return status;
+	}
+
+	uint8_t oldest = kv_next_page(store, next);
+	if (kv_page_seq(store, oldest) != 0 || !kv_page_is_blank(store, oldest))
+	{
+		status = kv_collect_page(store, oldest);
+	}
+
+	return status;
+}
+
+
+/** -------------------------------------------------------------------------------------------
+ * @brief mounts the store, formatting it if no page is valid, and rebuilds the RAM index
+ *
+ * @param base : address of the first page, page_size : erase unit, page_count : 2..KV_MAX_PAGES
+ * @return KV_OK or error code
+ *-------------------------------------------------------------------------------------------- **/
+kv_status_t kv_store_init(kv_store_t *store, const kv_flash_ops_t *ops, uint32_t base, uint32_t page_size, uint8_t page_count)
+{
+	uint32_t seq[KV_MAX_PAGES];
+	uint8_t active = 0;
+	uint8_t found = 0;
+
+	if (page_count < 2 || page_count > KV_MAX_PAGES || (page_size & 3u) != 0)
+	{
+		return KV_ERR_PARAM;
+	}
+
+	memset(store, 0, sizeof(*store));
+	store->ops = ops;
+	store->base = base;
+	store->page_size = page_size;
+	store->page_count = page_count;
+
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+	uint32_t start = DWT->CYCCNT;
+
+	for (uint8_t page = 0; page < page_count; page++)
+	{
+		seq[page] = kv_page_seq(store, page);
+		if (seq[page] != 0 && (found == 0 || seq[page] > seq[active]))
+		{
+			active = page;
+			found = 1;
+		}
+	}
+
+	if (found == 0)
+	{
+		for (uint8_t page = 0; page < page_count; page++)
+		{
+			if (!kv_page_is_blank(store, page) && kv_erase(store, page) != KV_OK)
+			{
+				return KV_ERR_FLASH;
+			}
+		}
+		return kv_format_page(store, 0, 1);
+	}
+
+	store->active_page = active;
+	store->active_seq = seq[active];
+
+	// Oldest first: the pages behind the active one in ring order. Only pages whose
+	// sequence numbers are consecutive belong to the current log.
+	for (uint8_t back = page_count - 1; back > 0; back--)
+	{
+		uint8_t page = (uint8_t)((active + page_count - back) % page_count);
+
+		if (seq[page] != 0 && seq[active] - seq[page] == back)
+		{
+			kv_replay_page(store, page);
+		}
+	}
+	kv_replay_page(store, active);
+
+	// Restore the invariant that the page after the active one is erased
+	uint8_t spare = kv_next_page(store, active);
+	kv_status_t status = KV_OK;
+
+	if (seq[spare] != 0 && seq[active] - seq[spare] == (uint32_t)(page_count - 1))
+	{
+		// Garbage collection was interrupted before the erase
+		status = kv_collect_page(store, spare);
+	}
+	else if (!kv_page_is_blank(store, spare))
+	{
+		status = kv_erase(store, spare);
+	}
+
+	store->stats.boot_cycles = DWT->CYCCNT - start;
+
+	return status;
+}
+
+
+/** -------------------------------------------------------------------------------------------
+ * @brief reads the current value of a key
+ *
+ * @param buf/buf_len : destination, value_len : length of the stored value (may be NULL)
+ * @return KV_OK, KV_ERR_NOT_FOUND, or KV_ERR_PARAM if buf is too small
+ *-------------------------------------------------------------------------------------------- **/
+kv_status_t kv_store_get(kv_store_t *store, uint8_t key, void *buf, uint8_t buf_len, uint8_t *value_len)
+{
+	if (key >= KV_MAX_KEYS)
+	{
+		return KV_ERR_PARAM;
+	}
+
+	uint32_t addr = store->index[key];
+	if (addr == 0)
+	{
+		return KV_ERR_NOT_FOUND;
+	}
+
+	uint8_t len = (uint8_t)(kv_read_word(store, addr) >> 8);
+	if (value_len != NULL)
+	{
+		*value_len = len;
+	}
+	if (len > buf_len)
+	{
+		return KV_ERR_PARAM;
+	}
+
+	store->ops->read(addr + KV_RECORD_HEADER_LEN, buf, len);
+
+	return KV_OK;
+}
+
+
+static kv_status_t kv_append(kv_store_t *store, uint8_t key, const void *value, uint8_t len)
+{
+	uint32_t record[(KV_RECORD_HEADER_LEN + KV_MAX_VALUE_LEN) / 4];
+	uint32_t record_len = KV_RECORD_LEN(len);
+	kv_status_t status;
+
+	if (store->write_offset + record_len > store->page_size)
+	{
+		status = kv_advance_page(store);
+		if (status != KV_OK)
+		{
+			return status;
+		}
+		if (store->write_offset + record_len > store->page_size)
+		{
+			return KV_ERR_FULL;
+		}
+	}
+
+	memset(record, 0xFF, record_len);
+	if (len != 0)
+	{
+		memcpy(&record[1], value, len);
+	}
+	record[0] = (uint32_t)key | ((uint32_t)len << 8) | ((uint32_t)kv_record_crc(key, len, (const uint8_t *)value) << 16);
+
+	uint32_t addr = kv_page_addr(store, store->active_page) + store->write_offset;
+	store->write_offset += record_len;
+
+	status = kv_program(store, addr, record, record_len);
+	if (status != KV_OK)
+	{
+		return status;
+	}
+
+	store->index[key] = (len == 0) ? 0 : addr;
+	store->stats.user_bytes += len;
+
+	return KV_OK;
+}
+
+
+/** -------------------------------------------------------------------------------------------
+ * @brief stores a value. Writing the value already stored is a no-op (no flash wear).
+ *
+ * @return KV_OK or error code. On error the previous value is still returned by kv_store_get().
+ *-------------------------------------------------------------------------------------------- **/
+kv_status_t kv_store_set(kv_store_t *store, uint8_t key, const void *value, uint8_t len)
+{
+	uint8_t current[KV_MAX_VALUE_LEN];
+	uint8_t current_len;
+
+	if (key >= KV_MAX_KEYS || len == 0 || len > KV_MAX_VALUE_LEN)
+	{
+		return KV_ERR_PARAM;
+	}
+
+	if (kv_store_get(store, key, current, sizeof(current), &current_len) == KV_OK &&
+		current_len == len && memcmp(current, value, len) == 0)
+	{
+		return KV_OK;
+	}
+
+	return kv_append(store, key, value, len);
+}
+
+
+kv_status_t kv_store_delete(kv_store_t *store, uint8_t key)
+{
+	if (key >= KV_MAX_KEYS)
+	{
+		return KV_ERR_PARAM;
+	}
+
+	if (store->index[key] == 0)
+	{
+		return KV_OK;
+	}
+
+	return kv_append(store, key, NULL, 0);
+}
+
+
+////////////////////////////////////////////// Flash backends ///////////////////////////////////////////////////////////////
+
+static void kv_flash_mapped_read(uint32_t addr, void *buf, uint32_t len)
+{
+	memcpy(buf, (const void *)addr, len);
+}
+
+static kv_status_t kv_flash_msc_write(uint32_t addr, const void *buf, uint32_t len)
+{
+	return (MSC_WriteWord((uint32_t *)addr, buf, len) == mscReturnOk) ? KV_OK : KV_ERR_FLASH;
+}
+
+static kv_status_t kv_flash_msc_erase(uint32_t addr)
+{
+	return (MSC_ErasePage((uint32_t *)addr) == mscReturnOk) ? KV_OK : KV_ERR_FLASH;
+}
+
+// MSC_Init() must have been called
+const kv_flash_ops_t kv_flash_msc_ops = {
+	.read = kv_flash_mapped_read,
+	.write = kv_flash_msc_write,
+	.erase_page = kv_flash_msc_erase
+};
+
+
+#if KV_STORE_SELF_TEST
+
+// RAM flash simulator for kv_store_self_test(): programming can only clear bits,
+// like the real array, so a write to a location that was not erased shows up as
+// a CRC error instead of silently working. kv_sim_ops_left cuts the power: once it
+// reaches 0 every write and erase fails without touching the array.
+#define KV_SIM_PAGE_SIZE		(512)
+#define KV_SIM_PAGE_COUNT		(4)
+#define KV_SIM_POWER_ON			(0xFFFFFFFF)
+
+static uint32_t kv_sim_flash[KV_SIM_PAGE_SIZE * KV_SIM_PAGE_COUNT / 4];
+static uint32_t kv_sim_ops_left = KV_SIM_POWER_ON;
+
+static uint8_t kv_flash_sim_power(void)
+{
+	if (kv_sim_ops_left == 0)
+	{
+		return 0;
+	}
+	if (kv_sim_ops_left != KV_SIM_POWER_ON)
+	{
+		kv_sim_ops_left--;
+	}
+	return 1;
+}
+
+static kv_status_t kv_flash_sim_write(uint32_t addr, const void *buf, uint32_t len)
+{
+	uint32_t *dst = (uint32_t *)addr;
+	const uint8_t *src = buf;
+
+	if (kv_flash_sim_power() == 0)
+	{
+		return KV_ERR_FLASH;
+	}
+
+	for (uint32_t i = 0; i < len / 4; i++)
+	{
+		uint32_t word;
+		memcpy(&word, &src[i * 4], sizeof(word));
+		dst[i] &= word;
+	}
+	return KV_OK;
+}
+
+static kv_status_t kv_flash_sim_erase(uint32_t addr)
+{
+	if (kv_flash_sim_power() == 0)
+	{
+		return KV_ERR_FLASH;
+	}
+	memset((void *)addr, 0xFF, KV_SIM_PAGE_SIZE);
+	return KV_OK;
+}
+
+static const kv_flash_ops_t kv_flash_sim_ops = {
+	.read = kv_flash_mapped_read,
+	.write = kv_flash_sim_write,
+	.erase_page = kv_flash_sim_erase
+};
+
+
+// Update that starts the first garbage collection of an empty simulator, one word per value
+#define KV_SIM_FIRST_GC			((KV_SIM_PAGE_COUNT - 1) * ((KV_SIM_PAGE_SIZE - KV_PAGE_HEADER_LEN) / KV_RECORD_LEN(4)))
+
+/** -------------------------------------------------------------------------------------------
+ * @brief power cut after 'cut' flash operations, counted from a few updates before the first
+ * garbage collection. Key 3 is written first and next by the update that starts the
+ * collection, so its only record is on the page being reclaimed. The update that fails must
+ * leave its key at the old value, before and after the reboot, and every other key untouched.
+ *
+ * @return number of keys holding a wrong value
+ *-------------------------------------------------------------------------------------------- **/
+static uint32_t kv_store_power_cut(uint32_t cut)
+{
+	kv_store_t store;
+	uint32_t expect[4] = { 0 };
+	uint32_t errors = 0;
+	uint8_t cut_key = KV_MAX_KEYS;
+	uint32_t attempt = 0;
+
+	memset(kv_sim_flash, 0xFF, sizeof(kv_sim_flash));
+	kv_sim_ops_left = KV_SIM_POWER_ON;
+	kv_store_init(&store, &kv_flash_sim_ops, (uint32_t)kv_sim_flash, KV_SIM_PAGE_SIZE, KV_SIM_PAGE_COUNT);
+
+	for (uint32_t i = 0; i <= KV_SIM_FIRST_GC + 10; i++)
+	{
+		uint8_t key = (i % KV_SIM_FIRST_GC == 0) ? 3 : (uint8_t)(i % 3);
+		uint32_t value = i + 1;
+
+		if (i == KV_SIM_FIRST_GC - 8)
+		{
+			kv_sim_ops_left = cut;
+		}
+		if (kv_store_set(&store, key, &value, sizeof(value)) != KV_OK)
+		{
+			cut_key = key;
+			attempt = value;
+			break;
+		}
+		expect[key] = value;
+	}
+
+	// Reads in the same session, then after the reboot
+	for (uint8_t boot = 0; boot < 2; boot++)
+	{
+		if (boot == 1)
+		{
+			kv_sim_ops_left = KV_SIM_POWER_ON;
+			kv_store_init(&store, &kv_flash_sim_ops, (uint32_t)kv_sim_flash, KV_SIM_PAGE_SIZE, KV_SIM_PAGE_COUNT);
+		}
+		for (uint8_t key = 0; key < 4; key++)
+		{
+			uint32_t value = 0;
+
+			if (kv_store_get(&store, key, &value, sizeof(value), NULL) != KV_OK ||
+				(value != expect[key] && (key != cut_key || boot == 0 || value != attempt)))
+			{
+				errors++;
+			}
+		}
+	}
+
+	return errors;
+}
+
+
+/** -------------------------------------------------------------------------------------------
+ * @brief exercises the store on the RAM simulator: repeated updates of a few settings with
+ * reboots (index rebuilds) in between. Logs errors, write amplification, erases per page and
+ * the boot index rebuild cost. Not called during normal operation.
+ *-------------------------------------------------------------------------------------------- **/
+void kv_store_self_test(void)
+{
+	kv_store_t store;
+	uint32_t expect[4] = { 0 };
+	uint32_t errors = 0;
+	uint32_t user_bytes = 0;
+	uint32_t flash_bytes = 0;
+	uint32_t erases = 0;
+	uint32_t cut_errors = 0;
+
+	memset(kv_sim_flash, 0xFF, sizeof(kv_sim_flash));
+
+	for (uint32_t boot = 0; boot < 20; boot++)
+	{
+		kv_store_init(&store, &kv_flash_sim_ops, (uint32_t)kv_sim_flash, KV_SIM_PAGE_SIZE, KV_SIM_PAGE_COUNT);
+
+		for (uint8_t key = 0; key < 4; key++)
+		{
+			uint32_t value;
+			if (expect[key] != 0 && (kv_store_get(&store, key, &value, sizeof(value), NULL) != KV_OK || value != expect[key]))
+			{
+				errors++;
+			}
+		}
+
+		for (uint32_t i = 0; i < 50; i++)
+		{
+			uint8_t key = (uint8_t)(i % 4);
+			expect[key] = boot * 1000 + i + 1;
+			if (kv_store_set(&store, key, &expect[key], sizeof(expect[key])) != KV_OK)
+			{
+				errors++;
+			}
+		}
+
+		user_bytes += store.stats.user_bytes;
+		flash_bytes += store.stats.flash_bytes;
+		erases += store.stats.page_erases;
+	}
+
+	for (uint32_t cut = 0; cut < 32; cut++)
+	{
+		cut_errors += kv_store_power_cut(cut);
+	}
+
+	#if INCLUDE_LOGGING
+		LOG_INFO("kv_store: %lu errors, write amplification %lu.%02lu, %lu erases, "
+				"boot index rebuild %lu records, %lu cycles, %lu errors after power cuts",
+				errors, flash_bytes / user_bytes, (flash_bytes % user_bytes) * 100 / user_bytes, erases,
+				store.stats.boot_records, store.stats.boot_cycles, cut_errors);
+	#else
+		(void)errors;
+		(void)user_bytes;
+		(void)flash_bytes;
+		(void)erases;
+		(void)cut_errors;
+	#endif
+}
+
+#endif
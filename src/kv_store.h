@@ -0,0 +1,103 @@
+/*********************************************************************************************
+ *  @file  kv_store.h
+ *	@brief Log-structured, wear-leveled key-value store over flash pages.
+ *
+ *		   Every update is appended to the active page, the newest valid record of a key
+ *		   wins. A RAM index (one flash address per key) is rebuilt at boot by replaying the
+ *		   pages in sequence order, so lookups are O(1). When the active page is full the
+ *		   next page in the ring becomes active, the live records of the oldest page are
+ *		   copied into it and the oldest page is erased (garbage collection). All pages are
+ *		   erased in turn, which spreads the wear evenly.
+ *
+ *		   Page layout : magic (uint32), sequence (uint32), records...
+ *		   Record      : key (uint8), len (uint8), crc16 (uint16) over key/len/value,
+ *		                 value padded to a word. An all-ones header word ends the log.
+ *
+ *		   A record is only visible once its CRC matches, so an update interrupted by a reset
+ *		   leaves the previous value in place.
+ *
+ *  @authors : Rajat Chaple (GATT client code)
+ *  		   Sundar Krishnakumar (GATT server code)
+ *
+ *  @date      April 29, 2020 (last update)
+ **********************************************************************************************/
+
+#ifndef __KV_STORE_H__
+#define __KV_STORE_H__
+
+#include <stdint.h>
+
+// 1: builds kv_store_self_test() and its RAM flash simulator
+#ifndef KV_STORE_SELF_TEST
+#define KV_STORE_SELF_TEST		(0)
+#endif
+
+#define KV_MAX_KEYS				(16)
+#define KV_MAX_VALUE_LEN		(64)
+#define KV_MAX_PAGES			(8)
+
+#define KV_PAGE_MAGIC			(0x3153564B)	// "KVS1"
+#define KV_PAGE_HEADER_LEN		(8)
+#define KV_RECORD_HEADER_LEN	(4)
+#define KV_ERASED_WORD			(0xFFFFFFFF)
+
+typedef enum
+{
+	KV_OK = 0,
+	KV_ERR_PARAM,
+	KV_ERR_NOT_FOUND,
+	KV_ERR_FULL,
+	KV_ERR_FLASH
+
+}kv_status_t;
+
+// Flash access. Addresses are absolute, writes are whole words to erased locations.
+typedef struct kv_flash_ops_s
+{
+	void (*read)(uint32_t addr, void *buf, uint32_t len);
+	kv_status_t (*write)(uint32_t addr, const void *buf, uint32_t len);
+	kv_status_t (*erase_page)(uint32_t addr);
+
+}kv_flash_ops_t;
+
+// Counters for boot cost and write amplification (flash_bytes / user_bytes)
+typedef struct kv_stats_s
+{
+	uint32_t boot_records;		// records replayed by the last kv_store_init()
+	uint32_t boot_cycles;		// DWT cycles taken by the last kv_store_init()
+	uint32_t user_bytes;		// value bytes passed to kv_store_set()
+	uint32_t flash_bytes;		// bytes programmed, including headers, padding and GC copies
+	uint32_t gc_bytes;			// part of flash_bytes spent copying live records
+	uint32_t page_erases;
+
+}kv_stats_t;
+
+typedef struct kv_store_s
+{
+	const kv_flash_ops_t *ops;
+	uint32_t base;
+	uint32_t page_size;
+	uint8_t page_count;
+
+	uint8_t active_page;
+	uint32_t active_seq;
+	uint32_t write_offset;		// next free byte in the active page
+	uint32_t index[KV_MAX_KEYS];	// address of the newest record per key, 0 = not stored
+
+	kv_stats_t stats;
+
+}kv_store_t;
+
+kv_status_t kv_store_init(kv_store_t *store, const kv_flash_ops_t *ops, uint32_t base, uint32_t page_size, uint8_t page_count);
+kv_status_t kv_store_get(kv_store_t *store, uint8_t key, void *buf, uint8_t buf_len, uint8_t *value_len);
+kv_status_t kv_store_set(kv_store_t *store, uint8_t key, const void *value, uint8_t len);
+kv_status_t kv_store_delete(kv_store_t *store, uint8_t key);
+
+// Internal flash (MSC) backend
+extern const kv_flash_ops_t kv_flash_msc_ops;
+
+#if KV_STORE_SELF_TEST
+void kv_store_self_test(void);
+#endif
+
+#endif /* __KV_STORE_H__ */
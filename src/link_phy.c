@@ -0,0 +1,216 @@
+/*********************************************************************************************
+ *  @file link_phy.c
+ *	@brief 2M PHY with a fallback to 1M on a weak link, data length and radio-on time per KB
+ *		   of the connections, see link_phy.h.
+ *
+ *  @authors : Rajat Chaple (GATT client code)
+ *  		   Sundar Krishnakumar (GATT server code)
+ *
+ *  @date      April 29, 2020 (last update)
+ **********************************************************************************************/
+#include "ble_device_type.h"
+#include "link_phy.h"
+#include "native_gecko.h"
+#include "gecko_ble_errors.h"
+#include "history.h"
+#include "log.h"
+
+
+// L2CAP and ATT notification headers in front of the value
+#define LINK_PHY_VALUE_OVERHEAD		(4 + 3)
+// Access address, LL header, MIC (the links are encrypted) and CRC, the preamble depends on the PHY
+#define LINK_PHY_PDU_OVERHEAD		(4 + 2 + 4 + 3)
+#define LINK_PHY_EMPTY_PDU			(4 + 2 + 3)
+#define LINK_PHY_T_IFS_US			(150)
+
+link_phy_stats_t link_phy_stats;
+
+static link_phy_link_t link_phy_link[LINK_PHY_LINKS];
+
+
+static uint32_t link_phy_ms_since(uint32_t ticks)
+{
+	return (uint32_t)((uint64_t)(history_time_ticks() - ticks) * 1000 / HISTORY_TIMER_FREQ);
+}
+
+static void link_phy_request(link_phy_link_t *l, uint8_t phy)
+{
+
+	struct gecko_msg_le_connection_set_phy_rsp_t *ret = gecko_cmd_le_connection_set_phy(l->connection, phy);
+	if (ret->result != 0)
+	{
+		#if INCLUDE_LOGGING
+			LOG_ERROR("ERROR: %d | response code from gecko_cmd_le_connection_set_phy()", ret->result);
+		#endif
+		return;
+	}
+	l->requested = phy;
+	l->change_ticks = history_time_ticks();
+
+}
+
+void link_phy_connection_opened(uint8_t link, uint8_t connection)
+{
+	link_phy_link_t *l = &link_phy_link[link];
+
+	l->connected = true;
+	l->connection = connection;
+	l->phy = le_gap_phy_1m;
+	l->requested = 0;
+	l->no_2m = false;
+	l->txsize = LINK_PHY_TXSIZE_DEFAULT;
+	l->change_ticks = history_time_ticks();
+
+	#if LINK_PHY_2M
+		if (l->hold_1m == false)
+		{
+			link_phy_request(l, le_gap_phy_2m);
+		}
+	#endif
+}
+
+// PHY update done, by either end. A 2M request answered with 1M is a peer without 2M.
+void link_phy_status(uint8_t link, uint8_t phy)
+{
+	link_phy_link_t *l = &link_phy_link[link];
+
+	if (l->connected == false)
+	{
+		return;
+	}
+
+	if (l->requested == le_gap_phy_2m && phy != le_gap_phy_2m)
+	{
+		l->no_2m = true;
+		link_phy_stats.no_2m++;
+	}
+	if (phy == le_gap_phy_2m && l->phy != le_gap_phy_2m)
+	{
+		link_phy_stats.upgrades++;
+	}
+	if (phy != le_gap_phy_2m && l->phy == le_gap_phy_2m)
+	{
+		link_phy_stats.fallbacks++;
+	}
+
+	l->phy = phy;
+	l->requested = 0;
+	l->change_ticks = history_time_ticks();
+	#if INCLUDE_LOGGING
+		LOG_INFO("PHY: link %u on %s", link, (phy == le_gap_phy_2m) ? "2M" : "1M");
+	#endif
+}
+
+// LL payload octets after the data length update
+void link_phy_parameters(uint8_t link, uint16_t txsize)
+{
+
+	if (link_phy_link[link].connected && txsize != 0)
+	{
+		link_phy_link[link].txsize = txsize;
+	}
+
+}
+
+/** -------------------------------------------------------------------------------------------
+ * @brief filtered RSSI of 'link': 1M below LINK_PHY_FALLBACK_RSSI_DBM, 2M again above
+ * LINK_PHY_UPGRADE_RSSI_DBM if the peer has it. Nothing for LINK_PHY_HOLD_MS after the last
+ * update or request, a request without a phy_status by then left the PHY as it was.
+ *-------------------------------------------------------------------------------------------- **/
+void link_phy_rssi(uint8_t link, int8_t rssi_dbm)
+{
+	link_phy_link_t *l = &link_phy_link[link];
+
+	if (l->connected == false || link_phy_ms_since(l->change_ticks) < LINK_PHY_HOLD_MS)
+	{
+		return;
+	}
+
+	if (l->requested == le_gap_phy_2m && l->phy != le_gap_phy_2m)
+	{
+		l->no_2m = true;
+		link_phy_stats.no_2m++;
+	}
+	l->requested = 0;
+
+	if (l->phy == le_gap_phy_2m && rssi_dbm < LINK_PHY_FALLBACK_RSSI_DBM)
+	{
+		link_phy_request(l, le_gap_phy_1m);
+	}
+	#if LINK_PHY_2M
+		else if (l->phy == le_gap_phy_1m && l->no_2m == false && rssi_dbm > LINK_PHY_UPGRADE_RSSI_DBM)
+		{
+			l->hold_1m = false;
+			link_phy_request(l, le_gap_phy_2m);
+		}
+	#endif
+}
+
+/** -------------------------------------------------------------------------------------------
+ * @brief a notification or indication of 'len' bytes went over 'link'. Its radio-on time is
+ * the LL PDUs it is split into at the current data length, each with the empty PDU back and
+ * two inter frame spaces.
+ *-------------------------------------------------------------------------------------------- **/
+void link_phy_value(uint8_t link, uint16_t len)
+{
+	link_phy_link_t *l = &link_phy_link[link];
+	uint8_t index = (l->phy == le_gap_phy_2m) ? LINK_PHY_INDEX_2M : LINK_PHY_INDEX_1M;
+	uint8_t preamble = (l->phy == le_gap_phy_2m) ? 2 : 1;
+	uint8_t us_per_octet = (l->phy == le_gap_phy_2m) ? 4 : 8;
+	uint16_t left = len + LINK_PHY_VALUE_OVERHEAD;
+	uint16_t payload;
+	uint32_t us = 0;
+
+	if (l->connected == false)
+	{
+		return;
+	}
+
+	while (left != 0)
+	{
+		payload = (left < l->txsize) ? left : l->txsize;
+		us += (uint32_t)(preamble + LINK_PHY_PDU_OVERHEAD + payload + preamble + LINK_PHY_EMPTY_PDU) * us_per_octet
+				+ 2 * LINK_PHY_T_IFS_US;
+		left -= payload;
+	}
+
+	link_phy_stats.bytes[index] += len;
+	link_phy_stats.air_us[index] += us;
+}
+
+void link_phy_connection_closed(uint8_t link, uint16_t reason)
+{
+	link_phy_link_t *l = &link_phy_link[link];
+
+	if (l->connected == false)
+	{
+		return;
+	}
+
+	l->connected = false;
+	if (reason == bg_err_bt_connection_timeout && l->phy == le_gap_phy_2m)
+	{
+		l->hold_1m = true;
+		link_phy_stats.lost_2m++;
+	}
+}
+
+void link_phy_log_stats(uint8_t link)
+{
+
+	#if INCLUDE_LOGGING
+		LOG_INFO("PHY: link %u was on %s, data length %u, %lu upgrades, %lu fallbacks, %lu peers without 2M, %lu lost on 2M, "
+				"1M %lu B at %lu us/KB, 2M %lu B at %lu us/KB",
+				link, (link_phy_link[link].phy == le_gap_phy_2m) ? "2M" : "1M", link_phy_link[link].txsize,
+				link_phy_stats.upgrades, link_phy_stats.fallbacks, link_phy_stats.no_2m, link_phy_stats.lost_2m,
+				link_phy_stats.bytes[LINK_PHY_INDEX_1M],
+				(link_phy_stats.bytes[LINK_PHY_INDEX_1M] != 0) ?
+						(uint32_t)((uint64_t)link_phy_stats.air_us[LINK_PHY_INDEX_1M] * 1024 / link_phy_stats.bytes[LINK_PHY_INDEX_1M]) : 0,
+				link_phy_stats.bytes[LINK_PHY_INDEX_2M],
+				(link_phy_stats.bytes[LINK_PHY_INDEX_2M] != 0) ?
+						(uint32_t)((uint64_t)link_phy_stats.air_us[LINK_PHY_INDEX_2M] * 1024 / link_phy_stats.bytes[LINK_PHY_INDEX_2M]) : 0);
+	#else
+		(void)link;
+	#endif
+
+}
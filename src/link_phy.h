@@ -0,0 +1,89 @@
+/*********************************************************************************************
+ *  @file  link_phy.h
+ *	@brief PHY and data length of the connections. Every connection opens on the 1M PHY, both
+ *		   ends then ask for 2M, which halves the airtime of a byte. The LL data length update
+ *		   is done by the stack itself up to the ATT MTU (gatt_set_max_mtu), the data length it
+ *		   ended up with is taken from the connection parameters.
+ *
+ *		   2M needs a few dB more signal. A link whose filtered RSSI (tx_power.h) drops below
+ *		   LINK_PHY_FALLBACK_RSSI_DBM goes back to 1M and up again above
+ *		   LINK_PHY_UPGRADE_RSSI_DBM, at most once per LINK_PHY_HOLD_MS. A link lost on 2M
+ *		   opens the next connection on 1M until the RSSI is good. A peer without 2M is asked
+ *		   once per connection.
+ *
+ *		   The radio-on time of every value sent or received is estimated from the LL PDUs it
+ *		   takes (with the empty PDUs back and the inter frame spaces) and kept per PHY, as
+ *		   microseconds per KB.
+ *
+ *  @authors : Rajat Chaple (GATT client code)
+ *  		   Sundar Krishnakumar (GATT server code)
+ *
+ *  @date      April 29, 2020 (last update)
+ **********************************************************************************************/
+#include "ble_device_type.h"
+
+#ifndef __LINK_PHY_H__
+#define __LINK_PHY_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// 1: 2M on every connection when both ends have it
+#define LINK_PHY_2M					(1)
+
+#if BUILD_INCLUDES_BLE_CLIENT
+#define LINK_PHY_LINKS				CLIENT_MAX_SERVERS
+#else
+#define LINK_PHY_LINKS				(1)
+#endif
+
+#define LINK_PHY_FALLBACK_RSSI_DBM	(-80)
+#define LINK_PHY_UPGRADE_RSSI_DBM	(-72)
+#define LINK_PHY_HOLD_MS			(10000)
+
+#define LINK_PHY_TXSIZE_DEFAULT		(27)	// LL payload octets without data length extension
+
+typedef enum
+{
+	LINK_PHY_INDEX_1M,
+	LINK_PHY_INDEX_2M,
+	LINK_PHY_INDEX_COUNT
+
+}link_phy_index_t;
+
+typedef struct link_phy_link_s
+{
+	bool connected;
+	uint8_t connection;
+	uint8_t phy;				// le_gap_phy_1m or le_gap_phy_2m
+	uint8_t requested;			// PHY asked for, 0 if none
+	bool no_2m;					// the peer stayed on 1M when asked
+	bool hold_1m;				// the last connection was lost on 2M, kept over connections
+	uint16_t txsize;
+	uint32_t change_ticks;
+
+}link_phy_link_t;
+
+typedef struct link_phy_stats_s
+{
+	uint32_t upgrades;
+	uint32_t fallbacks;
+	uint32_t no_2m;				// peers that stayed on 1M
+	uint32_t lost_2m;			// supervision timeouts on 2M
+
+	uint32_t bytes[LINK_PHY_INDEX_COUNT];
+	uint32_t air_us[LINK_PHY_INDEX_COUNT];
+
+}link_phy_stats_t;
+
+extern link_phy_stats_t link_phy_stats;
+
+void link_phy_connection_opened(uint8_t link, uint8_t connection);
+void link_phy_status(uint8_t link, uint8_t phy);
+void link_phy_parameters(uint8_t link, uint16_t txsize);
+void link_phy_rssi(uint8_t link, int8_t rssi_dbm);
+void link_phy_value(uint8_t link, uint16_t len);
+void link_phy_connection_closed(uint8_t link, uint16_t reason);
+void link_phy_log_stats(uint8_t link);
+
+#endif /* __LINK_PHY_H__ */
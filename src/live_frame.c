@@ -0,0 +1,525 @@
+/*********************************************************************************************
+ *  @file live_frame.c
+ *	@brief Packs live IMU samples into MTU sized Axis orientation frames and resends frames
+ *		   on request (server), unpacks them, detects missing frames and measures throughput
+ *		   and latency (client). See live_frame.h for the format.
+ *
+ *  @authors : Rajat Chaple (GATT client code)
+ *  		   Sundar Krishnakumar (GATT server code)
+ *
+ *  @date      April 29, 2020 (last update)
+ **********************************************************************************************/
+#include "ble_device_type.h"
+#include <string.h>
+#include "live_frame.h"
+#include "infrastructure.h"
+
+
+// Y-axis tilt and orientation of one sample
+static const uint8_t *live_frame_read_sample(const uint8_t *ptr, live_sample_t *sample)
+{
+
+	sample->y = (int16_t)BYTES_TO_UINT16(ptr[0], ptr[1]);
+	sample->pitch_cdeg = (int16_t)BYTES_TO_UINT16(ptr[2], ptr[3]);
+	sample->roll_cdeg = (int16_t)BYTES_TO_UINT16(ptr[4], ptr[5]);
+	for (uint8_t i = 0; i < 4; i++)
+	{
+		sample->q[i] = (int16_t)BYTES_TO_UINT16(ptr[6 + 2 * i], ptr[7 + 2 * i]);
+	}
+
+	return ptr + LIVE_FRAME_FIRST_SAMPLE_LEN;
+}
+
+static void live_frame_channels(const live_sample_t *sample, int32_t *ch)
+{
+
+	ch[0] = sample->y;
+	ch[1] = sample->pitch_cdeg;
+	ch[2] = sample->roll_cdeg;
+	for (uint8_t i = 0; i < 4; i++)
+	{
+		ch[3 + i] = sample->q[i];
+	}
+
+}
+
+static void live_frame_set_channels(live_sample_t *sample, const int32_t *ch)
+{
+
+	sample->y = (int16_t)ch[0];
+	sample->pitch_cdeg = (int16_t)ch[1];
+	sample->roll_cdeg = (int16_t)ch[2];
+	for (uint8_t i = 0; i < 4; i++)
+	{
+		sample->q[i] = (int16_t)ch[3 + i];
+	}
+
+}
+
+
+#if BUILD_INCLUDES_BLE_CLIENT
+#include "log.h"
+#include "native_gecko.h"
+#include "history.h"
+
+
+live_client_t live_client[CLIENT_MAX_SERVERS];
+
+
+void live_client_connection_opened(uint8_t link)
+{
+
+	memset(&live_client[link], 0, sizeof(live_client[link]));
+	live_client[link].start_ticks = history_time_ticks();
+
+}
+
+// Handles came from the GATT cache on this connection, no discovery
+void live_client_gatt_cache_used(uint8_t link)
+{
+	live_client[link].gatt_cache_used = true;
+}
+
+// Sample time of the newest sample against the local arrival time. The smallest offset seen
+// is taken as zero latency.
+static void live_client_latency(live_client_t *client, uint32_t t_ms)
+{
+	uint32_t now_ms = (uint32_t)((uint64_t)(history_time_ticks() - client->start_ticks) * 1000 / HISTORY_TIMER_FREQ);
+	int32_t offset = (int32_t)(now_ms - t_ms);
+
+	if (client->frames == 0 || offset < client->offset_min_ms)
+	{
+		client->offset_min_ms = offset;
+	}
+
+	uint32_t latency = offset - client->offset_min_ms;
+	client->latency_sum_ms += latency;
+	client->latency_max_ms = MAX(client->latency_max_ms, latency);
+}
+
+/** -------------------------------------------------------------------------------------------
+ * @brief unpacks an Axis orientation frame and checks its sequence number. Missing frames
+ * are asked for again on the Live retransmit characteristic (if the server has it).
+ *
+ * @param samples, LIVE_FRAME_MAX_SAMPLES entries
+ * @return number of samples in the frame
+ *-------------------------------------------------------------------------------------------- **/
+uint8_t live_client_frame(uint8_t link, uint8_t connection, uint16_t retransmit_characteristic, const uint8_t *frame,
+		uint8_t len, live_sample_t *samples)
+{
+	live_client_t *client = &live_client[link];
+	uint8_t count = live_frame_unpack(frame, len, samples, LIVE_FRAME_MAX_SAMPLES);
+
+	if (count == 0)
+	{
+		return 0;
+	}
+
+	if (client->samples == 0)
+	{
+		client->first_data_ms = (uint32_t)((uint64_t)(history_time_ticks() - client->start_ticks) * 1000 / HISTORY_TIMER_FREQ);
+		#if INCLUDE_LOGGING
+			LOG_INFO("Live %u: first data %lu ms after connecting (%s)", link, client->first_data_ms,
+					client->gatt_cache_used ? "cached handles" : "full discovery");
+		#endif
+	}
+
+	client->samples += count;
+
+	if ((frame[0] & LIVE_FRAME_FLAG_BATCH) == 0)
+	{
+		client->frames++;
+		return count;
+	}
+
+	if ((frame[0] & LIVE_FRAME_FLAG_RETRANSMIT) != 0)
+	{
+		client->recovered++;
+		return count;
+	}
+
+	uint8_t seq = frame[1];
+	uint8_t missing = seq - client->next_seq;
+
+	if (client->seq_valid && missing != 0)
+	{
+		client->gaps += missing;
+
+		uint8_t request[LIVE_RETRANSMIT_REQUEST_LEN] = { client->next_seq, missing };
+
+		if (missing > LIVE_FRAME_RING || retransmit_characteristic == 0)
+		{
+			client->lost += missing;
+		}
+		else if (gecko_cmd_gatt_write_characteristic_value(connection, retransmit_characteristic, LIVE_RETRANSMIT_REQUEST_LEN,
+				request)->result != 0)
+		{
+			client->lost += missing;	// another GATT procedure is running
+		}
+
+		LOG_DEBUG("Live frames %u to %u missing", client->next_seq, (uint8_t)(seq - 1));
+	}
+
+	client->next_seq = seq + 1;
+	client->seq_valid = true;
+
+	live_client_latency(client, samples[count - 1].t_ms);
+	client->frames++;
+
+	return count;
+}
+
+void live_client_log_stats(uint8_t link, bool notifications)
+{
+
+	#if INCLUDE_LOGGING
+		live_client_t *client = &live_client[link];
+		uint32_t elapsed = history_time_ticks() - client->start_ticks;
+
+		LOG_INFO("Live %u (%s): %lu samples in %lu frames, %lu samples/s, latency mean %lu ms max %lu ms",
+				link, notifications ? "notifications" : "indications", client->samples, client->frames,
+				(elapsed != 0) ? (uint32_t)((uint64_t)client->samples * HISTORY_TIMER_FREQ / elapsed) : 0,
+				(client->frames != 0) ? client->latency_sum_ms / client->frames : 0, client->latency_max_ms);
+		LOG_INFO("Live %u: %lu frames missing, %lu recovered, %lu lost", link, client->gaps, client->recovered, client->lost);
+		LOG_INFO("Live %u: first data %lu ms after connecting, %s", link, client->first_data_ms,
+				client->gatt_cache_used ? "cached handles" : "full discovery");
+	#else
+		(void)link;
+		(void)notifications;
+	#endif
+
+}
+
+#else
+
+#include "main.h"
+
+
+live_frame_typedef live_frame;
+
+// Samples per frame that keep the first sample within LIVE_FRAME_MAX_LATENCY_MS
+#define LIVE_FRAME_BATCH_SAMPLES	(MAX(1, LIVE_FRAME_MAX_LATENCY_MS / LETIMER_PERIOD_MS))
+
+
+/** -------------------------------------------------------------------------------------------
+ * @brief clears the frame and the counters, call when a connection opens
+ *-------------------------------------------------------------------------------------------- **/
+void live_frame_init(void)
+{
+
+	memset(&live_frame, 0, sizeof(live_frame));
+	delta_codec_init(&live_frame.codec, LIVE_FRAME_CHANNELS, 0);
+	live_frame_set_mtu(LIVE_FRAME_ATT_MTU_DEFAULT);
+
+}
+
+void live_frame_set_mtu(uint16_t mtu)
+{
+	live_frame.payload = MIN(mtu, LIVE_FRAME_ATT_MTU_MAX) - 3;
+}
+
+// 1 if a worst case delta sample might not fit any more
+static uint8_t live_frame_is_full(void)
+{
+	return (live_frame.count != 0 && (live_frame.count >= LIVE_FRAME_MAX_SAMPLES ||
+			live_frame.len + LIVE_FRAME_DELTA_SAMPLE_MAX_LEN > live_frame.payload));
+}
+
+/** -------------------------------------------------------------------------------------------
+ * @brief appends the newest IMU sample (Y-axis tilt and fused orientation) to the frame.
+ * The sample is dropped if the frame is full, which only happens while indications are not
+ * being confirmed.
+ *-------------------------------------------------------------------------------------------- **/
+void live_frame_add_sample(void)
+{
+	uint32_t t_ms = recorder.last.t_ms;
+	uint8_t raw[LIVE_FRAME_FIRST_SAMPLE_LEN];
+	live_sample_t sample;
+	int32_t ch[LIVE_FRAME_CHANNELS];
+	uint8_t *ptr = raw;
+
+	if (live_frame_is_full())
+	{
+		live_frame.dropped++;
+		return;
+	}
+
+	UINT16_TO_BITSTREAM(ptr, (uint16_t)accel_data.y);
+	fusion_orientation_payload(ptr);
+	live_frame_read_sample(raw, &sample);
+	live_frame_channels(&sample, ch);
+
+	if (live_frame.count == 0)
+	{
+		ptr = live_frame.frame;
+		UINT8_TO_BITSTREAM(ptr, LIVE_FRAME_FLAG_BATCH | LIVE_FRAME_FLAG_DELTA);
+		UINT8_TO_BITSTREAM(ptr, 0);		// sequence number, set when the frame is taken
+		UINT32_TO_BITSTREAM(ptr, t_ms);
+		memcpy(ptr, raw, LIVE_FRAME_FIRST_SAMPLE_LEN);
+		ptr += LIVE_FRAME_FIRST_SAMPLE_LEN;
+		delta_codec_seed(&live_frame.codec, ch);
+	}
+	else
+	{
+		ptr = &live_frame.frame[live_frame.len];
+		ptr += delta_codec_put_varint(ptr, MIN(t_ms - live_frame.last_t_ms, 0xFFFF));
+		ptr += delta_codec_encode(&live_frame.codec, ch, ptr);
+	}
+
+	live_frame.count++;
+	live_frame.frame[0] = LIVE_FRAME_FLAG_BATCH | LIVE_FRAME_FLAG_DELTA | live_frame.count;
+	live_frame.len = ptr - live_frame.frame;
+	live_frame.last_t_ms = t_ms;
+}
+
+/** -------------------------------------------------------------------------------------------
+ * @brief the newest IMU sample, as live_frame_add_sample() would add it
+ *-------------------------------------------------------------------------------------------- **/
+void live_frame_sample_now(live_sample_t *sample)
+{
+	uint8_t raw[LIVE_FRAME_FIRST_SAMPLE_LEN];
+	uint8_t *ptr = raw;
+
+	UINT16_TO_BITSTREAM(ptr, (uint16_t)accel_data.y);
+	fusion_orientation_payload(ptr);
+	live_frame_read_sample(raw, sample);
+	sample->t_ms = recorder.last.t_ms;
+}
+
+/** -------------------------------------------------------------------------------------------
+ * @brief packs count samples (oldest first) into one delta coded frame outside the GATT
+ * stream, buf holds LIVE_FRAME_HEADER_LEN + LIVE_FRAME_FIRST_SAMPLE_LEN +
+ * (count - 1) * LIVE_FRAME_DELTA_SAMPLE_MAX_LEN bytes
+ *
+ * @return frame length
+ *-------------------------------------------------------------------------------------------- **/
+uint8_t live_frame_pack(const live_sample_t *samples, uint8_t count, uint8_t seq, uint8_t *buf)
+{
+	delta_codec_t codec;
+	int32_t ch[LIVE_FRAME_CHANNELS];
+	uint8_t *ptr = buf;
+
+	UINT8_TO_BITSTREAM(ptr, LIVE_FRAME_FLAG_BATCH | LIVE_FRAME_FLAG_DELTA | count);
+	UINT8_TO_BITSTREAM(ptr, seq);
+	UINT32_TO_BITSTREAM(ptr, samples[0].t_ms);
+	UINT16_TO_BITSTREAM(ptr, (uint16_t)samples[0].y);
+	UINT16_TO_BITSTREAM(ptr, (uint16_t)samples[0].pitch_cdeg);
+	UINT16_TO_BITSTREAM(ptr, (uint16_t)samples[0].roll_cdeg);
+	for (uint8_t i = 0; i < 4; i++)
+	{
+		UINT16_TO_BITSTREAM(ptr, (uint16_t)samples[0].q[i]);
+	}
+
+	delta_codec_init(&codec, LIVE_FRAME_CHANNELS, 0);
+	live_frame_channels(&samples[0], ch);
+	delta_codec_seed(&codec, ch);
+
+	for (uint8_t i = 1; i < count; i++)
+	{
+		live_frame_channels(&samples[i], ch);
+		ptr += delta_codec_put_varint(ptr, MIN(samples[i].t_ms - samples[i - 1].t_ms, 0xFFFF));
+		ptr += delta_codec_encode(&codec, ch, ptr);
+	}
+
+	return ptr - buf;
+}
+
+uint8_t live_frame_is_ready(void)
+{
+	return (live_frame.count >= LIVE_FRAME_BATCH_SAMPLES || live_frame_is_full());
+}
+
+/** -------------------------------------------------------------------------------------------
+ * @brief numbers the frame, keeps it for retransmission, copies it to buf (LIVE_FRAME_MAX_LEN
+ * bytes) and starts an empty one
+ *
+ * @return frame length, 0 if no sample is waiting
+ *-------------------------------------------------------------------------------------------- **/
+uint8_t live_frame_take(uint8_t *buf)
+{
+	uint8_t len = live_frame.len;
+
+	if (live_frame.count == 0)
+	{
+		return 0;
+	}
+
+	live_frame.frame[1] = live_frame.seq;
+	memcpy(buf, live_frame.frame, len);
+
+	memcpy(live_frame.ring[live_frame.seq % LIVE_FRAME_RING], live_frame.frame, len);
+	live_frame.ring_len[live_frame.seq % LIVE_FRAME_RING] = len;
+	live_frame.seq++;
+
+	live_frame.samples += live_frame.count;
+	live_frame.frames++;
+	live_frame.bytes += len;
+	live_frame.count = 0;
+	live_frame.len = 0;
+
+	return len;
+}
+
+/** -------------------------------------------------------------------------------------------
+ * @brief Live retransmit write: resends the requested frames that are still in the ring as
+ * notifications, flagged LIVE_FRAME_FLAG_RETRANSMIT
+ *-------------------------------------------------------------------------------------------- **/
+void live_frame_retransmit(uint8_t connection, const uint8_t *request, uint8_t len)
+{
+	uint8_t buf[LIVE_FRAME_MAX_LEN];
+
+	if (len < LIVE_RETRANSMIT_REQUEST_LEN)
+	{
+		return;
+	}
+
+	for (uint8_t i = 0; i < MIN(request[1], LIVE_FRAME_RING); i++)
+	{
+		uint8_t seq = request[0] + i;
+		uint8_t slot = seq % LIVE_FRAME_RING;
+
+		if (live_frame.ring_len[slot] == 0 || live_frame.ring[slot][1] != seq)
+		{
+			live_frame.retransmit_missed++;
+			continue;
+		}
+
+		memcpy(buf, live_frame.ring[slot], live_frame.ring_len[slot]);
+		buf[0] |= LIVE_FRAME_FLAG_RETRANSMIT;
+
+		struct gecko_msg_gatt_server_send_characteristic_notification_rsp_t *ret = gecko_cmd_gatt_server_send_characteristic_notification(
+				connection, gattdb_y_axis_value, live_frame.ring_len[slot], buf);
+		if (ret->result != 0)
+		{
+			#if INCLUDE_LOGGING
+				LOG_ERROR("ERROR: %d | response code from gecko_cmd_gatt_server_send_characteristic_notification()", ret->result);
+			#endif
+			live_frame.retransmit_missed += MIN(request[1], LIVE_FRAME_RING) - i;
+			return;
+		}
+
+		live_frame.retransmitted++;
+		link_phy_value(0, live_frame.ring_len[slot]);
+	}
+}
+
+void live_frame_indication_sent(void)
+{
+	live_frame.indication_ticks = history_time_ticks();
+}
+
+void live_frame_indication_confirmed(void)
+{
+
+	if (live_frame.indication_ticks == 0)
+	{
+		return;
+	}
+
+	uint32_t rtt = history_time_ticks() - live_frame.indication_ticks;
+
+	live_frame.indication_ticks = 0;
+	live_frame.confirmations++;
+	live_frame.rtt_sum_ticks += rtt;
+	live_frame.rtt_max_ticks = MAX(live_frame.rtt_max_ticks, rtt);
+}
+
+void live_frame_log_stats(void)
+{
+
+	#if INCLUDE_LOGGING
+		uint32_t samples = MAX(live_frame.samples, 1);
+		LOG_INFO("Live: %lu samples in %lu frames, %lu dropped, %lu.%02lu bytes/sample, %lu frames resent, %lu no longer kept",
+				live_frame.samples, live_frame.frames, live_frame.dropped, live_frame.bytes / samples,
+				(live_frame.bytes % samples) * 100 / samples, live_frame.retransmitted, live_frame.retransmit_missed);
+		if (live_frame.confirmations != 0)
+		{
+			LOG_INFO("Live: indication round trip mean %lu ms max %lu ms",
+					(uint32_t)((uint64_t)live_frame.rtt_sum_ticks * 1000 / HISTORY_TIMER_FREQ / live_frame.confirmations),
+					(uint32_t)((uint64_t)live_frame.rtt_max_ticks * 1000 / HISTORY_TIMER_FREQ));
+		}
+	#endif
+
+}
+
+#endif
+
+
+/** -------------------------------------------------------------------------------------------
+ * @brief unpacks an Axis orientation frame, batched or in the older single value format
+ *
+ * @return number of samples written to samples
+ *-------------------------------------------------------------------------------------------- **/
+uint8_t live_frame_unpack(const uint8_t *frame, uint8_t len, live_sample_t *samples, uint8_t max_samples)
+{
+
+	if (len < 3 || max_samples == 0)
+	{
+		return 0;
+	}
+
+	if ((frame[0] & LIVE_FRAME_FLAG_BATCH) == 0)
+	{
+		memset(&samples[0], 0, sizeof(samples[0]));
+		if (len >= 1 + LIVE_FRAME_FIRST_SAMPLE_LEN)
+		{
+			live_frame_read_sample(&frame[1], &samples[0]);
+		}
+		else
+		{
+			samples[0].y = (int16_t)BYTES_TO_UINT16(frame[1], frame[2]);
+		}
+		return 1;
+	}
+
+	if (len < LIVE_FRAME_HEADER_LEN + LIVE_FRAME_FIRST_SAMPLE_LEN)
+	{
+		return 0;
+	}
+
+	uint32_t t_ms = BYTES_TO_UINT32(frame[2], frame[3], frame[4], frame[5]);
+	const uint8_t *ptr = &frame[LIVE_FRAME_HEADER_LEN];
+	const uint8_t *end = frame + len;
+	uint8_t delta = ((frame[0] & LIVE_FRAME_FLAG_DELTA) != 0);
+	delta_codec_t codec;
+	int32_t ch[LIVE_FRAME_CHANNELS];
+	uint8_t count;
+
+	for (count = 0; count < (frame[0] & LIVE_FRAME_COUNT_MASK) && count < max_samples; count++)
+	{
+		if (count == 0)
+		{
+			ptr = live_frame_read_sample(ptr, &samples[0]);
+			live_frame_channels(&samples[0], ch);
+			delta_codec_init(&codec, LIVE_FRAME_CHANNELS, 0);
+			delta_codec_seed(&codec, ch);
+		}
+		else if (delta)
+		{
+			uint32_t dt;
+			uint8_t n = delta_codec_get_varint(ptr, end, &dt);
+			uint8_t m = (n != 0) ? delta_codec_decode(&codec, &ptr[n], end, ch) : 0;
+
+			if (m == 0)
+			{
+				break;
+			}
+			ptr += n + m;
+			t_ms += dt;
+			live_frame_set_channels(&samples[count], ch);
+		}
+		else
+		{
+			if (end - ptr < LIVE_FRAME_SAMPLE_LEN)
+			{
+				break;
+			}
+			t_ms += BYTES_TO_UINT16(ptr[0], ptr[1]);
+			ptr = live_frame_read_sample(ptr + 2, &samples[count]);
+		}
+
+		samples[count].t_ms = t_ms;
+	}
+
+	return count;
+}
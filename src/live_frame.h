@@ -0,0 +1,167 @@
+/*********************************************************************************************
+ *  @file  live_frame.h
+ *	@brief Live IMU samples, packed several to an Axis orientation indication or
+ *		   notification. The server collects samples into one frame until the frame holds
+ *		   LIVE_FRAME_BATCH_SAMPLES or the ATT MTU is reached, so a faster sample rate adds
+ *		   samples per frame rather than frames.
+ *
+ *		   With indications every frame waits for the client's confirmation (an ATT round
+ *		   trip). With notifications nothing is confirmed: frames carry a sequence number,
+ *		   the client detects gaps and asks for the missing frames on the Live retransmit
+ *		   characteristic (first sequence number, count). The server keeps the last
+ *		   LIVE_FRAME_RING frames for this.
+ *
+ *		   Frame (little endian):
+ *		     flags (upper 3 bits, LIVE_FRAME_FLAG_BATCH set) | sample count (lower 5 bits),
+ *		     sequence number (uint8), time of the first sample, ms since the session
+ *		     started (uint32),
+ *		     first sample  : Y-axis tilt mg (int16), fused orientation (FUSION_PAYLOAD_LEN)
+ *		     other samples : with LIVE_FRAME_FLAG_DELTA, ms since the previous sample
+ *		                     (varint) and the LIVE_FRAME_CHANNELS deltas to the previous
+ *		                     sample (delta_codec.h); without it, ms since the previous
+ *		                     sample (uint16), then as the first
+ *
+ *		   The first sample is the keyframe, so every frame decodes on its own and a lost
+ *		   frame does not break the ones after it. A single sample frame fits the 20 byte
+ *		   payload of the default MTU; delta coded samples take 8 to 11 bytes while the user
+ *		   sits still, so an MTU of 247 carries up to LIVE_FRAME_MAX_SAMPLES. A frame without
+ *		   LIVE_FRAME_FLAG_BATCH is the older single value format (flags, Y-axis tilt,
+ *		   orientation) and is still decoded.
+ *
+ *  @authors : Rajat Chaple (GATT client code)
+ *  		   Sundar Krishnakumar (GATT server code)
+ *
+ *  @date      April 29, 2020 (last update)
+ **********************************************************************************************/
+#include "ble_device_type.h"
+
+#ifndef __LIVE_FRAME_H__
+#define __LIVE_FRAME_H__
+
+#include <stdint.h>
+#include "delta_codec.h"
+
+#define LIVE_FRAME_FLAG_BATCH			(0x80)
+#define LIVE_FRAME_FLAG_RETRANSMIT		(0x40)	// resent on request, older than the last frame
+#define LIVE_FRAME_FLAG_DELTA			(0x20)	// samples after the first are delta coded
+#define LIVE_FRAME_COUNT_MASK			(0x1F)
+
+#define LIVE_FRAME_HEADER_LEN			(6)
+#define LIVE_FRAME_ORIENTATION_LEN		(12)	// FUSION_PAYLOAD_LEN
+#define LIVE_FRAME_FIRST_SAMPLE_LEN		(2 + LIVE_FRAME_ORIENTATION_LEN)
+#define LIVE_FRAME_SAMPLE_LEN			(2 + LIVE_FRAME_FIRST_SAMPLE_LEN)
+
+// Y-axis tilt, pitch, roll, quaternion w/x/y/z. Worst case delta sample: 3 byte time delta
+// (up to 0xFFFF ms) and 3 bytes per channel.
+#define LIVE_FRAME_CHANNELS				(7)
+#define LIVE_FRAME_DELTA_SAMPLE_MAX_LEN	(DELTA_CODEC_INT16_MAX_LEN + LIVE_FRAME_CHANNELS * DELTA_CODEC_INT16_MAX_LEN)
+
+#define LIVE_FRAME_ATT_MTU_DEFAULT		(23)
+#define LIVE_FRAME_ATT_MTU_MAX			(247)
+#define LIVE_FRAME_MAX_LEN				(LIVE_FRAME_ATT_MTU_MAX - 3)
+#define LIVE_FRAME_MAX_SAMPLES			(LIVE_FRAME_COUNT_MASK)
+
+typedef struct live_sample_s
+{
+	uint32_t t_ms;				// ms since the server session started, 0 in the older format
+	int16_t y;					// Y-axis tilt, mg
+	int16_t pitch_cdeg;
+	int16_t roll_cdeg;
+	int16_t q[4];				// orientation quaternion w, x, y, z (Q15)
+
+}live_sample_t;
+
+#define LIVE_RETRANSMIT_REQUEST_LEN		(2)
+
+// Frames kept by the server for retransmission, also the longest gap the client asks for
+#define LIVE_FRAME_RING					(8)
+
+uint8_t live_frame_unpack(const uint8_t *frame, uint8_t len, live_sample_t *samples, uint8_t max_samples);
+
+#if BUILD_INCLUDES_BLE_CLIENT
+
+#include <stdbool.h>
+
+typedef struct live_client_s
+{
+	bool seq_valid;
+	uint8_t next_seq;			// sequence number expected next
+
+	uint32_t frames;
+	uint32_t samples;
+	uint32_t gaps;				// frames found missing
+	uint32_t recovered;			// missing frames received again
+	uint32_t lost;				// missing frames not asked for (gap too long or request failed)
+
+	// Arrival time minus sample time, relative to the smallest seen (clocks are not synced)
+	uint32_t start_ticks;
+	int32_t offset_min_ms;
+	uint32_t latency_sum_ms;
+	uint32_t latency_max_ms;
+
+	// Connection opened to first frame received, discovery included (or skipped, GATT cache)
+	bool gatt_cache_used;
+	uint32_t first_data_ms;
+
+}live_client_t;
+
+// One per link of the client (ble.h), cleared when its connection opens
+extern live_client_t live_client[CLIENT_MAX_SERVERS];
+
+void live_client_connection_opened(uint8_t link);
+void live_client_gatt_cache_used(uint8_t link);
+uint8_t live_client_frame(uint8_t link, uint8_t connection, uint16_t retransmit_characteristic, const uint8_t *frame,
+		uint8_t len, live_sample_t *samples);
+void live_client_log_stats(uint8_t link, bool notifications);
+
+#else
+
+// Samples wait at most this long for a frame to fill (rounded to whole sample periods)
+#define LIVE_FRAME_MAX_LATENCY_MS		(1000)
+
+typedef struct
+{
+	uint8_t frame[LIVE_FRAME_MAX_LEN];
+	uint8_t len;
+	uint8_t count;
+	uint8_t payload;			// longest frame the current MTU allows
+	uint32_t last_t_ms;
+	delta_codec_t codec;		// seeded with the first sample of every frame
+	uint8_t seq;				// sequence number of the next frame
+
+	// Frames sent last, by sequence number % LIVE_FRAME_RING
+	uint8_t ring[LIVE_FRAME_RING][LIVE_FRAME_MAX_LEN];
+	uint8_t ring_len[LIVE_FRAME_RING];
+
+	uint32_t samples;			// samples sent since the connection opened
+	uint32_t frames;
+	uint32_t bytes;				// frame bytes, headers included
+	uint32_t dropped;			// samples lost because the frame was full
+	uint32_t retransmitted;
+	uint32_t retransmit_missed;	// requested frames no longer in the ring
+
+	// Indication round trip (send to confirmation)
+	uint32_t indication_ticks;
+	uint32_t confirmations;
+	uint32_t rtt_sum_ticks;
+	uint32_t rtt_max_ticks;
+
+}live_frame_typedef;
+
+extern live_frame_typedef live_frame;
+
+void live_frame_init(void);
+void live_frame_set_mtu(uint16_t mtu);
+void live_frame_add_sample(void);
+void live_frame_sample_now(live_sample_t *sample);
+uint8_t live_frame_pack(const live_sample_t *samples, uint8_t count, uint8_t seq, uint8_t *buf);
+uint8_t live_frame_is_ready(void);
+uint8_t live_frame_take(uint8_t *buf);
+void live_frame_retransmit(uint8_t connection, const uint8_t *request, uint8_t len);
+void live_frame_indication_sent(void);
+void live_frame_indication_confirmed(void);
+void live_frame_log_stats(void);
+
+#endif
+
+#endif /* __LIVE_FRAME_H__ */
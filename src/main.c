@@ -38,6 +38,14 @@ int appMain(gecko_configuration_t *config)
 
 	//Initializing the bluetooth stack
 	gecko_init(config);
+	#if PERIODIC_STREAM
+		//sync to periodic advertising, not part of the default stack classes
+		gecko_bgapi_class_sync_init();
+	#endif
+	#if SCAN_ACCEPT_LIST
+		//controller accept list, not part of the default stack either
+		gecko_init_whitelisting();
+	#endif
 
 	//clock configuration for LETIMER0
 	configure_clock();
@@ -48,6 +56,11 @@ int appMain(gecko_configuration_t *config)
 
 	//i2c0 configuration for clock and pins
 	i2c_init();
+
+	// Stored settings replace the compile time defaults (proximity threshold...)
+	settings_init();
+	inactive_timer_seconds = settings.inactive_timeout_s;
+
 	proximity_sensor_config();
 //	test_proximity_sensor();	//Uncomment to Test proximity sensors functionality
 
@@ -139,6 +152,10 @@ int appMain(gecko_configuration_t *config)
 
 	// Initialize stack
 	gecko_init(config);
+	#if PERIODIC_STREAM
+		// Periodic advertising is not enabled in the stack by default
+		gecko_init_periodic_advertising();
+	#endif
 
 	// Make Tx power zero here
 	gecko_cmd_system_set_tx_power(0); //  TX Power should be set to 0db
@@ -160,6 +177,25 @@ int appMain(gecko_configuration_t *config)
 
 		// Init IRC0 here
 		I2C0_init();
+//		imu_convert_self_test();	//Uncomment to check fixed-point IMU conversion against reference
+//		cordic_self_test();		//Uncomment (with CORDIC_SELF_TEST 1) to check CORDIC atan2/hypot accuracy and cycles against libm
+//		kv_store_self_test();	//Uncomment (with KV_STORE_SELF_TEST 1) to measure settings store write amplification and boot index cost
+//		delta_codec_benchmark();	//Uncomment to measure IMU delta codec compression and cycles on seated / walking traces
+//		fusion_self_test();		//Uncomment (with FUSION_SELF_TEST 1) to check the orientation filter on static and gyro only traces
+		gyro_bias_reset();
+		fusion_init();
+
+		// Stored settings replace the compile time defaults (bad posture timeout options)
+		settings_init();
+
+		// Find the end of the session log on the SPI flash (needs the display SPI set up)
+		recorder_init();
+
+		// Write the log left in RAM by the previous run and record why we reset
+		postmortem_init();
+
+		// Samples missed while disconnected are streamed from the recorder on request
+		history_init();
 
 	#endif
 
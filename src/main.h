@@ -27,6 +27,13 @@
 #include "scheduler.h"
 #include "ble.h"
 #include "display.h"
+#include "settings.h"
+#include "history.h"
+#include "periodic_stream.h"
+#include "scan_schedule.h"
+#include "body_fusion.h"
+#include "tx_power.h"
+#include "link_phy.h"
 #include "ble_device_type.h"
 
 
@@ -87,6 +94,22 @@ int appMain(gecko_configuration_t *config);
 #include "log.h"
 #include "scheduler.h"
 #include "imu.h"
+#include "imu_convert.h"
+#include "fusion.h"
+#include "cordic.h"
+#include "gyro_bias.h"
+#include "imu_cal.h"
+#include "recorder.h"
+#include "postmortem.h"
+#include "history.h"
+#include "live_frame.h"
+#include "gatt_queue.h"
+#include "adv_schedule.h"
+#include "broadcast.h"
+#include "periodic_stream.h"
+#include "tx_power.h"
+#include "link_phy.h"
+#include "settings.h"
 #include "ble.h"
 #include "ble_device_type.h"
 
@@ -0,0 +1,241 @@
+/*********************************************************************************************
+ *  @file periodic_stream.c
+ *	@brief Live samples on periodic advertising: the train and its data (server), sync and
+ *		   sample recovery from the overlapping packets (client). See periodic_stream.h.
+ *
+ *  @authors : Rajat Chaple (GATT client code)
+ *  		   Sundar Krishnakumar (GATT server code)
+ *
+ *  @date      April 29, 2020 (last update)
+ **********************************************************************************************/
+#include "ble_device_type.h"
+#include <string.h>
+#include "periodic_stream.h"
+#include "native_gecko.h"
+#include "infrastructure.h"
+#include "log.h"
+
+
+#if BUILD_INCLUDES_BLE_CLIENT
+
+#include "gecko_ble_errors.h"
+
+periodic_client_t periodic_client = {
+	.sync = PERIODIC_STREAM_SYNC_INVALID
+};
+
+
+/** -------------------------------------------------------------------------------------------
+ * @brief extended scan report of the server: syncs to its periodic train if it has one and
+ * no sync is open or being opened. Scanning has to stay on until sync_opened.
+ *
+ * @param periodic_interval : from the report, 1.25 ms units, 0 if the set has no train
+ *-------------------------------------------------------------------------------------------- **/
+void periodic_client_scan_report(bd_addr address, uint8_t address_type, uint8_t adv_sid, uint16_t periodic_interval)
+{
+	uint32_t timeout;
+
+	if (periodic_interval == 0 || periodic_client.sync != PERIODIC_STREAM_SYNC_INVALID)
+	{
+		return;
+	}
+
+	// 10 ms units
+	timeout = (uint32_t)periodic_interval * 125 * PERIODIC_STREAM_SYNC_MISSES / 1000;
+	timeout = MIN(MAX(timeout, 0x06), 0xFFFF);
+
+	struct gecko_msg_sync_open_rsp_t *ret = gecko_cmd_sync_open(adv_sid, 0, (uint16_t)timeout, address, address_type);
+	BTSTACK_CHECK_RESPONSE(ret);
+	if (ret->result == bg_err_success)
+	{
+		periodic_client.sync = ret->sync;
+		periodic_client.opening = true;
+	}
+}
+
+void periodic_client_sync_opened(uint8_t sync)
+{
+
+	if (sync != periodic_client.sync)
+	{
+		return;
+	}
+	periodic_client.opening = false;
+	periodic_client.syncs++;
+	LOG_INFO("Periodic stream: synced (%lu)", periodic_client.syncs);
+
+}
+
+// Train lost (or never found), opened again from the next scan report while scanning
+void periodic_client_sync_closed(void)
+{
+
+	if (periodic_client.sync == PERIODIC_STREAM_SYNC_INVALID)
+	{
+		return;			// closed by periodic_client_close()
+	}
+
+	periodic_client.sync = PERIODIC_STREAM_SYNC_INVALID;
+	periodic_client.opening = false;
+	periodic_client.sync_lost++;
+	periodic_client_log_stats();
+
+}
+
+// Closes the sync or cancels its establishment, the GATT stream takes over while connected
+void periodic_client_close(void)
+{
+
+	if (periodic_client.sync == PERIODIC_STREAM_SYNC_INVALID)
+	{
+		return;
+	}
+
+	BTSTACK_CHECK_RESPONSE(gecko_cmd_sync_close(periodic_client.sync));
+	periodic_client.sync = PERIODIC_STREAM_SYNC_INVALID;
+	periodic_client.opening = false;
+
+}
+
+/** -------------------------------------------------------------------------------------------
+ * @brief periodic packet of the train: keeps the samples not taken from earlier packets.
+ *
+ * @param samples : PERIODIC_STREAM_SAMPLES, the new samples oldest first
+ * @return new samples
+ *-------------------------------------------------------------------------------------------- **/
+uint8_t periodic_client_data(const uint8_t *data, uint8_t len, uint8_t data_status, live_sample_t *samples)
+{
+	uint8_t count;
+	uint8_t diff;
+
+	if (data_status != PERIODIC_STREAM_DATA_COMPLETE)
+	{
+		return 0;
+	}
+
+	count = live_frame_unpack(data, len, samples, PERIODIC_STREAM_SAMPLES);
+	if (count == 0)
+	{
+		return 0;
+	}
+	periodic_client.packets++;
+
+	// Sequence number of the newest sample. Sample time going back means the server restarted.
+	diff = (uint8_t)(data[1] - periodic_client.last_seq);
+	periodic_client.last_seq = data[1];
+	if (periodic_client.seq_valid == false || samples[count - 1].t_ms < periodic_client.last_t_ms)
+	{
+		periodic_client.seq_valid = true;
+		diff = count;
+	}
+
+	if (diff > count)
+	{
+		periodic_client.missed += diff - count;
+		diff = count;
+	}
+
+	periodic_client.last_t_ms = samples[count - 1].t_ms;
+	memmove(&samples[0], &samples[count - diff], diff * sizeof(samples[0]));
+	periodic_client.samples += diff;
+
+	return diff;
+}
+
+void periodic_client_log_stats(void)
+{
+
+	LOG_INFO("Periodic stream: %lu syncs, %lu lost, %lu packets, %lu samples, %lu missed", periodic_client.syncs,
+			periodic_client.sync_lost, periodic_client.packets, periodic_client.samples, periodic_client.missed);
+
+}
+
+#else
+
+#include "main.h"
+
+periodic_stream_typedef periodic_stream;
+
+
+/** -------------------------------------------------------------------------------------------
+ * @brief starts the extended advertising set and its periodic train, one periodic packet per
+ * sample period. Called on boot, the data is filled in by periodic_stream_add_sample().
+ *-------------------------------------------------------------------------------------------- **/
+void periodic_stream_start(void)
+{
+
+	memset(&periodic_stream, 0, sizeof(periodic_stream));
+
+	struct gecko_msg_le_gap_set_advertise_timing_rsp_t *ret1 = gecko_cmd_le_gap_set_advertise_timing(PERIODIC_STREAM_ADV_HANDLE,
+			PERIODIC_STREAM_ADV_INTERVAL_MS * 8 / 5, PERIODIC_STREAM_ADV_INTERVAL_MS * 8 / 5, 0, 0);
+	if (ret1->result != 0)
+	{
+		#if INCLUDE_LOGGING
+			LOG_ERROR("ERROR: %d | response code from gecko_cmd_le_gap_set_advertise_timing()", ret1->result);
+		#endif
+	}
+
+	// Periodic advertising needs extended advertising PDUs
+	struct gecko_msg_le_gap_clear_advertise_configuration_rsp_t *ret2 = gecko_cmd_le_gap_clear_advertise_configuration(
+			PERIODIC_STREAM_ADV_HANDLE, 1);
+	if (ret2->result != 0)
+	{
+		#if INCLUDE_LOGGING
+			LOG_ERROR("ERROR: %d | response code from gecko_cmd_le_gap_clear_advertise_configuration()", ret2->result);
+		#endif
+	}
+
+	struct gecko_msg_le_gap_start_periodic_advertising_rsp_t *ret3 = gecko_cmd_le_gap_start_periodic_advertising(
+			PERIODIC_STREAM_ADV_HANDLE, LETIMER_PERIOD_MS * 4 / 5, LETIMER_PERIOD_MS * 4 / 5, 0);
+	if (ret3->result != 0)
+	{
+		#if INCLUDE_LOGGING
+			LOG_ERROR("ERROR: %d | response code from gecko_cmd_le_gap_start_periodic_advertising()", ret3->result);
+		#endif
+	}
+
+	struct gecko_msg_le_gap_start_advertising_rsp_t *ret4 = gecko_cmd_le_gap_start_advertising(PERIODIC_STREAM_ADV_HANDLE,
+			le_gap_general_discoverable, le_gap_non_connectable);
+	if (ret4->result != 0)
+	{
+		#if INCLUDE_LOGGING
+			LOG_ERROR("ERROR: %d | response code from gecko_cmd_le_gap_start_advertising()", ret4->result);
+		#endif
+	}
+
+}
+
+/** -------------------------------------------------------------------------------------------
+ * @brief puts the newest sample into the periodic data with the ones before it. The train
+ * keeps running, the stack sends the new data from its next periodic event.
+ *-------------------------------------------------------------------------------------------- **/
+void periodic_stream_add_sample(void)
+{
+	uint8_t data[PERIODIC_STREAM_MAX_LEN];
+	uint8_t len;
+
+	if (periodic_stream.count == PERIODIC_STREAM_SAMPLES)
+	{
+		memmove(&periodic_stream.sample[0], &periodic_stream.sample[1],
+				(PERIODIC_STREAM_SAMPLES - 1) * sizeof(periodic_stream.sample[0]));
+		periodic_stream.count--;
+	}
+	live_frame_sample_now(&periodic_stream.sample[periodic_stream.count]);
+	periodic_stream.count++;
+
+	len = live_frame_pack(periodic_stream.sample, periodic_stream.count, periodic_stream.seq++, data);
+
+	struct gecko_msg_le_gap_bt5_set_adv_data_rsp_t *ret = gecko_cmd_le_gap_bt5_set_adv_data(PERIODIC_STREAM_ADV_HANDLE, 8,
+			len, data);
+	if (ret->result != 0)
+	{
+		#if INCLUDE_LOGGING
+			LOG_ERROR("ERROR: %d | response code from gecko_cmd_le_gap_bt5_set_adv_data()", ret->result);
+		#endif
+		return;
+	}
+
+	periodic_stream.packets++;
+}
+
+#endif
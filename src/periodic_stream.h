@@ -0,0 +1,100 @@
+/*********************************************************************************************
+ *  @file  periodic_stream.h
+ *	@brief Live samples on a periodic advertising train. The server runs an extended
+ *		   advertising set (set 2) with periodic advertising at the sample period and puts
+ *		   the newest PERIODIC_STREAM_SAMPLES samples into every periodic packet as one
+ *		   delta coded live frame (live_frame.h). Any number of clients sync to the train
+ *		   and receive every sample at a fixed time without a connection, so a desk display
+ *		   and a logger cost the server one TX schedule instead of one connection each.
+ *
+ *		   Nothing is acknowledged. Each packet repeats the samples of the packets before
+ *		   it, so a receiver that misses up to PERIODIC_STREAM_SAMPLES - 1 packets in a row
+ *		   still gets every sample. The frame sequence number counts samples (of the newest
+ *		   one), the receiver counts the ones it never got from that.
+ *
+ *  @authors : Rajat Chaple (GATT client code)
+ *  		   Sundar Krishnakumar (GATT server code)
+ *
+ *  @date      April 29, 2020 (last update)
+ **********************************************************************************************/
+#include "ble_device_type.h"
+
+#ifndef __PERIODIC_STREAM_H__
+#define __PERIODIC_STREAM_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "live_frame.h"
+
+// 1: the server streams live samples on periodic advertising, clients sync to it
+#define PERIODIC_STREAM					(1)
+
+// Samples in every periodic packet, newest last
+#define PERIODIC_STREAM_SAMPLES			(4)
+
+#define PERIODIC_STREAM_MAX_LEN			(LIVE_FRAME_HEADER_LEN + LIVE_FRAME_FIRST_SAMPLE_LEN + \
+										 (PERIODIC_STREAM_SAMPLES - 1) * LIVE_FRAME_DELTA_SAMPLE_MAX_LEN)
+
+#if BUILD_INCLUDES_BLE_CLIENT
+
+#include "native_gecko.h"
+
+#define PERIODIC_STREAM_SYNC_INVALID	(0xFF)
+
+#define PERIODIC_STREAM_DATA_COMPLETE	(0)		// sync_data data_status
+
+// Periodic packets missed in a row before the sync is given up, then it is opened again
+// from the next extended scan report
+#define PERIODIC_STREAM_SYNC_MISSES		(6)
+
+typedef struct periodic_client_s
+{
+	uint8_t sync;				// PERIODIC_STREAM_SYNC_INVALID if neither synced nor opening
+	bool opening;				// sync_open sent, waiting for sync_opened
+	bool seq_valid;
+	uint8_t last_seq;			// sample number of the newest sample taken
+	uint32_t last_t_ms;			// its time, ms since the server session started
+
+	uint32_t syncs;				// syncs established
+	uint32_t sync_lost;
+	uint32_t packets;
+	uint32_t samples;			// new samples taken
+	uint32_t missed;			// samples never received (more packets lost than the overlap covers)
+
+}periodic_client_t;
+
+extern periodic_client_t periodic_client;
+
+void periodic_client_scan_report(bd_addr address, uint8_t address_type, uint8_t adv_sid, uint16_t periodic_interval);
+void periodic_client_sync_opened(uint8_t sync);
+void periodic_client_sync_closed(void);
+void periodic_client_close(void);
+uint8_t periodic_client_data(const uint8_t *data, uint8_t len, uint8_t data_status, live_sample_t *samples);
+void periodic_client_log_stats(void);
+
+#else
+
+// Set 0 is the connectable one, set 1 the posture broadcast (broadcast.h)
+#define PERIODIC_STREAM_ADV_HANDLE		(2)
+
+// Extended advertising events a receiver needs to find the train, the samples are in the periodic packets
+#define PERIODIC_STREAM_ADV_INTERVAL_MS	(1000)
+
+typedef struct
+{
+	live_sample_t sample[PERIODIC_STREAM_SAMPLES];	// oldest first
+	uint8_t count;
+	uint8_t seq;				// sample number of the newest sample
+
+	uint32_t packets;			// periodic data updates
+
+}periodic_stream_typedef;
+
+extern periodic_stream_typedef periodic_stream;
+
+void periodic_stream_start(void);
+void periodic_stream_add_sample(void);
+
+#endif
+
+#endif /* __PERIODIC_STREAM_H__ */
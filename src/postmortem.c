@@ -0,0 +1,416 @@
+/*********************************************************************************************
+ *  @file postmortem.c
+ *	@brief Post-mortem log on the MX25 SPI flash, see postmortem.h for the page format.
+ *
+ *		   The RAM page lives in the .noinit section (see the linker script), which the
+ *		   startup code neither loads nor clears. It is trusted after a reset only if its
+ *		   magic and length check hold and the reset was not a power-on or brown-out.
+ *
+ *  @authors : Sundar Krishnakumar (GATT server code)
+ *
+ *
+ *  @date      April 29, 2020 (last update)
+ *
+ **********************************************************************************************/
+#include "ble_device_type.h"
+#if BUILD_INCLUDES_BLE_CLIENT
+
+#else
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include "postmortem.h"
+#include "crc16.h"
+#include "spi_flash.h"
+#include "em_rmu.h"
+#include "infrastructure.h"
+
+
+postmortem_typedef postmortem;
+
+static postmortem_ram_typedef postmortem_ram __attribute__ ((section(".noinit")));
+
+// Reset causes after which RAM content is undefined
+#define POSTMORTEM_RAM_LOST_CAUSES	(RMU_RSTCAUSE_PORST | RMU_RSTCAUSE_AVDDBOD | RMU_RSTCAUSE_DVDDBOD | RMU_RSTCAUSE_DECBOD)
+
+
+////////////////////////////////////////////// Flash access ///////////////////////////////////////////////////////////////
+
+static uint32_t postmortem_page_addr(uint32_t seq)
+{
+	return POSTMORTEM_FLASH_BASE + (seq % POSTMORTEM_PAGES) * POSTMORTEM_PAGE_SIZE;
+}
+
+// Reads a page header, returns 1 if it carries the magic. Flash must be awake.
+static uint8_t postmortem_read_header(uint32_t page, uint8_t *hdr)
+{
+
+	MX25_READ(POSTMORTEM_FLASH_BASE + page * POSTMORTEM_PAGE_SIZE, hdr, POSTMORTEM_HEADER_LEN);
+
+	return (BYTES_TO_UINT16(hdr[0], hdr[1]) == POSTMORTEM_MAGIC);
+}
+
+static uint32_t postmortem_header_seq(const uint8_t *hdr)
+{
+	return (uint32_t)BYTES_TO_UINT16(hdr[4], hdr[5]) | ((uint32_t)BYTES_TO_UINT16(hdr[6], hdr[7]) << 16);
+}
+
+// Finds the newest page, same scheme as recorder_init(): first page of every sector, then
+// the pages of the newest sector.
+static void postmortem_scan(void)
+{
+	uint8_t hdr[POSTMORTEM_HEADER_LEN];
+	uint32_t newest_seq = 0;
+	uint32_t newest_sector = 0;
+	uint8_t found = 0;
+
+	for (uint32_t sector = 0; sector < POSTMORTEM_PAGES / POSTMORTEM_PAGES_PER_SECTOR; sector++)
+	{
+		uint32_t page = sector * POSTMORTEM_PAGES_PER_SECTOR;
+
+		if (postmortem_read_header(page, hdr) && (postmortem_header_seq(hdr) % POSTMORTEM_PAGES) == page &&
+			(found == 0 || postmortem_header_seq(hdr) > newest_seq))
+		{
+			newest_seq = postmortem_header_seq(hdr);
+			newest_sector = sector;
+			found = 1;
+		}
+	}
+
+	if (found == 0)
+	{
+		return;
+	}
+
+	for (uint32_t i = 1; i < POSTMORTEM_PAGES_PER_SECTOR; i++)
+	{
+		uint32_t page = newest_sector * POSTMORTEM_PAGES_PER_SECTOR + i;
+
+		if (postmortem_read_header(page, hdr) == 0 || postmortem_header_seq(hdr) != newest_seq + 1)
+		{
+			break;
+		}
+		newest_seq++;
+	}
+
+	postmortem.valid = 1;
+	postmortem.next_seq = newest_seq + 1;
+
+	uint32_t sector_first = newest_seq - (newest_seq % POSTMORTEM_PAGES_PER_SECTOR);
+	postmortem.oldest_seq = (sector_first + POSTMORTEM_PAGES_PER_SECTOR > POSTMORTEM_PAGES) ?
+							(sector_first + POSTMORTEM_PAGES_PER_SECTOR - POSTMORTEM_PAGES) : 0;
+}
+
+
+////////////////////////////////////////////// RAM page ///////////////////////////////////////////////////////////////
+
+static void postmortem_ram_reset(void)
+{
+
+	postmortem_ram.magic = POSTMORTEM_RAM_MAGIC;
+	postmortem_ram.session = recorder.session;
+	postmortem_ram.len = 0;
+	postmortem_ram.len_check = (uint8_t)~0;
+	postmortem_ram.fault_magic = 0;
+
+}
+
+static uint8_t postmortem_ram_is_valid(void)
+{
+	return (postmortem_ram.magic == POSTMORTEM_RAM_MAGIC && postmortem_ram.len <= POSTMORTEM_TEXT_LEN &&
+			(uint8_t)(postmortem_ram.len_check ^ postmortem_ram.len) == 0xFF);
+}
+
+static const char *postmortem_cause_name(uint32_t cause)
+{
+
+	if (cause & RMU_RSTCAUSE_PORST)
+	{
+		return "power-on";
+	}
+	if (cause & (RMU_RSTCAUSE_AVDDBOD | RMU_RSTCAUSE_DVDDBOD | RMU_RSTCAUSE_DECBOD))
+	{
+		return "brown-out";
+	}
+	if (cause & RMU_RSTCAUSE_WDOGRST)
+	{
+		return "watchdog";
+	}
+	if (cause & RMU_RSTCAUSE_LOCKUPRST)
+	{
+		return "lockup";
+	}
+	if (cause & RMU_RSTCAUSE_SYSREQRST)
+	{
+		return "software";
+	}
+	if (cause & RMU_RSTCAUSE_EXTRST)
+	{
+		return "pin";
+	}
+
+	return "other";
+}
+
+
+/** -------------------------------------------------------------------------------------------
+ * @brief writes the RAM page to the next flash page. Called when a line does not fit, and at
+ * boot for the page left by the previous run. Erases the sector ahead when the page is the
+ * first of it, which drops the oldest 16 pages once the region has wrapped. A page that did
+ * not program is dropped, the next one goes to the same flash page.
+ *-------------------------------------------------------------------------------------------- **/
+void postmortem_flush(void)
+{
+	uint8_t page[POSTMORTEM_PAGE_SIZE];
+	uint8_t *ptr = page;
+	uint32_t seq = postmortem.next_seq;
+	uint32_t addr = postmortem_page_addr(seq);
+
+	if (postmortem_ram.len == 0)
+	{
+		return;
+	}
+
+	memset(page, 0xFF, sizeof(page));
+
+	UINT16_TO_BITSTREAM(ptr, POSTMORTEM_MAGIC);
+	UINT8_TO_BITSTREAM(ptr, postmortem_ram.len);
+	UINT8_TO_BITSTREAM(ptr, 0xFF);
+	UINT32_TO_BITSTREAM(ptr, seq);
+	UINT16_TO_BITSTREAM(ptr, postmortem_ram.session);
+	UINT16_TO_BITSTREAM(ptr, 0xFFFF);
+	memcpy(ptr, postmortem_ram.text, postmortem_ram.len);
+
+	uint16_t crc = crc16_update(CRC16_INIT, page, POSTMORTEM_PAGE_SIZE);
+	page[10] = (uint8_t)crc;
+	page[11] = (uint8_t)(crc >> 8);
+
+	spi_flash_begin();
+
+	if ((seq % POSTMORTEM_PAGES_PER_SECTOR) == 0)
+	{
+		if (MX25_SE(addr) != FlashOperationSuccess)
+		{
+			#if INCLUDE_LOGGING
+				LOG_ERROR("ERROR: MX25_SE() failed at 0x%lx", addr);
+			#endif
+		}
+
+		if (postmortem.valid && seq + POSTMORTEM_PAGES_PER_SECTOR > postmortem.oldest_seq + POSTMORTEM_PAGES)
+		{
+			postmortem.oldest_seq = seq + POSTMORTEM_PAGES_PER_SECTOR - POSTMORTEM_PAGES;
+		}
+	}
+
+	ReturnMsg ret = MX25_PP(addr, page, POSTMORTEM_PAGE_SIZE);
+
+	postmortem.active_us += spi_flash_end();
+
+	if (ret != FlashOperationSuccess)
+	{
+		#if INCLUDE_LOGGING
+			LOG_ERROR("ERROR: %d | response code from MX25_PP()", ret);
+		#endif
+	}
+	else
+	{
+		if (postmortem.valid == 0)
+		{
+			postmortem.oldest_seq = seq;
+			postmortem.valid = 1;
+		}
+		postmortem.pages++;
+		postmortem.next_seq++;
+	}
+
+	postmortem_ram.session = recorder.session;
+	postmortem_ram.len = 0;
+	postmortem_ram.len_check = (uint8_t)~0;
+}
+
+
+/** -------------------------------------------------------------------------------------------
+ * @brief appends one line to the RAM page. The flash is only written when the page is full.
+ * Lines longer than POSTMORTEM_LINE_MAX_LEN are cut.
+ *-------------------------------------------------------------------------------------------- **/
+void postmortem_log(const char *format, ...)
+{
+	char line[POSTMORTEM_LINE_MAX_LEN + 1];
+	va_list args;
+	int len;
+
+	len = snprintf(line, sizeof(line), "%lu ", recorder.session_time_ms);
+
+	va_start(args, format);
+	len += vsnprintf(&line[len], sizeof(line) - len, format, args);
+	va_end(args);
+
+	len = MIN(len, POSTMORTEM_LINE_MAX_LEN - 1);
+	line[len++] = '\n';
+
+	if (postmortem_ram.len + len > POSTMORTEM_TEXT_LEN)
+	{
+		postmortem_flush();
+	}
+
+	memcpy(&postmortem_ram.text[postmortem_ram.len], line, len);
+	postmortem_ram.len += len;
+	postmortem_ram.len_check = (uint8_t)~postmortem_ram.len;
+
+	postmortem.lines++;
+}
+
+
+/** -------------------------------------------------------------------------------------------
+ * @brief reads a whole page and checks its sequence number and CRC
+ *
+ * @return 1 if page holds the requested, intact page
+ *-------------------------------------------------------------------------------------------- **/
+uint8_t postmortem_read_page(uint32_t seq, uint8_t *page)
+{
+
+	if (postmortem.valid == 0 || seq < postmortem.oldest_seq || seq >= postmortem.next_seq)
+	{
+		return 0;
+	}
+
+	spi_flash_begin();
+	MX25_READ(postmortem_page_addr(seq), page, POSTMORTEM_PAGE_SIZE);
+	postmortem.active_us += spi_flash_end();
+
+	uint16_t crc = BYTES_TO_UINT16(page[10], page[11]);
+	page[10] = 0xFF;
+	page[11] = 0xFF;
+	uint16_t computed = crc16_update(CRC16_INIT, page, POSTMORTEM_PAGE_SIZE);
+	page[10] = (uint8_t)crc;
+	page[11] = (uint8_t)(crc >> 8);
+
+	return (BYTES_TO_UINT16(page[0], page[1]) == POSTMORTEM_MAGIC && postmortem_header_seq(page) == seq &&
+			page[2] <= POSTMORTEM_TEXT_LEN && crc == computed);
+}
+
+
+/** -------------------------------------------------------------------------------------------
+ * @brief prints the newest pages in flash on the UART, oldest first
+ *-------------------------------------------------------------------------------------------- **/
+void postmortem_dump(uint32_t pages)
+{
+	#if INCLUDE_LOGGING
+		uint8_t page[POSTMORTEM_PAGE_SIZE];
+		uint32_t seq = postmortem.oldest_seq;
+
+		if (postmortem.valid == 0)
+		{
+			return;
+		}
+
+		if (postmortem.next_seq - seq > pages)
+		{
+			seq = postmortem.next_seq - pages;
+		}
+
+		for (; seq < postmortem.next_seq; seq++)
+		{
+			if (postmortem_read_page(seq, page))
+			{
+				LOG_INFO("Post-mortem page %lu, session %u:\n%.*s", seq, BYTES_TO_UINT16(page[8], page[9]),
+						 page[2], (const char *)&page[POSTMORTEM_HEADER_LEN]);
+			}
+			else
+			{
+				LOG_WARN("Post-mortem page %lu unreadable", seq);
+			}
+		}
+	#else
+		(void)pages;
+	#endif
+}
+
+
+/** -------------------------------------------------------------------------------------------
+ * @brief finds the end of the log in flash, writes the page left in RAM by the previous run
+ * and logs the reset cause (and the fault registers after a hard fault). Call after
+ * recorder_init() so the lines carry the new session number.
+ *-------------------------------------------------------------------------------------------- **/
+void postmortem_init(void)
+{
+	uint32_t cause = RMU_ResetCauseGet();
+	uint8_t fault = 0;
+	uint32_t fault_regs[4];
+
+	RMU_ResetCauseClear();
+
+	memset(&postmortem, 0, sizeof(postmortem));
+	postmortem.reset_cause = cause;
+
+	spi_flash_begin();
+	postmortem_scan();
+	postmortem.active_us += spi_flash_end();
+
+	if ((cause & POSTMORTEM_RAM_LOST_CAUSES) == 0 && postmortem_ram_is_valid())
+	{
+		if (postmortem_ram.fault_magic == POSTMORTEM_RAM_MAGIC)
+		{
+			fault = 1;
+			fault_regs[0] = postmortem_ram.fault_pc;
+			fault_regs[1] = postmortem_ram.fault_lr;
+			fault_regs[2] = postmortem_ram.fault_cfsr;
+			fault_regs[3] = postmortem_ram.fault_hfsr;
+		}
+
+		postmortem_flush();
+	}
+
+	postmortem_ram_reset();
+
+	postmortem_log("boot session %u reset 0x%lx %s", recorder.session, cause, postmortem_cause_name(cause));
+
+	if (fault)
+	{
+		postmortem_log("hard fault pc 0x%08lx lr 0x%08lx cfsr 0x%08lx hfsr 0x%08lx",
+					   fault_regs[0], fault_regs[1], fault_regs[2], fault_regs[3]);
+	}
+
+	postmortem_dump(POSTMORTEM_DUMP_PAGES);
+
+	#if INCLUDE_LOGGING
+		LOG_INFO("Post-mortem: next page %lu, oldest %lu, reset cause 0x%lx", postmortem.next_seq, postmortem.oldest_seq, cause);
+	#endif
+}
+
+
+////////////////////////////////////////////// Fault handler ///////////////////////////////////////////////////////////////
+
+// Called with the exception stack frame: r0, r1, r2, r3, r12, lr, pc, xpsr
+static void __attribute__ ((used)) postmortem_fault(const uint32_t *frame)
+{
+
+	postmortem_ram.fault_pc = frame[6];
+	postmortem_ram.fault_lr = frame[5];
+	postmortem_ram.fault_cfsr = SCB->CFSR;
+	postmortem_ram.fault_hfsr = SCB->HFSR;
+	postmortem_ram.fault_magic = POSTMORTEM_RAM_MAGIC;
+
+	// The RAM page is written to flash at the next boot
+	NVIC_SystemReset();
+
+}
+
+/** -------------------------------------------------------------------------------------------
+ * @brief replaces the weak default handler (an endless loop) of the startup code. Picks the
+ * stack the fault was taken on and passes its frame to postmortem_fault().
+ *-------------------------------------------------------------------------------------------- **/
+void __attribute__ ((naked)) HardFault_Handler(void)
+{
+	__asm volatile
+	(
+		"tst lr, #4				\n"
+		"ite eq					\n"
+		"mrseq r0, msp			\n"
+		"mrsne r0, psp			\n"
+		"b postmortem_fault		\n"
+	);
+}
+
+#endif
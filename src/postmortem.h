@@ -0,0 +1,98 @@
+/*********************************************************************************************
+ *  @file  postmortem.h
+ *	@brief Post-mortem log. Short text lines about key events (boot and reset cause,
+ *		   connections, bonding, calibration, faults) are collected in a RAM page that is not
+ *		   cleared at reset, and written to the top 64 kB of the MX25 SPI flash one whole page
+ *		   at a time, so the log costs one page program per ~240 bytes of text.
+ *
+ *		   A fault or watchdog reset leaves the RAM page in place; it is written to flash at
+ *		   the next boot together with the fault registers, so the last lines before a crash
+ *		   are not lost. The log of earlier boots is printed on the UART at boot (logging
+ *		   builds) and can be read back page by page with postmortem_read_page().
+ *
+ *		   Page header (little endian, POSTMORTEM_HEADER_LEN bytes):
+ *		     magic (uint16), text length (uint8), 0xFF, sequence (uint32), recorder session
+ *		     (uint16), CRC-16 over the page with this field as 0xFFFF (uint16)
+ *
+ *		   Each line starts with the recorder session time in ms, so it can be matched with
+ *		   the recorded IMU samples. Page n is at (n % POSTMORTEM_PAGES), like the recorder.
+ *
+ *  @authors : Sundar Krishnakumar (GATT server code)
+ *
+ *
+ *  @date      April 29, 2020 (last update)
+ *
+ **********************************************************************************************/
+#include "ble_device_type.h"
+#if BUILD_INCLUDES_BLE_CLIENT
+
+#else
+
+#ifndef __POSTMORTEM_H__
+#define __POSTMORTEM_H__
+
+#include <stdint.h>
+#include "recorder.h"
+
+// Region of the MX25 above the recorder
+#define POSTMORTEM_FLASH_BASE		(RECORDER_FLASH_BASE + RECORDER_FLASH_SIZE)
+#define POSTMORTEM_FLASH_SIZE		(0x010000)
+
+#define POSTMORTEM_PAGE_SIZE		(SPI_FLASH_PAGE_SIZE)
+#define POSTMORTEM_PAGES			(POSTMORTEM_FLASH_SIZE / POSTMORTEM_PAGE_SIZE)
+#define POSTMORTEM_PAGES_PER_SECTOR	(SPI_FLASH_SECTOR_SIZE / POSTMORTEM_PAGE_SIZE)
+
+#define POSTMORTEM_MAGIC			(0x4D50)		// "PM"
+#define POSTMORTEM_HEADER_LEN		(12)
+#define POSTMORTEM_TEXT_LEN			(POSTMORTEM_PAGE_SIZE - POSTMORTEM_HEADER_LEN)
+
+// Longest line, including the time stamp and the '\n'
+#define POSTMORTEM_LINE_MAX_LEN		(64)
+
+// Pages of earlier boots printed on the UART by postmortem_init() (logging builds)
+#define POSTMORTEM_DUMP_PAGES		(4)
+
+#define POSTMORTEM_RAM_MAGIC		(0x4D524D50)	// "PMRM"
+
+// Kept in .noinit, survives every reset but power-on and brown-out
+typedef struct
+{
+	uint32_t magic;
+	uint16_t session;			// recorder session the text belongs to
+	uint8_t len;				// text bytes used
+	uint8_t len_check;			// ~len, catches a half written length
+	uint8_t text[POSTMORTEM_TEXT_LEN];
+
+	// Written by the fault handler, logged at the next boot
+	uint32_t fault_magic;
+	uint32_t fault_pc;
+	uint32_t fault_lr;
+	uint32_t fault_cfsr;
+	uint32_t fault_hfsr;
+
+}postmortem_ram_typedef;
+
+typedef struct
+{
+	uint32_t next_seq;			// sequence number of the next page written
+	uint32_t oldest_seq;		// oldest page still in flash
+	uint8_t valid;				// 1 if at least one page is in flash
+	uint32_t reset_cause;		// RMU reset cause of this boot
+
+	uint32_t lines;				// lines logged since boot
+	uint32_t pages;				// pages written since boot
+	uint32_t active_us;			// time the flash was out of deep power-down
+
+}postmortem_typedef;
+
+extern postmortem_typedef postmortem;
+
+void postmortem_init(void);
+void postmortem_log(const char *format, ...) __attribute__ ((format (printf, 1, 2)));
+void postmortem_flush(void);
+uint8_t postmortem_read_page(uint32_t seq, uint8_t *page);
+void postmortem_dump(uint32_t pages);
+
+#endif /* __POSTMORTEM_H__ */
+
+#endif
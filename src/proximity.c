@@ -18,6 +18,7 @@
 #include "log.h"
 #include "i2cspmhalconfig.h"
 #include "proximity.h"
+#include "settings.h"
 #include "gpio.h"
 
 uint8_t read_data;
@@ -135,8 +136,8 @@ void proximity_sensor_config()
 	blocking_write_i2c(0x8A, 0);
 	blocking_write_i2c(0x8B, 0);
 	//HIGH Threshold
-	blocking_write_i2c(0x8C, ((PROXIMITY_SENSOR_THRESHOLD_VALUE & 0xFF00) >> 8));
-	blocking_write_i2c(0x8D, (PROXIMITY_SENSOR_THRESHOLD_VALUE & 0x00FF));
+	blocking_write_i2c(0x8C, ((settings.proximity_threshold & 0xFF00) >> 8));
+	blocking_write_i2c(0x8D, (settings.proximity_threshold & 0x00FF));
 	//clearing interrrupt from interrupt status register of proximity
 	blocking_write_i2c(0x8E,0x01);
 
@@ -245,7 +246,7 @@ void test_proximity_sensor()
 			case STATE_TEST_GESTURE:
 				if(gesture_event == false)
 				{
-					if(proximity_sensor_read(PROXIMITY_SENSED_VALUE_RAW) > PROXIMITY_SENSOR_THRESHOLD_VALUE)
+					if(proximity_sensor_read(PROXIMITY_SENSED_VALUE_RAW) > settings.proximity_threshold)
 					{
 						gpioLed1SetOn();
 						gesture_event = true;
@@ -253,7 +254,7 @@ void test_proximity_sensor()
 				}
 				else
 				{
-					if(proximity_sensor_read(PROXIMITY_SENSED_VALUE_RAW) < PROXIMITY_SENSOR_THRESHOLD_VALUE)
+					if(proximity_sensor_read(PROXIMITY_SENSED_VALUE_RAW) < settings.proximity_threshold)
 					{
 						gpioLed1SetOff();
 						gesture_event = false;
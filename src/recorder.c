@@ -0,0 +1,440 @@
+/*********************************************************************************************
+ *  @file recorder.c
+ *	@brief Session recorder on the MX25 SPI flash, see recorder.h for the block format.
+ *
+ *		   The MX25 shares USART1 with the LCD, every flash access is wrapped in
+ *		   spi_flash_begin() / spi_flash_end().
+ *
+ *		   A sector is erased when the first block of it is written, which also drops the
+ *		   oldest 16 blocks once the region has wrapped.
+ *
+ *  @authors : Sundar Krishnakumar (GATT server code)
+ *
+ *
+ *  @date      April 29, 2020 (last update)
+ *
+ **********************************************************************************************/
+#include "ble_device_type.h"
+#if BUILD_INCLUDES_BLE_CLIENT
+
+#else
+
+#include <string.h>
+#include "recorder.h"
+#include "crc16.h"
+#include "spi_flash.h"
+#include "infrastructure.h"
+
+
+recorder_typedef recorder;
+
+
+////////////////////////////////////////////// Flash access ///////////////////////////////////////////////////////////////
+
+static uint32_t recorder_page_addr(uint32_t seq)
+{
+	return RECORDER_FLASH_BASE + (seq % RECORDER_PAGES) * RECORDER_BLOCK_SIZE;
+}
+
+// Reads a block header, returns 1 if it carries the magic. Flash must be awake.
+static uint8_t recorder_read_header(uint32_t page, uint8_t *hdr)
+{
+
+	MX25_READ(RECORDER_FLASH_BASE + page * RECORDER_BLOCK_SIZE, hdr, RECORDER_HEADER_LEN);
+
+	return (BYTES_TO_UINT16(hdr[0], hdr[1]) == RECORDER_MAGIC);
+
+}
+
+static uint32_t recorder_header_seq(const uint8_t *hdr)
+{
+	return (uint32_t)hdr[4] | ((uint32_t)hdr[5] << 8) | ((uint32_t)hdr[6] << 16) | ((uint32_t)hdr[7] << 24);
+}
+
+static uint16_t recorder_header_session(const uint8_t *hdr)
+{
+	return BYTES_TO_UINT16(hdr[8], hdr[9]);
+}
+
+static uint32_t recorder_header_time(const uint8_t *hdr)
+{
+	return (uint32_t)hdr[12] | ((uint32_t)hdr[13] << 8) | ((uint32_t)hdr[14] << 16) | ((uint32_t)hdr[15] << 24);
+}
+
+
+////////////////////////////////////////////// Encoding ///////////////////////////////////////////////////////////////
+
+static void recorder_channels(const recorder_sample_typedef *s, int32_t *ch)
+{
+	ch[0] = s->accel.x;
+	ch[1] = s->accel.y;
+	ch[2] = s->accel.z;
+	ch[3] = s->gyro.x;
+	ch[4] = s->gyro.y;
+	ch[5] = s->gyro.z;
+}
+
+// Keyframe (first sample of a block): channels absolute, time in the header.
+// Otherwise time delta followed by channel deltas.
+static uint8_t recorder_encode(uint8_t *out, const recorder_sample_typedef *s, delta_codec_t *codec)
+{
+	int32_t ch[RECORDER_CHANNELS];
+	uint8_t len = 0;
+
+	recorder_channels(s, ch);
+	if (delta_codec_next_is_keyframe(codec) == 0)
+	{
+		len += delta_codec_put_varint(&out[len], s->t_ms - recorder.last.t_ms);
+	}
+	len += delta_codec_encode(codec, ch, &out[len]);
+
+	return len;
+}
+
+
+////////////////////////////////////////////// Block write ///////////////////////////////////////////////////////////////
+
+static void recorder_start_block(void)
+{
+
+	memset(recorder.block, 0xFF, sizeof(recorder.block));
+	recorder.block_len = 0;
+	recorder.block_count = 0;
+	delta_codec_reset(&recorder.codec);
+
+}
+
+// Fills in the header of the block being filled (the time of the first sample is already there)
+static void recorder_write_header(uint8_t *block)
+{
+	uint8_t *ptr = block;
+
+	UINT16_TO_BITSTREAM(ptr, RECORDER_MAGIC);
+	UINT8_TO_BITSTREAM(ptr, recorder.block_count);
+	UINT8_TO_BITSTREAM(ptr, recorder.block_len);
+	UINT32_TO_BITSTREAM(ptr, recorder.next_seq);
+	UINT16_TO_BITSTREAM(ptr, recorder.session);
+	UINT16_TO_BITSTREAM(ptr, 0xFFFF);
+
+	uint16_t crc = crc16_update(CRC16_INIT, block, RECORDER_BLOCK_SIZE);
+	block[10] = (uint8_t)crc;
+	block[11] = (uint8_t)(crc >> 8);
+}
+
+static void recorder_flush_block(void)
+{
+	uint32_t seq = recorder.next_seq;
+	uint32_t addr = recorder_page_addr(seq);
+
+	recorder_write_header(recorder.block);
+
+	spi_flash_begin();
+
+	if ((seq % RECORDER_PAGES_PER_SECTOR) == 0)
+	{
+		if (MX25_SE(addr) != FlashOperationSuccess)
+		{
+			#if INCLUDE_LOGGING
+				LOG_ERROR("ERROR: MX25_SE() failed at 0x%lx", addr);
+			#endif
+		}
+		recorder.stats.erases++;
+
+		// Erasing this sector dropped its previous blocks
+		if (recorder.valid && seq + RECORDER_PAGES_PER_SECTOR > recorder.oldest_seq + RECORDER_PAGES)
+		{
+			recorder.oldest_seq = seq + RECORDER_PAGES_PER_SECTOR - RECORDER_PAGES;
+		}
+	}
+
+	ReturnMsg ret = MX25_PP(addr, recorder.block, RECORDER_BLOCK_SIZE);
+
+	recorder.stats.active_us += spi_flash_end();
+
+	if (ret != FlashOperationSuccess)
+	{
+		#if INCLUDE_LOGGING
+			LOG_ERROR("ERROR: %d | response code from MX25_PP()", ret);
+		#endif
+	}
+	else
+	{
+		if (recorder.valid == 0)
+		{
+			recorder.oldest_seq = seq;
+			recorder.valid = 1;
+		}
+		recorder.stats.blocks++;
+		recorder.stats.payload_bytes += recorder.block_len;
+		recorder.stats.flash_bytes += RECORDER_BLOCK_SIZE;
+		recorder.next_seq++;
+	}
+
+	// A block that did not program is dropped, the next one goes to the same page
+	recorder_start_block();
+
+	#if INCLUDE_LOGGING
+		const recorder_stats_typedef *st = &recorder.stats;
+		LOG_INFO("Recorder: block %lu, %lu samples, %lu.%02lu bytes/sample, flash active %lu us, %lu bytes/s while active",
+				seq, st->samples, st->payload_bytes / st->samples, (st->payload_bytes % st->samples) * 100 / st->samples,
+				st->active_us, (st->active_us != 0) ? (uint32_t)((uint64_t)st->flash_bytes * 1000000 / st->active_us) : 0);
+	#endif
+}
+
+
+/** -------------------------------------------------------------------------------------------
+ * @brief finds the newest block in flash and starts a new session after it. Reads the first
+ * header of every sector and then the headers of the newest sector.
+ *-------------------------------------------------------------------------------------------- **/
+void recorder_init(void)
+{
+	uint8_t hdr[RECORDER_HEADER_LEN];
+	uint32_t newest_seq = 0;
+	uint32_t newest_sector = 0;
+	uint16_t newest_session = 0;
+	uint8_t found = 0;
+
+	memset(&recorder, 0, sizeof(recorder));
+	delta_codec_init(&recorder.codec, RECORDER_CHANNELS, 0);
+
+	spi_flash_begin();
+
+	for (uint32_t sector = 0; sector < RECORDER_PAGES / RECORDER_PAGES_PER_SECTOR; sector++)
+	{
+		uint32_t page = sector * RECORDER_PAGES_PER_SECTOR;
+
+		if (recorder_read_header(page, hdr) && (recorder_header_seq(hdr) % RECORDER_PAGES) == page &&
+			(found == 0 || recorder_header_seq(hdr) > newest_seq))
+		{
+			newest_seq = recorder_header_seq(hdr);
+			newest_session = recorder_header_session(hdr);
+			newest_sector = sector;
+			found = 1;
+		}
+	}
+
+	if (found)
+	{
+		for (uint32_t i = 1; i < RECORDER_PAGES_PER_SECTOR; i++)
+		{
+			uint32_t page = newest_sector * RECORDER_PAGES_PER_SECTOR + i;
+
+			if (recorder_read_header(page, hdr) == 0 || recorder_header_seq(hdr) != newest_seq + 1)
+			{
+				break;
+			}
+			newest_seq++;
+			newest_session = recorder_header_session(hdr);
+		}
+
+		recorder.valid = 1;
+		recorder.next_seq = newest_seq + 1;
+		recorder.session = newest_session + 1;
+
+		// Everything but the sector being filled may still hold older blocks
+		uint32_t sector_first = newest_seq - (newest_seq % RECORDER_PAGES_PER_SECTOR);
+		recorder.oldest_seq = (sector_first + RECORDER_PAGES_PER_SECTOR > RECORDER_PAGES) ?
+							  (sector_first + RECORDER_PAGES_PER_SECTOR - RECORDER_PAGES) : 0;
+	}
+
+	recorder.stats.active_us += spi_flash_end();
+
+	recorder_start_block();
+
+	#if INCLUDE_LOGGING
+		LOG_INFO("Recorder: session %d, next block %lu, oldest %lu", recorder.session, recorder.next_seq, recorder.oldest_seq);
+	#endif
+}
+
+
+/** -------------------------------------------------------------------------------------------
+ * @brief appends one sample. The flash is only touched when a block is full.
+ *
+ * @param dt_ms : time since the previous sample
+ *-------------------------------------------------------------------------------------------- **/
+void recorder_append(const accel_data_typedef *accel, const gyro_data_typedef *gyro, uint32_t dt_ms)
+{
+	recorder_sample_typedef sample;
+	uint8_t encoded[RECORDER_SAMPLE_MAX_LEN];
+	delta_codec_t codec = recorder.codec;
+	uint8_t len;
+
+	if (recorder.stats.samples != 0)
+	{
+		recorder.session_time_ms += dt_ms;
+	}
+
+	sample.t_ms = recorder.session_time_ms;
+	sample.accel = *accel;
+	sample.gyro = *gyro;
+
+	// Encoded on a copy of the codec, the sample may have to start a new block instead
+	len = recorder_encode(encoded, &sample, &codec);
+
+	if (recorder.block_len + len > RECORDER_PAYLOAD_LEN)
+	{
+		recorder_flush_block();
+		codec = recorder.codec;
+		len = recorder_encode(encoded, &sample, &codec);
+	}
+
+	if (recorder.block_count == 0)
+	{
+		uint8_t *ptr = &recorder.block[12];
+		UINT32_TO_BITSTREAM(ptr, sample.t_ms);
+	}
+
+	memcpy(&recorder.block[RECORDER_HEADER_LEN + recorder.block_len], encoded, len);
+	recorder.block_len += len;
+	recorder.block_count++;
+	recorder.codec = codec;
+	recorder.last = sample;
+	recorder.stats.samples++;
+}
+
+
+/** -------------------------------------------------------------------------------------------
+ * @brief finds the block holding the sample at (session, t_ms), or the first block after it.
+ * Bisection over the block sequence numbers, one header read per step.
+ *
+ * @return 1 and *seq if such a block is in flash
+ *-------------------------------------------------------------------------------------------- **/
+uint8_t recorder_locate(uint16_t session, uint32_t t_ms, uint32_t *seq)
+{
+	uint8_t hdr[RECORDER_HEADER_LEN];
+	uint32_t lo;
+	uint32_t hi;
+
+	if (recorder.valid == 0 || recorder.next_seq == recorder.oldest_seq)
+	{
+		return 0;
+	}
+
+	// Invariant: blocks before lo start before the target, blocks from hi on after it
+	lo = recorder.oldest_seq;
+	hi = recorder.next_seq;
+
+	spi_flash_begin();
+
+	while (lo < hi)
+	{
+		uint32_t mid = lo + (hi - lo) / 2;
+
+		recorder_read_header(mid % RECORDER_PAGES, hdr);
+
+		uint16_t s = recorder_header_session(hdr);
+		uint32_t t = recorder_header_time(hdr);
+
+		if (s < session || (s == session && t <= t_ms))
+		{
+			lo = mid + 1;
+		}
+		else
+		{
+			hi = mid;
+		}
+	}
+
+	recorder.stats.active_us += spi_flash_end();
+
+	// lo is the first block starting after the target; the one before it may contain it
+	*seq = (lo > recorder.oldest_seq) ? (lo - 1) : lo;
+	if (*seq >= recorder.next_seq)
+	{
+		return 0;
+	}
+
+	return 1;
+}
+
+
+/** -------------------------------------------------------------------------------------------
+ * @brief reads a whole block and checks its sequence number and CRC. seq == next_seq returns
+ * the block still being filled in RAM (if it holds a sample), so readers can follow the
+ * recording up to the newest sample.
+ *
+ * @return 1 if block holds the requested, intact block
+ *-------------------------------------------------------------------------------------------- **/
+uint8_t recorder_read_block(uint32_t seq, uint8_t *block)
+{
+
+	if (seq == recorder.next_seq && recorder.block_count != 0)
+	{
+		memcpy(block, recorder.block, RECORDER_BLOCK_SIZE);
+		recorder_write_header(block);
+		return 1;
+	}
+
+	if (recorder.valid == 0 || seq < recorder.oldest_seq || seq >= recorder.next_seq)
+	{
+		return 0;
+	}
+
+	spi_flash_begin();
+	MX25_READ(recorder_page_addr(seq), block, RECORDER_BLOCK_SIZE);
+	recorder.stats.active_us += spi_flash_end();
+
+	uint16_t crc = BYTES_TO_UINT16(block[10], block[11]);
+	block[10] = 0xFF;
+	block[11] = 0xFF;
+	uint16_t computed = crc16_update(CRC16_INIT, block, RECORDER_BLOCK_SIZE);
+	block[10] = (uint8_t)crc;
+	block[11] = (uint8_t)(crc >> 8);
+
+	return (BYTES_TO_UINT16(block[0], block[1]) == RECORDER_MAGIC && recorder_header_seq(block) == seq && crc == computed);
+
+}
+
+
+/** -------------------------------------------------------------------------------------------
+ * @brief decodes the samples of a block read with recorder_read_block()
+ *
+ * @return number of samples written to 'samples'
+ *-------------------------------------------------------------------------------------------- **/
+uint8_t recorder_decode_block(const uint8_t *block, recorder_sample_typedef *samples, uint8_t max_samples)
+{
+	const uint8_t *ptr = &block[RECORDER_HEADER_LEN];
+	const uint8_t *end = ptr + MIN(block[3], RECORDER_PAYLOAD_LEN);
+	uint8_t count = MIN(block[2], max_samples);
+	int32_t ch[RECORDER_CHANNELS];
+	uint32_t t_ms = recorder_header_time(block);
+	delta_codec_t codec;
+
+	delta_codec_init(&codec, RECORDER_CHANNELS, 0);
+
+	for (uint8_t n = 0; n < count; n++)
+	{
+		uint32_t value;
+		uint8_t len;
+
+		if (n != 0)
+		{
+			len = delta_codec_get_varint(ptr, end, &value);
+			if (len == 0)
+			{
+				return n;
+			}
+			ptr += len;
+			t_ms += value;
+		}
+
+		len = delta_codec_decode(&codec, ptr, end, ch);
+		if (len == 0)
+		{
+			return n;
+		}
+		ptr += len;
+
+		samples[n].t_ms = t_ms;
+		samples[n].accel.x = (int16_t)ch[0];
+		samples[n].accel.y = (int16_t)ch[1];
+		samples[n].accel.z = (int16_t)ch[2];
+		samples[n].gyro.x = (int16_t)ch[3];
+		samples[n].gyro.y = (int16_t)ch[4];
+		samples[n].gyro.z = (int16_t)ch[5];
+	}
+
+	return count;
+}
+
+#endif
@@ -0,0 +1,109 @@
+/*********************************************************************************************
+ *  @file  recorder.h
+ *	@brief Session recorder. Every IMU sample is appended to the external MX25 SPI NOR flash,
+ *		   whether or not a client is connected, so the history can be read back later.
+ *
+ *		   Samples are packed into 256 byte blocks (one flash page). Each block starts with
+ *		   a header and a keyframe; the following samples are a varint time delta and the
+ *		   delta_codec.h channel deltas, so a block decodes on its own.
+ *
+ *		   Block header (little endian, RECORDER_HEADER_LEN bytes):
+ *		     magic (uint16), sample count (uint8), payload length (uint8), sequence (uint32),
+ *		     session (uint16), CRC-16 over the block with this field as 0xFFFF (uint16),
+ *		     time of the first sample, ms since the session started (uint32)
+ *
+ *		   Block n is always at page (n % RECORDER_PAGES), so the block headers form a sorted
+ *		   index: a time range is found by bisection over the sequence numbers, reading one
+ *		   header per step, without scanning the flash.
+ *
+ *		   The flash is woken for each block write and put back in deep power-down after it.
+ *
+ *  @authors : Sundar Krishnakumar (GATT server code)
+ *
+ *
+ *  @date      April 29, 2020 (last update)
+ *
+ **********************************************************************************************/
+#include "ble_device_type.h"
+#if BUILD_INCLUDES_BLE_CLIENT
+
+#else
+
+#ifndef __RECORDER_H__
+#define __RECORDER_H__
+
+#include <stdint.h>
+#include "imu.h"
+#include "spi_flash.h"
+#include "delta_codec.h"
+
+// Region of the MX25 used for recording. The top 64 kB are left for other logs.
+#define RECORDER_FLASH_BASE			(0x000000)
+#define RECORDER_FLASH_SIZE			(0x0F0000)
+
+#define RECORDER_BLOCK_SIZE			(SPI_FLASH_PAGE_SIZE)
+#define RECORDER_SECTOR_SIZE		(SPI_FLASH_SECTOR_SIZE)
+#define RECORDER_PAGES				(RECORDER_FLASH_SIZE / RECORDER_BLOCK_SIZE)
+#define RECORDER_PAGES_PER_SECTOR	(RECORDER_SECTOR_SIZE / RECORDER_BLOCK_SIZE)
+
+#define RECORDER_MAGIC				(0x5253)	// "SR"
+#define RECORDER_HEADER_LEN			(16)
+#define RECORDER_PAYLOAD_LEN		(RECORDER_BLOCK_SIZE - RECORDER_HEADER_LEN)
+
+// accel x/y/z, gyro x/y/z
+#define RECORDER_CHANNELS			(6)
+
+// Worst case encoded sample: 5 byte time delta + 6 channels of 3 bytes
+#define RECORDER_SAMPLE_MAX_LEN		(DELTA_CODEC_VARINT_MAX_LEN + RECORDER_CHANNELS * DELTA_CODEC_INT16_MAX_LEN)
+
+// Most samples a block can hold (smallest encoded sample: 1 byte time delta + 6 x 1 byte)
+#define RECORDER_BLOCK_MAX_SAMPLES	(RECORDER_PAYLOAD_LEN / 7 + 1)
+
+typedef struct
+{
+	uint32_t t_ms;				// ms since the session started
+	accel_data_typedef accel;	// milli-g
+	gyro_data_typedef gyro;		// millirad/s, bias corrected
+
+}recorder_sample_typedef;
+
+typedef struct
+{
+	uint32_t samples;			// samples appended since boot
+	uint32_t blocks;			// blocks written since boot
+	uint32_t payload_bytes;		// encoded sample bytes in the written blocks
+	uint32_t flash_bytes;		// bytes programmed (whole blocks)
+	uint32_t active_us;			// time the flash was out of deep power-down
+	uint32_t erases;
+
+}recorder_stats_typedef;
+
+typedef struct
+{
+	uint16_t session;			// incremented on every boot
+	uint32_t session_time_ms;
+	uint32_t next_seq;			// sequence number of the block being filled
+	uint32_t oldest_seq;		// oldest block still in flash
+	uint8_t valid;				// 1 if at least one block is in flash
+
+	uint8_t block[RECORDER_BLOCK_SIZE];
+	uint8_t block_len;			// payload bytes used
+	uint8_t block_count;
+	delta_codec_t codec;		// keyframe at the start of every block
+	recorder_sample_typedef last;
+
+	recorder_stats_typedef stats;
+
+}recorder_typedef;
+
+extern recorder_typedef recorder;
+
+void recorder_init(void);
+void recorder_append(const accel_data_typedef *accel, const gyro_data_typedef *gyro, uint32_t dt_ms);
+uint8_t recorder_locate(uint16_t session, uint32_t t_ms, uint32_t *seq);
+uint8_t recorder_read_block(uint32_t seq, uint8_t *block);
+uint8_t recorder_decode_block(const uint8_t *block, recorder_sample_typedef *samples, uint8_t max_samples);
+
+#endif /* __RECORDER_H__ */
+
+#endif
@@ -0,0 +1,188 @@
+/*********************************************************************************************
+ *  @file scan_schedule.c
+ *	@brief Fast then slow scanning of the client, see scan_schedule.h.
+ *
+ *  @authors : Rajat Chaple (GATT client code)
+ *
+ *
+ *  @date      April 29, 2020 (last update)
+ *
+ **********************************************************************************************/
+#include "ble_device_type.h"
+#if BUILD_INCLUDES_BLE_CLIENT
+
+#include "scan_schedule.h"
+#include "native_gecko.h"
+#include "gecko_ble_errors.h"
+#include "history.h"
+#include "log.h"
+
+
+scan_schedule_t scan_schedule;
+
+// 25 ms window: 50 % (the old fixed 80/40) for 30 s, then half the duty cycle for twice as long
+static const scan_schedule_stage_t scan_schedule_stages[] = {
+	{50, 25, 30},
+	{100, 25, 60},
+	{200, 25, 120},
+	{400, 25, 240},
+	{800, 25, 480},
+	{1600, 25, 3600}
+};
+
+#define SCAN_SCHEDULE_STAGES		(sizeof(scan_schedule_stages) / sizeof(scan_schedule_stages[0]))
+
+#define MS_IN_MINUTE				(60000)
+#define MS_IN_HOUR					(3600000)
+
+
+static uint32_t scan_schedule_ms_since(uint32_t ticks)
+{
+	return (uint32_t)((uint64_t)(history_time_ticks() - ticks) * 1000 / HISTORY_TIMER_FREQ);
+}
+
+// Scan-on time of the current stage so far
+static uint32_t scan_schedule_stage_on_ms(void)
+{
+	const scan_schedule_stage_t *s = &scan_schedule_stages[scan_schedule.stage];
+
+	return (uint32_t)((uint64_t)scan_schedule_ms_since(scan_schedule.stage_ticks) * s->window_ms / s->interval_ms);
+}
+
+static void scan_schedule_timer_set(uint32_t ticks)
+{
+	BTSTACK_CHECK_RESPONSE(gecko_cmd_hardware_set_soft_timer(ticks, SCAN_SCHEDULE_TIMER_HANDLE, 1));
+}
+
+/** -------------------------------------------------------------------------------------------
+ * @brief (re)starts discovery at the timing of 'stage'. The timing only applies when
+ * discovery is started, so a running one is stopped first.
+ *-------------------------------------------------------------------------------------------- **/
+static void scan_schedule_enter(uint8_t stage)
+{
+	const scan_schedule_stage_t *s = &scan_schedule_stages[stage];
+
+	if (scan_schedule.scanning)
+	{
+		scan_schedule.on_ms += scan_schedule_stage_on_ms();
+		BTSTACK_CHECK_RESPONSE(gecko_cmd_le_gap_end_procedure());
+	}
+
+	// 0.625 ms units
+	BTSTACK_CHECK_RESPONSE(gecko_cmd_le_gap_set_discovery_timing(le_gap_phy_1m, s->interval_ms * 8 / 5, s->window_ms * 8 / 5));
+	BTSTACK_CHECK_RESPONSE(gecko_cmd_le_gap_start_discovery(le_gap_phy_1m, le_gap_discover_generic));
+
+	scan_schedule.scanning = true;
+	scan_schedule.stage = stage;
+	scan_schedule.stage_ticks = history_time_ticks();
+
+	scan_schedule_timer_set((uint32_t)s->duration_s * HISTORY_TIMER_FREQ);
+}
+
+
+// Boot and disconnect
+void scan_schedule_start(void)
+{
+
+	scan_schedule.scanning = false;
+	scan_schedule.start_ticks = history_time_ticks();
+	scan_schedule.on_ms = 0;
+	scan_schedule_enter(0);
+
+}
+
+// SCAN_SCHEDULE_TIMER_HANDLE expired, backs off to the next stage. The last one keeps
+// scanning, the timer only logs from then on.
+void scan_schedule_timer(void)
+{
+
+	if (scan_schedule.scanning == false)
+	{
+		return;
+	}
+
+	if ((uint32_t)scan_schedule.stage + 1 < SCAN_SCHEDULE_STAGES)
+	{
+		scan_schedule_enter(scan_schedule.stage + 1);
+	}
+	else
+	{
+		scan_schedule_timer_set((uint32_t)scan_schedule_stages[scan_schedule.stage].duration_s * HISTORY_TIMER_FREQ);
+	}
+	scan_schedule_log_stats();
+
+}
+
+// Server found, discovery has been stopped to connect to it
+void scan_schedule_found(void)
+{
+
+	if (scan_schedule.scanning == false)
+	{
+		return;
+	}
+
+	scan_schedule.on_ms += scan_schedule_stage_on_ms();
+	scan_schedule.scanning = false;
+	scan_schedule_timer_set(0);
+
+	scan_schedule.found++;
+	scan_schedule.present_ms += scan_schedule_ms_since(scan_schedule.start_ticks);
+	scan_schedule.present_on_ms += scan_schedule.on_ms;
+
+	scan_schedule_log_stats();
+
+}
+
+// Proximity or a button: fast again if it had backed off
+void scan_schedule_wake(void)
+{
+
+	if (scan_schedule.scanning && scan_schedule.stage != 0)
+	{
+		scan_schedule.wakes++;
+		scan_schedule_enter(0);
+	}
+
+}
+
+// Scan report received, the controller has passed it to the host
+void scan_schedule_report(void)
+{
+
+	scan_schedule.reports++;
+
+}
+
+// Scan-on time per hour of scanning while the server is present (scans that found it) and
+// while it is absent (the scan still running), reports per minute of scanning
+void scan_schedule_log_stats(void)
+{
+
+	#if INCLUDE_LOGGING
+		uint32_t absent_ms = 0;
+		uint32_t absent_on_ms = 0;
+
+		if (scan_schedule.scanning)
+		{
+			absent_ms = scan_schedule_ms_since(scan_schedule.start_ticks);
+			absent_on_ms = scan_schedule.on_ms + scan_schedule_stage_on_ms();
+		}
+
+		uint32_t scan_ms = scan_schedule.present_ms + absent_ms;
+		uint32_t reports_per_minute = (scan_ms != 0) ? (uint32_t)((uint64_t)scan_schedule.reports * MS_IN_MINUTE / scan_ms) : 0;
+		uint32_t present_per_hour = (scan_schedule.present_ms != 0) ?
+				(uint32_t)((uint64_t)scan_schedule.present_on_ms * MS_IN_HOUR / scan_schedule.present_ms) : 0;
+		uint32_t absent_per_hour = (absent_ms != 0) ? (uint32_t)((uint64_t)absent_on_ms * MS_IN_HOUR / absent_ms) : 0;
+
+		LOG_INFO("Scanning: stage %u, %lu wakes, %lu reports (%lu per minute)", scan_schedule.stage, scan_schedule.wakes,
+				scan_schedule.reports, reports_per_minute);
+		LOG_INFO("Scanning: present %lu ms on per hour (%lu found, %lu ms on in %lu ms)",
+				present_per_hour, scan_schedule.found, scan_schedule.present_on_ms, scan_schedule.present_ms);
+		LOG_INFO("Scanning: absent %lu ms on per hour (%lu ms on in %lu ms)",
+				absent_per_hour, absent_on_ms, absent_ms);
+	#endif
+
+}
+
+#endif
@@ -0,0 +1,69 @@
+/*********************************************************************************************
+ *  @file  scan_schedule.h
+ *	@brief Scanning of the client for its server, fast then slow. Discovery starts at a high
+ *		   duty cycle so a server that is around (boot, or it just dropped) is found within
+ *		   a few of its advertising events, then the scan interval doubles in stages at the
+ *		   same window while the server is not found, down to ~1.5 % of the radio time.
+ *		   Proximity or a button press starts over from the fast stage: the user is at the
+ *		   desk, so the server most likely is too.
+ *
+ *		   The scan-on time is the time spent at each stage times its window / interval
+ *		   (the stack does not report it). It is kept apart for the scans that found the
+ *		   server (present) and the scan still looking for it (absent), each logged as ms of
+ *		   scan-on time per hour of scanning, at every stage change and hourly after. The
+ *		   scan reports passed to the host are logged per minute of scanning with them.
+ *
+ *  @authors : Rajat Chaple (GATT client code)
+ *
+ *
+ *  @date      April 29, 2020 (last update)
+ *
+ **********************************************************************************************/
+#include "ble_device_type.h"
+#if BUILD_INCLUDES_BLE_CLIENT
+
+#ifndef __SCAN_SCHEDULE_H__
+#define __SCAN_SCHEDULE_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Display refresh is soft timer 0
+#define SCAN_SCHEDULE_TIMER_HANDLE		(5)
+
+typedef struct scan_schedule_stage_s
+{
+	uint16_t interval_ms;
+	uint16_t window_ms;
+	uint16_t duration_s;				// last stage: log period, it lasts until the server is found
+
+}scan_schedule_stage_t;
+
+typedef struct scan_schedule_s
+{
+	bool scanning;						// discovery running (not connected)
+	uint8_t stage;
+	uint32_t start_ticks;				// scanning started (boot or disconnect)
+	uint32_t stage_ticks;				// current stage entered
+	uint32_t on_ms;						// scan-on time since start_ticks
+
+	uint32_t wakes;						// back to the fast stage on proximity or a button
+	uint32_t reports;					// scan reports, each one wakes the host
+	uint32_t found;						// scans that found the server
+	uint32_t present_ms;				// time scanned by those
+	uint32_t present_on_ms;				// their scan-on time
+
+}scan_schedule_t;
+
+extern scan_schedule_t scan_schedule;
+
+void scan_schedule_start(void);
+void scan_schedule_timer(void);
+void scan_schedule_found(void);
+void scan_schedule_wake(void);
+void scan_schedule_report(void);
+void scan_schedule_log_stats(void);
+
+#endif /* __SCAN_SCHEDULE_H__ */
+
+#endif
@@ -15,6 +15,7 @@
 #include "log.h"
 #include "scheduler.h"
 #include "proximity.h"
+#include "settings.h"
 #include "main.h"
 #include "timers.h"
 #include "gpio.h"
@@ -96,7 +97,7 @@ void event_handler_proximity_state(struct gecko_cmd_packet* evt)
 //		blocking_write_i2c(0x8E, 0x00);
 		gpioLed1SetOn();
 		LOG_DEBUG("Proximity detected");
-		inactive_timer_seconds = THRESHOLD_TIME_ACTIVE_TO_INACTIVE_S;
+		inactive_timer_seconds = settings.inactive_timeout_s;
 		i2c_write_write((uint8_t*)&command_for_clearing_prox_interrupt);
 		gpioLed1SetOff();
 		break;
@@ -41,6 +41,8 @@ enum events{
 	LAST_EVENT_IN_THE_LIST = PROXIMITY_DETECTED
 };
 
+extern uint32_t inactive_timer_seconds;
+
 
 //function prototypes
 void scheduler_set_event_proximity_detected(void);
@@ -0,0 +1,173 @@
+/*********************************************************************************************
+ *  @file settings.c
+ *	@brief Loads the runtime settings from the key-value store at boot and writes them back
+ *		   when they are changed. Values that are missing or out of range keep their default.
+ *
+ *  @authors : Rajat Chaple (GATT client code)
+ *  		   Sundar Krishnakumar (GATT server code)
+ *
+ *  @date      April 29, 2020 (last update)
+ **********************************************************************************************/
+#include "ble_device_type.h"
+#include <string.h>
+#include "settings.h"
+#include "em_msc.h"
+#include "log.h"
+
+// Defined in the linker script, first page of the settings store
+extern uint32_t __kvStoreBase;
+
+kv_store_t settings_store;
+
+
+static void settings_mount(void)
+{
+
+	MSC_Init();
+
+	kv_status_t status = kv_store_init(&settings_store, &kv_flash_msc_ops, (uint32_t)&__kvStoreBase,
+									   FLASH_PAGE_SIZE, SETTINGS_KV_PAGE_COUNT);
+	if (status != KV_OK)
+	{
+		#if INCLUDE_LOGGING
+			LOG_ERROR("ERROR: %d | response code from kv_store_init()", status);
+		#endif
+	}
+
+	#if INCLUDE_LOGGING
+		LOG_INFO("Settings store: %lu records replayed in %lu cycles",
+				settings_store.stats.boot_records, settings_store.stats.boot_cycles);
+	#endif
+
+}
+
+
+static void settings_write(settings_key_t key, const void *value, uint8_t len)
+{
+	kv_status_t status = kv_store_set(&settings_store, (uint8_t)key, value, len);
+
+	if (status != KV_OK)
+	{
+		#if INCLUDE_LOGGING
+			LOG_ERROR("ERROR: %d | response code from kv_store_set(%d)", status, key);
+		#endif
+	}
+}
+
+
+#if BUILD_INCLUDES_BLE_CLIENT
+
+#include "proximity.h"
+#include "scheduler.h"
+#include "ble.h"
+
+settings_t settings = {
+	.proximity_threshold = PROXIMITY_SENSOR_THRESHOLD_VALUE,
+	.inactive_timeout_s = THRESHOLD_TIME_ACTIVE_TO_INACTIVE_S
+};
+
+
+/** -------------------------------------------------------------------------------------------
+ * @brief mounts the settings store and overrides the defaults with the stored values.
+ * Must be called before the proximity sensor is configured.
+ *-------------------------------------------------------------------------------------------- **/
+void settings_init(void)
+{
+	uint8_t buf[KV_MAX_VALUE_LEN];
+	uint8_t len;
+
+	settings_mount();
+
+	if (kv_store_get(&settings_store, SETTINGS_KEY_PROXIMITY_THRESHOLD, buf, sizeof(buf), &len) == KV_OK &&
+		len == sizeof(uint16_t))
+	{
+		settings.proximity_threshold = BYTES_TO_UINT16(buf[0], buf[1]);
+	}
+
+	if (kv_store_get(&settings_store, SETTINGS_KEY_INACTIVE_TIMEOUT, buf, sizeof(buf), &len) == KV_OK &&
+		len == sizeof(uint32_t))
+	{
+		uint32_t value;
+		memcpy(&value, buf, sizeof(value));
+		if (value != 0)
+		{
+			settings.inactive_timeout_s = value;
+		}
+	}
+
+}
+
+
+void settings_save(settings_key_t key)
+{
+
+	switch (key)
+	{
+		case SETTINGS_KEY_PROXIMITY_THRESHOLD:
+			settings_write(key, &settings.proximity_threshold, sizeof(settings.proximity_threshold));
+			break;
+
+		case SETTINGS_KEY_INACTIVE_TIMEOUT:
+			settings_write(key, &settings.inactive_timeout_s, sizeof(settings.inactive_timeout_s));
+			break;
+
+		default:
+			break;
+	}
+
+}
+
+#else
+
+#include "ble.h"
+
+extern uint8_t time_until_trigger[];
+extern uint8_t current_tut_index;
+extern uint8_t tut_options_max;
+
+
+/** -------------------------------------------------------------------------------------------
+ * @brief mounts the settings store and overrides the defaults with the stored values
+ *-------------------------------------------------------------------------------------------- **/
+void settings_init(void)
+{
+	uint8_t buf[KV_MAX_VALUE_LEN];
+	uint8_t len;
+
+	settings_mount();
+
+	if (kv_store_get(&settings_store, SETTINGS_KEY_TUT_OPTIONS, buf, sizeof(buf), &len) == KV_OK &&
+		len == tut_options_max)
+	{
+		memcpy(time_until_trigger, buf, len);
+	}
+
+	if (kv_store_get(&settings_store, SETTINGS_KEY_TUT_INDEX, buf, sizeof(buf), &len) == KV_OK &&
+		len == 1 && buf[0] < tut_options_max)
+	{
+		current_tut_index = buf[0];
+	}
+
+}
+
+
+void settings_save(settings_key_t key)
+{
+
+	switch (key)
+	{
+		case SETTINGS_KEY_TUT_OPTIONS:
+			settings_write(key, time_until_trigger, tut_options_max);
+			break;
+
+		case SETTINGS_KEY_TUT_INDEX:
+			settings_write(key, &current_tut_index, sizeof(current_tut_index));
+			break;
+
+		default:
+			break;
+	}
+
+}
+
+#endif
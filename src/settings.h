@@ -0,0 +1,52 @@
+/*********************************************************************************************
+ *  @file  settings.h
+ *	@brief Runtime settings kept in the key-value store (kv_store.c) on internal flash.
+ *		   Every setting has a compile time default (the macros it used to be), the stored
+ *		   value replaces it at boot when present and valid.
+ *
+ *  @authors : Rajat Chaple (GATT client code)
+ *  		   Sundar Krishnakumar (GATT server code)
+ *
+ *  @date      April 29, 2020 (last update)
+ **********************************************************************************************/
+#include "ble_device_type.h"
+
+#ifndef __SETTINGS_H__
+#define __SETTINGS_H__
+
+#include <stdint.h>
+#include "kv_store.h"
+
+// Pages reserved below the stack NVM by the linker script (__kvStoreBase)
+#define SETTINGS_KV_PAGE_COUNT		(4)
+
+// Keys are never reused, add new ones at the end
+typedef enum
+{
+	SETTINGS_KEY_TUT_OPTIONS = 1,		// server: time_until_trigger[] seconds
+	SETTINGS_KEY_TUT_INDEX,				// server: current_tut_index
+	SETTINGS_KEY_PROXIMITY_THRESHOLD,	// client: proximity interrupt threshold, raw counts
+	SETTINGS_KEY_INACTIVE_TIMEOUT,		// client: seconds without proximity before inactive
+	SETTINGS_KEY_TX_POWER_TABLE			// retired, was the client's RSSI to TX power table (tx_power.h)
+
+}settings_key_t;
+
+#if BUILD_INCLUDES_BLE_CLIENT
+
+typedef struct settings_s
+{
+	uint16_t proximity_threshold;
+	uint32_t inactive_timeout_s;
+
+}settings_t;
+
+extern settings_t settings;
+
+#endif
+
+extern kv_store_t settings_store;
+
+void settings_init(void);
+void settings_save(settings_key_t key);
+
+#endif /* __SETTINGS_H__ */
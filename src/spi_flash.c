@@ -0,0 +1,66 @@
+/*********************************************************************************************
+ *  @file spi_flash.c
+ *	@brief Power and bus handling for the MX25 SPI NOR flash, see spi_flash.h
+ *
+ *  @authors : Sundar Krishnakumar (GATT server code)
+ *
+ *
+ *  @date      April 29, 2020 (last update)
+ *
+ **********************************************************************************************/
+#include "ble_device_type.h"
+#if BUILD_INCLUDES_BLE_CLIENT
+
+#else
+
+#include "spi_flash.h"
+#include "displaypal.h"
+#include "em_cmu.h"
+
+
+static uint32_t spi_flash_active_start;
+
+
+static void spi_flash_delay_us(uint32_t us)
+{
+	uint32_t start = DWT->CYCCNT;
+	uint32_t cycles = us * (CMU_ClockFreqGet(cmuClock_CORE) / 1000000);
+
+	while ((DWT->CYCCNT - start) < cycles)
+	{
+	}
+}
+
+/** -------------------------------------------------------------------------------------------
+ * @brief takes the USART from the display and releases the MX25 from deep power-down
+ *-------------------------------------------------------------------------------------------- **/
+void spi_flash_begin(void)
+{
+	uint8_t id;
+
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+	spi_flash_active_start = DWT->CYCCNT;
+
+	MX25_init();
+	MX25_RES(&id);
+	spi_flash_delay_us(SPI_FLASH_WAKEUP_US);
+}
+
+/** -------------------------------------------------------------------------------------------
+ * @brief deep power-down, USART back to the display
+ *
+ * @return time the flash was out of deep power-down since spi_flash_begin(), microseconds
+ *-------------------------------------------------------------------------------------------- **/
+uint32_t spi_flash_end(void)
+{
+
+	MX25_DP();
+	PAL_SpiInit();
+
+	return (DWT->CYCCNT - spi_flash_active_start) / (CMU_ClockFreqGet(cmuClock_CORE) / 1000000);
+
+}
+
+#endif
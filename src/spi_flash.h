@@ -0,0 +1,38 @@
+/*********************************************************************************************
+ *  @file  spi_flash.h
+ *	@brief Power and bus handling for the MX25 SPI NOR flash, shared by the session recorder
+ *		   and the post-mortem log.
+ *
+ *		   The MX25 sits on USART1 together with the LCD. spi_flash_begin() takes the USART
+ *		   and releases the flash from deep power-down, spi_flash_end() puts it back to deep
+ *		   power-down and hands the USART back to the display driver.
+ *
+ *  @authors : Sundar Krishnakumar (GATT server code)
+ *
+ *
+ *  @date      April 29, 2020 (last update)
+ *
+ **********************************************************************************************/
+#include "ble_device_type.h"
+#if BUILD_INCLUDES_BLE_CLIENT
+
+#else
+
+#ifndef __SPI_FLASH_H__
+#define __SPI_FLASH_H__
+
+#include <stdint.h>
+#include "mx25flash_spi.h"
+
+#define SPI_FLASH_PAGE_SIZE			(256)		// MX25 program page
+#define SPI_FLASH_SECTOR_SIZE		(4096)		// MX25 erase sector
+
+// Release from deep power-down (tRES1) before the first command, microseconds
+#define SPI_FLASH_WAKEUP_US			(35)
+
+void spi_flash_begin(void);
+uint32_t spi_flash_end(void);
+
+#endif /* __SPI_FLASH_H__ */
+
+#endif
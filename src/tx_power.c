@@ -0,0 +1,200 @@
+/*********************************************************************************************
+ *  @file tx_power.c
+ *	@brief Closed loop TX power from the filtered RSSI of the links, see tx_power.h.
+ *
+ *  @authors : Rajat Chaple (GATT client code)
+ *  		   Sundar Krishnakumar (GATT server code)
+ *
+ *  @date      April 29, 2020 (last update)
+ **********************************************************************************************/
+#include "ble_device_type.h"
+#include <string.h>
+#include "tx_power.h"
+#include "native_gecko.h"
+#include "gecko_ble_errors.h"
+#include "history.h"
+#include "log.h"
+
+
+tx_power_stats_t tx_power_stats = {
+	.power = TX_POWER_IDLE_DBM10
+};
+
+static tx_power_link_t tx_power_link[TX_POWER_LINKS];
+
+
+static uint32_t tx_power_ms_since(uint32_t ticks)
+{
+	return (uint32_t)((uint64_t)(history_time_ticks() - ticks) * 1000 / HISTORY_TIMER_FREQ);
+}
+
+static bool tx_power_connected(void)
+{
+
+	for (uint8_t i = 0; i < TX_POWER_LINKS; i++)
+	{
+		if (tx_power_link[i].connected)
+		{
+			return true;
+		}
+	}
+	return false;
+
+}
+
+// Adds the time at the current power, only connected time counts for the average
+static void tx_power_account(void)
+{
+	uint32_t ms = tx_power_ms_since(tx_power_stats.power_ticks);
+
+	if (tx_power_connected())
+	{
+		tx_power_stats.connected_ms += ms;
+		tx_power_stats.power_ms += (int64_t)tx_power_stats.power * ms;
+	}
+	tx_power_stats.power_ticks = history_time_ticks();
+}
+
+/** -------------------------------------------------------------------------------------------
+ * @brief sets the radio to what the weakest connected link needs, TX_POWER_IDLE_DBM10 without
+ * a link. Called after a link changed, the caller has added the time at the old power.
+ *-------------------------------------------------------------------------------------------- **/
+static void tx_power_apply(void)
+{
+	int16_t power = TX_POWER_MIN_DBM10;
+	bool any = false;
+
+	for (uint8_t i = 0; i < TX_POWER_LINKS; i++)
+	{
+		if (tx_power_link[i].connected)
+		{
+			power = (tx_power_link[i].power > power) ? tx_power_link[i].power : power;
+			any = true;
+		}
+	}
+	if (any == false)
+	{
+		power = TX_POWER_IDLE_DBM10;
+	}
+	if (power == tx_power_stats.power)
+	{
+		return;
+	}
+
+	struct gecko_msg_system_set_tx_power_rsp_t *ret = gecko_cmd_system_set_tx_power(power);
+	tx_power_stats.power = ret->set_power;
+}
+
+void tx_power_connection_opened(uint8_t link)
+{
+
+	tx_power_account();
+	memset(&tx_power_link[link], 0, sizeof(tx_power_link[link]));
+	tx_power_link[link].connected = true;
+	tx_power_link[link].power = TX_POWER_IDLE_DBM10;
+	tx_power_link[link].step_ticks = history_time_ticks();
+	tx_power_stats.connections++;
+	tx_power_apply();
+
+}
+
+/** -------------------------------------------------------------------------------------------
+ * @brief RSSI of the peer on 'link'. The power our packets need at the peer is worked out from
+ * the smoothed RSSI, the link moves towards it by up to TX_POWER_STEP_DB once it is more than
+ * the hysteresis away and the last step is TX_POWER_STEP_MS old.
+ *-------------------------------------------------------------------------------------------- **/
+void tx_power_rssi(uint8_t link, int8_t rssi)
+{
+	tx_power_link_t *l = &tx_power_link[link];
+
+	if (l->connected == false)
+	{
+		return;
+	}
+
+	tx_power_stats.samples++;
+	if (l->rssi_valid == false)
+	{
+		l->rssi_q4 = (int16_t)rssi * 16;
+		l->rssi_valid = true;
+	}
+	else
+	{
+		l->rssi_q4 += ((int16_t)rssi * 16 - l->rssi_q4) / (1 << TX_POWER_EWMA_SHIFT);
+	}
+
+	#if TX_POWER_CONTROL
+		// Margin at the peer of this one reading, at the power it was sent back with
+		if ((int16_t)rssi + (l->power - TX_POWER_PEER_DBM * 10) / 10 - TX_POWER_SENSITIVITY_DBM < TX_POWER_FADE_MARGIN_DB
+				&& l->power < TX_POWER_MAX_DBM10)
+		{
+			tx_power_account();
+			l->power = TX_POWER_MAX_DBM10;
+			l->step_ticks = history_time_ticks();
+			tx_power_stats.fades++;
+			tx_power_apply();
+			return;
+		}
+
+		int16_t target = (TX_POWER_SENSITIVITY_DBM + TX_POWER_TARGET_MARGIN_DB + TX_POWER_PEER_DBM) * 10 - l->rssi_q4 * 10 / 16;
+		target = (target < TX_POWER_MIN_DBM10) ? TX_POWER_MIN_DBM10 : target;
+		target = (target > TX_POWER_MAX_DBM10) ? TX_POWER_MAX_DBM10 : target;
+
+		int16_t step = target - l->power;
+		if (step <= TX_POWER_HYSTERESIS_DB * 10 && step >= -TX_POWER_HYSTERESIS_DB * 10)
+		{
+			return;
+		}
+		if (tx_power_ms_since(l->step_ticks) < TX_POWER_STEP_MS)
+		{
+			return;
+		}
+		step = (step > TX_POWER_STEP_DB * 10) ? TX_POWER_STEP_DB * 10 : step;
+		step = (step < -TX_POWER_STEP_DB * 10) ? -TX_POWER_STEP_DB * 10 : step;
+
+		tx_power_account();
+		l->power += step;
+		l->step_ticks = history_time_ticks();
+		tx_power_stats.steps++;
+		tx_power_apply();
+	#endif
+}
+
+// Filtered RSSI of 'link', dBm
+int8_t tx_power_rssi_dbm(uint8_t link)
+{
+	return (int8_t)(tx_power_link[link].rssi_q4 / 16);
+}
+
+void tx_power_connection_closed(uint8_t link, uint16_t reason)
+{
+
+	if (tx_power_link[link].connected == false)
+	{
+		return;
+	}
+
+	tx_power_account();
+	tx_power_link[link].connected = false;
+	if (reason == bg_err_bt_connection_timeout)
+	{
+		tx_power_stats.link_losses++;
+	}
+	tx_power_apply();
+
+}
+
+void tx_power_log_stats(void)
+{
+
+	tx_power_account();
+	#if INCLUDE_LOGGING
+		LOG_INFO("TX power: now %d dBm10, mean %ld dBm10 over %lu s connected, %lu RSSI samples, %lu steps, %lu fades, "
+				"%lu connections, %lu link losses",
+				tx_power_stats.power,
+				(tx_power_stats.connected_ms != 0) ? (int32_t)(tx_power_stats.power_ms / tx_power_stats.connected_ms) : 0,
+				tx_power_stats.connected_ms / 1000, tx_power_stats.samples, tx_power_stats.steps, tx_power_stats.fades,
+				tx_power_stats.connections, tx_power_stats.link_losses);
+	#endif
+
+}
@@ -0,0 +1,86 @@
+/*********************************************************************************************
+ *  @file  tx_power.h
+ *	@brief Closed loop TX power of the connections. The RSSI of the peer is smoothed with an
+ *		   EWMA and the TX power is set so our packets reach the peer with a target link
+ *		   margin above its sensitivity, assuming a symmetric path and a peer sending at
+ *		   TX_POWER_PEER_DBM. A change needs the power to be more than the hysteresis off the
+ *		   target and is limited to one step per TX_POWER_STEP_MS, so one noisy reading no
+ *		   longer moves the power. A reading close to the sensitivity (a fade) goes to the
+ *		   maximum at once.
+ *
+ *		   The radio has one TX power for all links, it is set for the weakest one. Only the
+ *		   server adapts by default: the loop measures the peer's power, two ends adapting to
+ *		   each other would chase each other down.
+ *
+ *		   The time weighted average TX power while connected and the link losses
+ *		   (supervision timeouts) are counted to compare against a fixed power.
+ *
+ *  @authors : Rajat Chaple (GATT client code)
+ *  		   Sundar Krishnakumar (GATT server code)
+ *
+ *  @date      April 29, 2020 (last update)
+ **********************************************************************************************/
+#include "ble_device_type.h"
+
+#ifndef __TX_POWER_H__
+#define __TX_POWER_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#if BUILD_INCLUDES_BLE_CLIENT
+#define TX_POWER_CONTROL			(0)		// 0: fixed TX_POWER_IDLE_DBM10, the server adapts
+#define TX_POWER_LINKS				CLIENT_MAX_SERVERS
+#else
+#define TX_POWER_CONTROL			(1)
+#define TX_POWER_LINKS				(1)
+#endif
+
+// 0.1 dBm units as gecko_cmd_system_set_tx_power() takes them, EFR32BG13 goes up to 10 dBm
+#define TX_POWER_MIN_DBM10			(-300)
+#define TX_POWER_MAX_DBM10			(100)
+#define TX_POWER_IDLE_DBM10			(0)		// not connected, and the start of every connection
+
+#define TX_POWER_SENSITIVITY_DBM	(-90)	// 1M PHY, with some allowance for the peer
+#define TX_POWER_PEER_DBM			(0)
+#define TX_POWER_TARGET_MARGIN_DB	(20)
+#define TX_POWER_FADE_MARGIN_DB		(6)		// below this from one reading: maximum power
+#define TX_POWER_HYSTERESIS_DB		(3)
+#define TX_POWER_STEP_DB			(3)
+#define TX_POWER_STEP_MS			(1000)
+#define TX_POWER_EWMA_SHIFT			(3)		// alpha 1/8
+
+typedef struct tx_power_link_s
+{
+	bool connected;
+	bool rssi_valid;
+	int16_t rssi_q4;			// EWMA of the RSSI, 1/16 dBm
+	int16_t power;				// dBm10 this link needs
+	uint32_t step_ticks;		// last change
+
+}tx_power_link_t;
+
+typedef struct tx_power_stats_s
+{
+	int16_t power;				// dBm10 the radio is set to
+	uint32_t power_ticks;		// since then
+	uint32_t connected_ms;		// with at least one link
+	int64_t power_ms;			// dBm10 * ms while connected
+
+	uint32_t samples;
+	uint32_t steps;
+	uint32_t fades;
+	uint32_t connections;
+	uint32_t link_losses;		// supervision timeouts
+
+}tx_power_stats_t;
+
+extern tx_power_stats_t tx_power_stats;
+
+void tx_power_connection_opened(uint8_t link);
+void tx_power_rssi(uint8_t link, int8_t rssi);
+int8_t tx_power_rssi_dbm(uint8_t link);
+void tx_power_connection_closed(uint8_t link, uint16_t reason);
+void tx_power_log_stats(void);
+
+#endif /* __TX_POWER_H__ */